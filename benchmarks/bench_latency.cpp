@@ -0,0 +1,99 @@
+//
+// Created by niko on 24.09.2021.
+//
+// Request latency with and without TCP_NODELAY. Requests are sent at a steady
+// rate from another thread, so a write often goes while the previous one
+// is not acknowledged yet, which Nagle's algorithm holds back. With "-" for the
+// server address, the default, a PING server on the loopback in this process is used.
+//
+
+#include "ping_server.hpp"
+
+#include <redis_async/redis_async.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace redis_async;
+    using clock_type = std::chrono::steady_clock;
+
+    /** Latencies of the requests in microseconds, sorted */
+    std::vector<double> run(const std::string &alias, std::size_t requests,
+                            std::chrono::microseconds period) {
+        std::vector<double> latencies;
+        std::mutex mutex;
+        std::atomic<std::size_t> done{0};
+        auto next = clock_type::now();
+        for (std::size_t i = 0; i < requests; ++i) {
+            std::this_thread::sleep_until(next);
+            next += period;
+            auto sent = clock_type::now();
+            rd_service::execute(
+                rdalias{alias}, cmd::ping(),
+                [&, sent](const result_t &) {
+                    std::chrono::duration<double, std::micro> elapsed = clock_type::now() - sent;
+                    std::lock_guard<std::mutex> lock{mutex};
+                    latencies.push_back(elapsed.count());
+                    ++done;
+                },
+                [&](const error::rd_error &e) {
+                    std::cerr << e.what() << std::endl;
+                    ++done;
+                });
+        }
+        while (done < requests)
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    double percentile(const std::vector<double> &sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(sorted.size() * p))];
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    std::unique_ptr<bench::ping_server> loopback;
+    std::string uri = argc > 1 ? argv[1] : "-";
+    if (uri == "-") {
+        loopback = std::make_unique<bench::ping_server>();
+        uri = loopback->address();
+    }
+    std::size_t requests = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+    std::chrono::microseconds period{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 50};
+
+    rd_service::add_connection(
+        connection_options::parse("nodelay=tcp://" + uri + "?tcp_nodelay=true"), 1);
+    rd_service::add_connection(
+        connection_options::parse("nagle=tcp://" + uri + "?tcp_nodelay=false"), 1);
+    std::thread loop{[] { rd_service::run(); }};
+
+    std::cout << "tcp_nodelay        p50, us      p99, us    p99.9, us      max, us\n";
+    for (auto alias : {"nodelay", "nagle"}) {
+        run(alias, requests / 10, period); // Warm up
+        auto latencies = run(alias, requests, period);
+        if (latencies.empty())
+            continue;
+        std::cout << std::setw(11) << (alias == std::string{"nodelay"} ? "true" : "false")
+                  << std::fixed << std::setprecision(0) << std::setw(13)
+                  << percentile(latencies, 0.5) << std::setw(13) << percentile(latencies, 0.99)
+                  << std::setw(13) << percentile(latencies, 0.999) << std::setw(13)
+                  << latencies.back() << '\n';
+    }
+
+    rd_service::stop();
+    loop.join();
+    return 0;
+}
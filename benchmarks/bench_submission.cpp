@@ -0,0 +1,150 @@
+//
+// Created by niko on 20.09.2021.
+//
+// Contention of the request submission path: producer threads submit
+// requests, one thread takes them, as the io_service thread of a pool does.
+// Compares the lock-free queue of the pool to a queue under a mutex, as a
+// baseline, then goes through rd_service::execute to a pool connected to a
+// PING server on the loopback.
+//
+
+#include "ping_server.hpp"
+
+#include <redis_async/commands.hpp>
+#include <redis_async/details/connection/events.hpp>
+#include <redis_async/details/mpsc_queue.hpp>
+#include <redis_async/redis_async.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+    using redis_async::details::events::execute;
+
+    class mutex_queue {
+    public:
+        void push(execute &&evt) {
+            std::lock_guard<std::recursive_mutex> lock{mutex_};
+            queue_.push(std::move(evt));
+        }
+        std::optional<execute> pop() {
+            std::lock_guard<std::recursive_mutex> lock{mutex_};
+            if (queue_.empty())
+                return std::nullopt;
+            std::optional<execute> evt{std::move(queue_.front())};
+            queue_.pop();
+            return evt;
+        }
+
+    private:
+        std::recursive_mutex mutex_;
+        std::queue<execute> queue_;
+    };
+
+    /** Requests per second submitted by all the producers */
+    template <typename Queue>
+    double run(std::size_t producers, std::size_t requests) {
+        Queue queue;
+        std::atomic<bool> start{false};
+        std::vector<std::thread> threads;
+        auto per_producer = requests / producers;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&] {
+                while (!start)
+                    std::this_thread::yield();
+                for (std::size_t i = 0; i < per_producer; ++i)
+                    queue.push(execute{redis_async::cmd::get("key")});
+            });
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        for (std::size_t taken = 0, total = per_producer * producers; taken < total;) {
+            if (queue.pop())
+                ++taken;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        for (auto &t : threads)
+            t.join();
+        return per_producer * producers / elapsed.count();
+    }
+
+    struct service_rate {
+        double submitted; ///< Requests per second the producers hand to rd_service
+        double completed; ///< Requests per second answered by the server
+    };
+
+    /** Requests of all the producers through rd_service::execute to the pool of the alias */
+    service_rate run_service(const std::string &alias, std::size_t producers,
+                             std::size_t requests) {
+        using namespace redis_async;
+        std::atomic<bool> start{false};
+        std::atomic<std::size_t> done{0};
+        std::vector<std::thread> threads;
+        auto per_producer = requests / producers;
+        auto total = per_producer * producers;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&] {
+                while (!start)
+                    std::this_thread::yield();
+                for (std::size_t i = 0; i < per_producer; ++i)
+                    rd_service::execute(
+                        rdalias{alias}, cmd::ping(), [&done](const result_t &) { ++done; },
+                        [&done](const error::rd_error &e) {
+                            std::cerr << e.what() << std::endl;
+                            ++done;
+                        });
+            });
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        for (auto &t : threads)
+            t.join();
+        std::chrono::duration<double> submitted = std::chrono::steady_clock::now() - begin;
+        while (done < total)
+            std::this_thread::yield();
+        std::chrono::duration<double> completed = std::chrono::steady_clock::now() - begin;
+        return {total / submitted.count(), total / completed.count()};
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    std::size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    std::size_t service_requests = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    std::size_t pool_size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4;
+
+    std::cout << "producers      mutex, req/s       mpsc, req/s\n";
+    for (std::size_t producers = 1; producers <= 32; producers *= 2) {
+        auto locked = run<mutex_queue>(producers, requests);
+        auto lock_free = run<redis_async::details::mpsc_queue<execute>>(producers, requests);
+        std::cout << std::setw(9) << producers << std::fixed << std::setprecision(0)
+                  << std::setw(18) << locked << std::setw(18) << lock_free << '\n';
+    }
+
+    using redis_async::rd_service;
+    bench::ping_server server;
+    rd_service::add_connection(
+        redis_async::connection_options::parse("bench=tcp://" + server.address()), pool_size);
+    std::thread loop{[] { rd_service::run(); }};
+
+    run_service("bench", 1, service_requests / 10); // Warm up
+    std::cout << "\nproducers  submitted, req/s  completed, req/s\n";
+    for (std::size_t producers = 1; producers <= 32; producers *= 2) {
+        auto rate = run_service("bench", producers, service_requests);
+        std::cout << std::setw(9) << producers << std::fixed << std::setprecision(0)
+                  << std::setw(18) << rate.submitted << std::setw(18) << rate.completed << '\n';
+    }
+
+    rd_service::stop();
+    loop.join();
+    return 0;
+}
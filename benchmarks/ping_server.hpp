@@ -0,0 +1,98 @@
+//
+// Created by niko on 19.10.2021.
+//
+
+#ifndef REDIS_ASYNC_PING_SERVER_HPP
+#define REDIS_ASYNC_PING_SERVER_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace bench {
+
+    /** Answers +PONG to every PING, in its own thread */
+    class ping_server {
+        using tcp = boost::asio::ip::tcp;
+
+    public:
+        ping_server()
+            : acceptor_(service_, tcp::endpoint{boost::asio::ip::address_v4::loopback(), 0}) {
+            accept();
+            thread_ = std::thread{[this] { service_.run(); }};
+        }
+        ~ping_server() {
+            service_.stop();
+            thread_.join();
+        }
+
+        std::string address() const {
+            return "127.0.0.1:" + std::to_string(acceptor_.local_endpoint().port());
+        }
+
+    private:
+        struct session {
+            explicit session(boost::asio::io_service &svc)
+                : socket(svc) {
+            }
+            tcp::socket socket;
+            std::array<char, 4096> buffer;
+            std::string incoming;
+            std::string outgoing;
+        };
+        using session_ptr = std::shared_ptr<session>;
+
+        void accept() {
+            auto s = std::make_shared<session>(service_);
+            acceptor_.async_accept(s->socket, [this, s](boost::system::error_code ec) {
+                if (ec)
+                    return;
+                // The server side answers at once, only the client side is measured
+                s->socket.set_option(tcp::no_delay(true));
+                read(s);
+                accept();
+            });
+        }
+
+        void read(const session_ptr &s) {
+            s->socket.async_read_some(boost::asio::buffer(s->buffer),
+                                      [this, s](boost::system::error_code ec, std::size_t size) {
+                                          if (ec)
+                                              return;
+                                          s->incoming.append(s->buffer.data(), size);
+                                          answer(s);
+                                      });
+        }
+
+        void answer(const session_ptr &s) {
+            static const std::string ping{"PING\r\n"};
+            std::string::size_type pos = 0, end = 0;
+            while ((pos = s->incoming.find(ping, end)) != std::string::npos) {
+                end = pos + ping.size();
+                s->outgoing += "+PONG\r\n";
+            }
+            s->incoming.erase(0, end);
+            if (s->outgoing.empty())
+                return read(s);
+            auto out = std::make_shared<std::string>(std::move(s->outgoing));
+            s->outgoing.clear();
+            boost::asio::async_write(s->socket, boost::asio::buffer(*out),
+                                     [this, s, out](boost::system::error_code ec, std::size_t) {
+                                         if (!ec)
+                                             read(s);
+                                     });
+        }
+
+        boost::asio::io_service service_;
+        tcp::acceptor acceptor_;
+        std::thread thread_;
+    };
+
+} // namespace bench
+
+#endif // REDIS_ASYNC_PING_SERVER_HPP
@@ -7,13 +7,113 @@
 
 #include <redis_async/command_options.hpp>
 #include <redis_async/error.hpp>
+#include <boost/container/small_vector.hpp>
 #include <variant>
 #include <string_view>
 #include <chrono>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 
 namespace redis_async {
 
+    /**
+     * @brief Arguments of a command.
+     * Bytes of all arguments are copied into one buffer, kept inline while
+     * they are small, so building a short command allocates nothing.
+     */
+    class command_arguments_t {
+        struct argument_t {
+            std::uint32_t offset;
+            std::uint32_t size;
+        };
+
+    public:
+        static constexpr std::size_t inline_count = 8;
+        static constexpr std::size_t inline_bytes = 128;
+
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::string_view *;
+            using reference = std::string_view;
+
+            const_iterator() = default;
+
+            std::string_view operator*() const {
+                return (*args_)[index_];
+            }
+            const_iterator &operator++() {
+                ++index_;
+                return *this;
+            }
+            const_iterator operator++(int) {
+                auto tmp = *this;
+                ++index_;
+                return tmp;
+            }
+            bool operator==(const const_iterator &rhs) const {
+                return index_ == rhs.index_;
+            }
+            bool operator!=(const const_iterator &rhs) const {
+                return index_ != rhs.index_;
+            }
+
+        private:
+            friend class command_arguments_t;
+            const_iterator(const command_arguments_t *args, std::size_t index)
+                : args_{args}
+                , index_{index} {
+            }
+
+            const command_arguments_t *args_ = nullptr;
+            std::size_t index_ = 0;
+        };
+
+        command_arguments_t() = default;
+
+        template <typename Iterator>
+        command_arguments_t(Iterator first, Iterator last) {
+            std::size_t bytes = 0;
+            for (auto it = first; it != last; ++it)
+                bytes += std::string_view{*it}.size();
+            bytes_.reserve(bytes);
+            args_.reserve(std::distance(first, last));
+            for (; first != last; ++first)
+                push_back(*first);
+        }
+
+        /** Copy the argument */
+        void push_back(std::string_view arg) {
+            args_.push_back({static_cast<std::uint32_t>(bytes_.size()),
+                             static_cast<std::uint32_t>(arg.size())});
+            bytes_.insert(bytes_.end(), arg.begin(), arg.end());
+        }
+
+        std::size_t size() const {
+            return args_.size();
+        }
+        bool empty() const {
+            return args_.empty();
+        }
+        std::string_view operator[](std::size_t index) const {
+            auto &arg = args_[index];
+            return {bytes_.data() + arg.offset, arg.size};
+        }
+        const_iterator begin() const {
+            return {this, 0};
+        }
+        const_iterator end() const {
+            return {this, args_.size()};
+        }
+
+    private:
+        boost::container::small_vector<argument_t, inline_count> args_;
+        boost::container::small_vector<char, inline_bytes> bytes_;
+    };
+
     struct single_command_t {
 
         template <bool...>
@@ -23,7 +123,7 @@ namespace redis_async {
         template <class R, class... Ts>
         using are_all_constructible = all_true<std::is_constructible<R, Ts>::value...>;
 
-        using args_container_t = std::vector<std::string>;
+        using args_container_t = command_arguments_t;
         args_container_t arguments;
 
         single_command_t(std::initializer_list<std::string_view> args)
@@ -38,6 +138,14 @@ namespace redis_async {
     using command_container_t = std::vector<single_command_t>;
     using command_wrapper_t = std::variant<command_container_t, single_command_t>;
 
+    /**
+     * @brief The command only reads, running it twice is the same as once.
+     * Such requests can be sent again after the connection fails.
+     */
+    bool is_idempotent(const single_command_t &cmd);
+    /** A batch is idempotent if all of its commands are */
+    bool is_idempotent(const command_wrapper_t &cmd);
+
     namespace cmd {
         // ping commands
         single_command_t ping(std::string_view msg = {});
@@ -66,6 +174,7 @@ namespace redis_async {
                               std::initializer_list<std::pair<std::string_view, std::string_view>> kv);
         single_command_t hdel(std::string_view key, std::initializer_list<std::string_view> keys);
         single_command_t hget(std::string_view key, std::string_view field);
+        single_command_t hgetall(std::string_view key);
         single_command_t hkeys(std::string_view key);
         single_command_t hmset(std::string_view key,
                                std::initializer_list<std::pair<std::string_view, std::string_view>> kv);
@@ -96,6 +205,10 @@ namespace redis_async {
         single_command_t sunion(std::initializer_list<std::string_view> keys);
         single_command_t sunionstore(std::string_view dest, std::initializer_list<std::string_view> keys);
 
+        // pub/sub commands, subscriptions are made with rd_service::subscribe
+        single_command_t publish(std::string_view channel, std::string_view message);
+        single_command_t spublish(std::string_view channel, std::string_view message);
+
     } // namespace cmd
 
 } // namespace redis_async
@@ -6,14 +6,17 @@
 #define REDIS_ASYNC_COMMON_HPP
 
 #include <redis_async/error.hpp>
+#include <redis_async/flat_reply.hpp>
 #include <redis_async/rd_types.hpp>
 
 #include <boost/optional.hpp>
 #include <boost/utility/string_view.hpp>
 #include <chrono>
+#include <cstdint>
 #include <cxxabi.h>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 
 namespace redis_async {
@@ -38,17 +41,61 @@ namespace redis_async {
 
     namespace details {
         class basic_connection;
+        class basic_reply_decoder;
+
+        /** What a request does if the request queue of its pool is full */
+        enum class admission {
+            reject,   ///< Fail with error::queue_full_error
+            try_once, ///< Do not submit the request, tell the caller
+            wait      ///< Wait in the pool until there is room
+        };
+
+        /** Command a subscription is made with */
+        enum class subscription_kind {
+            channel,      ///< SUBSCRIBE
+            pattern,      ///< PSUBSCRIBE
+            shard_channel ///< SSUBSCRIBE
+        };
     } // namespace details
     using connection_ptr = std::shared_ptr<details::basic_connection>;
+    using reply_decoder_ptr = std::shared_ptr<details::basic_reply_decoder>;
     using optional_size = boost::optional<size_t>;
+    /** @brief Handle to cancel a subscription with */
+    using subscription_id = std::uint64_t;
 
     using simple_callback = std::function<void()>;
     /** @brief Callback for error handling */
     using error_callback = std::function<void(error::rd_error const &)>;
     /** @brief Callback for query results */
     using query_result_callback = std::function<void(result_t)>;
+    /** @brief Callback for query results referring to the receive buffer */
+    using reply_view_callback = std::function<void(reply_view_t)>;
+    /** @brief Callback for query results in a single contiguous allocation */
+    using flat_reply_callback = std::function<void(flat_reply_t)>;
+    /** @brief Callback for query results decoded into T */
+    template <typename T>
+    using typed_result_callback = std::function<void(T)>;
+    /** @brief Reply to a command of a batch */
+    struct batch_reply_t {
+        result_t value;                          ///< nil_t if the command failed
+        std::optional<error::query_error> error; ///< Set if the command failed
+    };
+    /** @brief Callback for results of a batch of queries, in the order of commands */
+    using batch_result_callback = std::function<void(std::vector<batch_reply_t>)>;
     /** @brief Callback for a query error */
     using query_error_callback = std::function<void(error::query_error const &)>;
+    /** @brief Callback for messages of a subscribed channel */
+    using message_callback = std::function<void(pubsub_message_t const &)>;
+
+    /** @brief Counters of the client side cache of a database alias */
+    struct cache_stats_t {
+        std::size_t hits = 0;          ///< Requests answered from the cache
+        std::size_t misses = 0;        ///< Cacheable requests sent to the server
+        std::size_t invalidations = 0; ///< Keys dropped as the server told they changed
+        std::size_t evictions = 0;     ///< Keys dropped to stay within the size limit
+        std::size_t entries = 0;       ///< Keys cached now
+        std::size_t bytes = 0;         ///< Approximate memory taken by them
+    };
 
     /**
      * @brief Short unique string to refer a database alias.
@@ -87,10 +134,32 @@ namespace redis_async {
         std::string schema; ///< Database connection schema. Currently supported are tcp and socket
         std::string uri;    ///< Connection uri. `host:port` for tcp, `/path/to/file` for socket
         std::string database;                         ///< Database id
+        std::string user;                             ///< ACL user name, empty for default
         std::string password;                         ///< Database user's password
+        std::string client_name;                      ///< CLIENT SETNAME of every connection
+        int protocol = 0; ///< RESP version asked for by HELLO, 0 does not send HELLO
         bool keep_alive = false;                      ///< keep alive connection
-        std::chrono::milliseconds connect_timeout{0}; ///<
-        std::chrono::milliseconds socket_timeout{0};  ///<
+        std::chrono::milliseconds keep_alive_idle{0};     ///< Before the first probe, 0 is OS default
+        std::chrono::milliseconds keep_alive_interval{0}; ///< Between probes, 0 is OS default
+        std::size_t keep_alive_count = 0; ///< Unanswered probes to drop the connection after
+        bool tcp_nodelay = true;          ///< Disable Nagle's algorithm
+        std::size_t recv_buffer_size = 0; ///< SO_RCVBUF, 0 means OS default
+        std::size_t send_buffer_size = 0; ///< SO_SNDBUF, 0 means OS default
+        bool quick_ack = false;           ///< Set TCP_QUICKACK before every read, Linux only
+        std::chrono::milliseconds connect_timeout{0}; ///< Connect fails after, 0 means no limit
+        std::chrono::milliseconds socket_timeout{0};  ///< Default request timeout, 0 means none
+        std::size_t max_flush_size = 256 * 1024; ///< Max bytes of one write, 0 means no limit
+        bool inline_completion = false; ///< Call result callbacks from the read handler
+        std::size_t max_connections = 0; ///< Pool size, if not given to add_connection
+        std::size_t min_idle = 0;        ///< Connections kept open and idle in the pool
+        std::chrono::milliseconds idle_timeout{0}; ///< Idle connections above min_idle close after
+        std::size_t max_queue_size = 0;  ///< Requests of a pool not answered yet, 0 means no limit
+        std::size_t max_queue_bytes = 0; ///< Bytes of these requests, 0 means no limit
+        std::chrono::milliseconds reconnect_delay{100};       ///< First reconnect after a failure
+        std::chrono::milliseconds max_reconnect_delay{10000}; ///< Limit of the growing delay
+        bool replay_requests = false; ///< Send idempotent requests again after a failure
+        std::size_t client_cache_size = 0; ///< Bytes of the client side cache, 0 disables it
+        bool cluster = false; ///< Redis Cluster, the uri is one of its nodes
 
         /**
          * Parse a connection string
@@ -0,0 +1,81 @@
+//
+// Created by niko on 08.10.2021.
+//
+
+#ifndef REDIS_ASYNC_CLIENT_CACHE_HPP
+#define REDIS_ASYNC_CLIENT_CACHE_HPP
+
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <redis_async/commands.hpp>
+#include <redis_async/common.hpp>
+
+namespace redis_async {
+    namespace details {
+
+        /**
+         * Replies of GET, HGET and MGET kept in the client, least recently used
+         * keys are evicted to stay within the size limit. The server tracks the
+         * keys read by the connections (CLIENT TRACKING) and tells when they
+         * change, the keys are dropped then. Thread safe.
+         */
+        class client_cache : private boost::noncopyable {
+        public:
+            /** Keys of a request filling the cache, taken before it is sent */
+            struct fill_t {
+                single_command_t command;
+                ::std::atomic_bool done{false};
+            };
+            using fill_ptr = ::std::shared_ptr<fill_t>;
+
+        public:
+            explicit client_cache(size_t max_bytes);
+            ~client_cache();
+
+            /** The command is GET, HGET or MGET */
+            static bool cacheable(const single_command_t &cmd);
+
+            /**
+             * Reply to the command from the cache.
+             * @return false if any of its keys is not cached
+             */
+            bool lookup(const single_command_t &cmd, result_t &value);
+            /**
+             * A reply to the command will fill the cache. Invalidations of its
+             * keys coming before the reply keep it out of the cache.
+             */
+            fill_ptr start_fill(const single_command_t &cmd);
+            /**
+             * Cache the reply, nullptr if the request failed. Only the first
+             * call for the fill counts, a failure after the reply does nothing.
+             */
+            void complete_fill(const fill_ptr &fill, const result_t *value);
+
+            /** Invalidation message of the server, a push frame of RESP3 */
+            void on_push(const reply_view_t &reply);
+            /** The request filling the cache is written to the connection, it reads the keys */
+            void sent(const single_command_t &cmd, const void *reader);
+            /**
+             * Drop the keys read through a closed connection, the server stops
+             * tracking them for it. Keys read through the others stay.
+             */
+            void forget_reader(const void *reader);
+
+            cache_stats_t stats() const;
+
+        private:
+            struct impl;
+            using pimpl = ::std::unique_ptr<impl>;
+            pimpl pimpl_;
+        };
+
+        using client_cache_ptr = ::std::shared_ptr<client_cache>;
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_CLIENT_CACHE_HPP
@@ -0,0 +1,104 @@
+//
+// Created by niko on 11.10.2021.
+//
+
+#ifndef REDIS_ASYNC_CLUSTER_HPP
+#define REDIS_ASYNC_CLUSTER_HPP
+
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <redis_async/commands.hpp>
+#include <redis_async/common.hpp>
+
+namespace redis_async {
+    namespace details {
+
+        class connection_pool;
+
+        /** Number of hash slots of a Redis Cluster */
+        constexpr std::size_t cluster_slots = 16384;
+
+        /** Slot of the key, only the part in braces counts if the key has a hash tag */
+        std::uint16_t key_slot(std::string_view key);
+        /** The key the command is routed by, none for commands without keys */
+        std::optional<std::string_view> command_key(const single_command_t &cmd);
+
+        /** Part of a multi-key command with the keys of one slot */
+        struct key_group_t {
+            single_command_t command;
+            std::vector<std::size_t> positions; ///< Of its keys among the keys of the command
+        };
+        /**
+         * Split MGET, DEL, EXISTS or UNLINK by the slots of its keys, in the
+         * order the slots first appear.
+         */
+        std::vector<key_group_t> split_by_slot(const single_command_t &cmd);
+
+        /**
+         * Nodes of a Redis Cluster, a pool for each. Commands go to the node
+         * serving the slot of their key. The slot table is read with CLUSTER
+         * SLOTS, and is corrected by MOVED replies until it is read again.
+         */
+        class cluster : public ::std::enable_shared_from_this<cluster>, private boost::noncopyable {
+        public:
+            using connection_pool_ptr = ::std::shared_ptr<connection_pool>;
+            /** Pool of every event loop for a node */
+            using shard_pools = ::std::vector<connection_pool_ptr>;
+            using pools_factory = ::std::function<shard_pools(connection_options const &)>;
+            using cluster_ptr = ::std::shared_ptr<cluster>;
+
+        public:
+            /** Connects to the node of the options and reads the slot table from it */
+            static cluster_ptr create(connection_options const &co, pools_factory &&factory);
+            ~cluster();
+
+            rdalias const &alias() const;
+            /**
+             * Send the command to the node of its slot, to any node if it has no
+             * key. A batch goes to the node of its first key. MGET, DEL, EXISTS
+             * and UNLINK with keys of several slots are split, their parts are
+             * sent at once and their replies merged, unless the reply is a view.
+             * @param shard Event loop the pool of the node is chosen by
+             */
+            bool get_connection(size_t shard, command_wrapper_t &&cmd,
+                                query_result_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout, admission adm);
+            bool get_connection(size_t shard, command_wrapper_t &&cmd,
+                                reply_view_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout, admission adm);
+            bool get_connection(size_t shard, command_wrapper_t &&cmd,
+                                flat_reply_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout, admission adm);
+            bool get_connection(size_t shard, command_wrapper_t &&cmd, reply_decoder_ptr &&decoder,
+                                error_callback &&err, std::chrono::milliseconds timeout,
+                                admission adm);
+
+            /** Read the slot table again, unless it is being read */
+            void refresh();
+            /** host:port of the node serving the slot, empty until the slot table is read */
+            ::std::string node_address(::std::uint16_t slot) const;
+            /** Pools of all the known nodes */
+            ::std::vector<connection_pool_ptr> pools() const;
+            /** No more nodes are connected to, the pools are left to close */
+            ::std::vector<connection_pool_ptr> close();
+
+        private:
+            cluster(connection_options const &co, pools_factory &&factory);
+
+        private:
+            struct impl;
+            using pimpl = ::std::unique_ptr<impl>;
+            pimpl pimpl_;
+        };
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_CLUSTER_HPP
@@ -27,13 +27,47 @@ namespace redis_async {
         using connection_event_callback = std::function<void(basic_connection_ptr)>;
         using connection_error_callback =
             std::function<void(basic_connection_ptr, error::connection_error)>;
+        using connection_push_callback = std::function<void(reply_view_t &&)>;
+        using connection_push_error_callback = std::function<void(error::query_error const &)>;
 
         struct connection_callbacks {
-            connection_event_callback idle;
-            connection_event_callback terminated;
-            connection_error_callback error;
+            connection_event_callback idle{};
+            connection_event_callback terminated{};
+            connection_error_callback error{};
+            connection_push_callback push{};             ///< Replies of a subscribed connection
+            connection_push_error_callback push_error{}; ///< Error replies of a subscribed one
         };
 
+        /**
+         * Call the result callback, exceptions it throws go to the error callback.
+         * @param conn_number Connection of the reply, 0 for a reply from the client cache
+         */
+        template <typename Callback, typename Reply>
+        void deliver_result(size_t conn_number, const Callback &result_cb,
+                            const error_callback &error_cb, Reply &&res) {
+            try {
+                result_cb(std::move(res));
+            } catch (error::rd_error const &e) {
+                LOG4CXX_TRACE(logger_def, "Conn#" << conn_number
+                                                  << ": Query result handler throwed a db_error: "
+                                                  << e.what());
+                if (error_cb)
+                    error_cb(e);
+            } catch (std::exception const &e) {
+                LOG4CXX_TRACE(logger_def, "Conn#" << conn_number
+                                                  << ": Query result handler throwed an exception: "
+                                                  << e.what());
+                if (error_cb)
+                    error_cb(error::client_error(e));
+            } catch (...) {
+                LOG4CXX_TRACE(logger_def,
+                              "Conn#" << conn_number
+                                      << ": Query result handler throwed an unknown exception");
+                if (error_cb)
+                    error_cb(error::client_error("Unknown exception"));
+            }
+        }
+
         class basic_connection : public boost::noncopyable {
         public:
             using io_service_ptr = asio_config::io_service_ptr;
@@ -49,6 +83,15 @@ namespace redis_async {
             rdalias const &alias() const;
             void execute(events::execute &&evt);
             void terminate();
+            /** Requests sent to the connection and not replied yet */
+            size_t outstanding();
+            /** Idempotent requests the failed connection left without replies */
+            std::vector<events::execute> take_replay();
+            /**
+             * Send a (P|S)(UN)SUBSCRIBE command. The connection serves only
+             * subscriptions since then, its replies go to the push callbacks.
+             */
+            void subscribe(single_command_t &&cmd);
 
         protected:
             basic_connection() = default;
@@ -58,6 +101,9 @@ namespace redis_async {
             virtual rdalias const &aliasImpl() const = 0;
             virtual void executeImpl(events::execute &&evt) = 0;
             virtual void terminateImpl() = 0;
+            virtual size_t outstandingImpl() = 0;
+            virtual std::vector<events::execute> takeReplayImpl() = 0;
+            virtual void subscribeImpl(single_command_t &&cmd) = 0;
         };
 
     } // namespace details
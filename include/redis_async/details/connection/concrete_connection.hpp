@@ -54,13 +54,25 @@ namespace redis_async {
                 LOG4CXX_ERROR(logger_def,
                               "Conn#" << fsm_type::number() << ": Connection error " << e.what());
                 if (callbacks_.error) {
-                    callbacks_.error(connection_ptr(), e);
+                    callbacks_.error(fsm_type::shared_from_this(), e);
                 } else {
                     LOG4CXX_ERROR(logger_def,
                                   "Conn#" << fsm_type::number() << ": No connection_error callback");
                 }
             }
 
+            void notifyPushImpl(reply_view_t &&reply) override {
+                if (callbacks_.push)
+                    callbacks_.push(std::move(reply));
+            }
+
+            void notifyPushErrorImpl(error::query_error const &e) override {
+                LOG4CXX_WARN(logger_def,
+                             "Conn#" << fsm_type::number() << ": Subscription error " << e.what());
+                if (callbacks_.push_error)
+                    callbacks_.push_error(e);
+            }
+
         private:
             void connectImpl(connection_options const &opts) override {
                 fsm_type::process_event(opts);
@@ -78,6 +90,18 @@ namespace redis_async {
                 fsm_type::process_event(events::terminate{});
             }
 
+            size_t outstandingImpl() override {
+                return fsm_type::pending_requests();
+            }
+
+            std::vector<events::execute> takeReplayImpl() override {
+                return fsm_type::release_replay();
+            }
+
+            void subscribeImpl(single_command_t &&cmd) override {
+                fsm_type::process_event(events::subscribe{std::move(cmd)});
+            }
+
         private:
             connection_callbacks callbacks_;
         };
@@ -5,9 +5,9 @@
 #ifndef REDIS_ASYNC_CONNECTION_FSM_HPP
 #define REDIS_ASYNC_CONNECTION_FSM_HPP
 
-#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
-#include <boost/asio/streambuf.hpp>
+#include <boost/mpl/vector/vector30.hpp>
 #include <boost/msm/back/state_machine.hpp>
 #include <boost/msm/front/functor_row.hpp>
 #include <boost/msm/front/state_machine_def.hpp>
@@ -17,10 +17,16 @@
 #include <redis_async/details/connection/base_connection.hpp>
 #include <redis_async/details/connection/events.hpp>
 #include <redis_async/details/connection/handler_parse_result.hpp>
-#include <redis_async/details/protocol/parser.hpp>
+#include <redis_async/details/connection/recv_buffer.hpp>
+#include <redis_async/details/protocol/stream_parser.hpp>
 #include <redis_async/details/protocol/serializer.hpp>
 #include <redis_async/error.hpp>
 
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+
 namespace redis_async {
     namespace details {
 
@@ -41,13 +47,41 @@ namespace redis_async {
             using state = msm::front::state<>;
             using terminate_state = msm::front::terminate_state<>;
 
-            using buffer = boost::asio::streambuf;
-            using iterator = boost::asio::buffers_iterator<buffer::const_buffers_type, char>;
+            using buffer = recv_buffer_t;
+            using decoded_callback = std::function<void(reply_decoder_ptr)>;
+            using iterator = const char *;
+            using clock_type = std::chrono::steady_clock;
+
+            /** Minimal free space in the receive buffer for a read */
+            static constexpr std::size_t read_size = 2048;
+            /** Larger write buffers are freed after the write, not kept for reuse */
+            static constexpr std::size_t max_spare_write_buffer = 1024 * 1024;
 
             template <typename SourceState, typename Event, typename TargetState,
                       typename Action = none, typename Guard = none>
             using tr = msm::front::Row<SourceState, Event, TargetState, Action, Guard>;
 
+            /** A request written to the socket and the replies collected for it so far */
+            struct pending_query {
+                events::execute query{};
+                array_holder_t replies{};
+                /** Of the commands of a batch, empty while none of them failed */
+                std::vector<std::optional<error::query_error>> errors{};
+                bool timed_out = false; ///< Failed with timeout_error, the reply is dropped
+
+                /** ASKING ahead of a redirected request, its reply is dropped as well */
+                static pending_query asking() {
+                    pending_query placeholder;
+                    placeholder.timed_out = true;
+                    return placeholder;
+                }
+
+                /** The next reply is the last one the request waits for */
+                bool completed_by_next() const {
+                    return replies.elements.size() + 1 >= query.batch;
+                }
+            };
+
             //@{
             /** @name Actions */
             struct on_connection_error {
@@ -71,13 +105,199 @@ namespace redis_async {
                     fsm.close_transport();
                 }
             };
+
+            struct pipeline_query {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::execute const &evt, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    LOG4CXX_TRACE(logger_states, "Conn#" << fsm.number()
+                                                         << ": connection: pipeline query, "
+                                                         << state.pending_.size()
+                                                         << " pending");
+                    if (evt.expired(clock_type::now())) {
+                        fsm.notify_error(evt, error::timeout_error("Request timed out"));
+                        return;
+                    }
+                    fsm.send_query(state.pending_, evt);
+                }
+            };
+
+            struct on_reply {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::recv const &evt, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    if (state.pending_.empty()) {
+                        LOG4CXX_WARN(logger_states,
+                                     "Conn#" << fsm.number() << ": connection: unexpected reply");
+                        return;
+                    }
+                    auto &front = state.pending_.front();
+                    if (!front.query.batch) {
+                        auto pending = std::move(front);
+                        state.pending_.pop_front();
+                        if (!pending.timed_out)
+                            fsm.notify_result(std::move(pending.query), evt);
+                        return;
+                    }
+                    front.replies.elements.push_back(std::move(evt.res));
+                    complete_batch(fsm, state);
+                }
+
+                template <typename SourceState, typename TargetState>
+                void operator()(error::query_error const &err, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    if (state.pending_.empty()) {
+                        LOG4CXX_WARN(logger_states, "Conn#" << fsm.number()
+                                                            << ": connection: unexpected error "
+                                                            << err.what());
+                        return;
+                    }
+                    auto &front = state.pending_.front();
+                    if (!front.query.batch) {
+                        auto pending = std::move(front);
+                        state.pending_.pop_front();
+                        if (!pending.timed_out)
+                            fsm.notify_error(pending.query, err);
+                        return;
+                    }
+                    if (front.errors.empty())
+                        front.errors.resize(front.query.batch);
+                    front.errors[front.replies.elements.size()] = err;
+                    front.replies.elements.push_back(nil_t{});
+                    complete_batch(fsm, state);
+                }
+
+                template <typename SourceState>
+                static void complete_batch(connection_fsm_type &fsm, SourceState &state) {
+                    auto &front = state.pending_.front();
+                    if (front.replies.elements.size() < front.query.batch)
+                        return;
+                    auto pending = std::move(front);
+                    state.pending_.pop_front();
+                    if (pending.timed_out)
+                        return;
+                    if (!pending.errors.empty())
+                        fsm.notify_error(pending.query,
+                                         error::batch_error(std::move(pending.replies.elements),
+                                                            std::move(pending.errors)));
+                    else
+                        fsm.notify_result(std::move(pending.query),
+                                          result_t{std::move(pending.replies)});
+                }
+            };
+
+            struct on_setup_reply {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::recv const &, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    if (state.pending_.empty())
+                        return;
+                    LOG4CXX_TRACE(logger_states, "Conn#" << fsm.number() << ": connection: "
+                                                         << state.pending_.front() << " done");
+                    state.pending_.pop_front();
+                }
+            };
+
+            struct send_subscription {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::subscribe const &evt, connection_fsm_type &fsm,
+                                SourceState &, TargetState &) {
+                    fsm.send(evt.command);
+                }
+            };
+
+            /** A message or a confirmation of a subscribed connection */
+            struct on_push {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::recv const &evt, connection_fsm_type &fsm,
+                                SourceState &, TargetState &) {
+                    fsm.notify_push(std::move(evt.view));
+                }
+
+                template <typename SourceState, typename TargetState>
+                void operator()(error::query_error const &err, connection_fsm_type &fsm,
+                                SourceState &, TargetState &) {
+                    fsm.notify_push_error(err);
+                }
+            };
+
+            /** A setup command failed, the connection is not usable */
+            struct on_setup_error {
+                template <typename SourceState, typename TargetState>
+                void operator()(events::recv const &, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    fail(fsm, state, "unexpected reply");
+                }
+
+                template <typename SourceState, typename TargetState>
+                void operator()(error::query_error const &err, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    fail(fsm, state, err.what());
+                }
+
+                template <typename SourceState>
+                static void fail(connection_fsm_type &fsm, SourceState &state,
+                                 const std::string &reason) {
+                    auto command = state.pending_.empty() ? "setup" : state.pending_.front();
+                    error::connection_error err{command + " failed: " + reason};
+                    LOG4CXX_ERROR(logger_states, "Conn#" << fsm.number()
+                                                         << ": connection: " << err.what());
+                    state.pending_.clear();
+                    fsm.close_transport();
+                    fsm.notify_error(err);
+                }
+            };
+            //@}
+
+            //@{
+            /** @name Guards */
+            struct more_pending {
+                template <typename Event, typename SourceState, typename TargetState>
+                bool operator()(Event const &, connection_fsm_type &, SourceState &state,
+                                TargetState &) {
+                    return !state.last_reply();
+                }
+            };
+
+            struct last_pending {
+                template <typename Event, typename SourceState, typename TargetState>
+                bool operator()(Event const &, connection_fsm_type &, SourceState &state,
+                                TargetState &) {
+                    return state.last_reply();
+                }
+            };
+
+            struct more_setup {
+                template <typename SourceState, typename TargetState>
+                bool operator()(events::recv const &evt, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    return state.accepts(evt, fsm.options()) && !state.last_reply();
+                }
+            };
+
+            struct last_setup {
+                template <typename SourceState, typename TargetState>
+                bool operator()(events::recv const &evt, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    return state.accepts(evt, fsm.options()) && state.last_reply();
+                }
+            };
+
+            struct bad_setup {
+                template <typename SourceState, typename TargetState>
+                bool operator()(events::recv const &evt, connection_fsm_type &fsm,
+                                SourceState &state, TargetState &) {
+                    return !state.accepts(evt, fsm.options());
+                }
+            };
             //@}
 
             struct unplugged : state {
                 // clang-format off
                 using deferred_events = mpl::vector<
                     events::terminate,
-                    events::execute
+                    events::execute,
+                    events::subscribe
                     >;
                 // clang-format on
 
@@ -107,7 +327,8 @@ namespace redis_async {
                 // clang-format off
                 using deferred_events = mpl::vector<
                     events::terminate,
-                    events::execute
+                    events::execute,
+                    events::subscribe
                 >;
                 // clang-format on
 
@@ -136,22 +357,63 @@ namespace redis_async {
                 // clang-format off
                 using deferred_events = mpl::vector<
                     events::terminate,
-                    events::execute
+                    events::execute,
+                    events::subscribe
                 >;
                 // clang-format on
 
+                /** Setup commands written to the socket and waiting for replies, oldest first */
+                std::deque<std::string> pending_;
+
+                bool last_reply() const {
+                    return pending_.size() <= 1;
+                }
+
+                /**
+                 * The reply is the one the setup command expects. Errors come as
+                 * query_error, HELLO must answer with the protocol version asked for.
+                 */
+                bool accepts(const events::recv &evt, const connection_options &opts) const {
+                    if (pending_.empty() || pending_.front() != "HELLO")
+                        return true;
+                    auto asked_for = [&opts](const result_t &value) {
+                        auto *proto = std::get_if<int_t>(&value);
+                        return proto && *proto == opts.protocol;
+                    };
+                    // RESP3 answers with a map, RESP2 with an array of keys and values
+                    if (auto *fields = std::get_if<map_holder_t>(&evt.res)) {
+                        for (auto &field : fields->elements) {
+                            auto *key = std::get_if<string_t>(&field.first);
+                            if (key && *key == "proto")
+                                return asked_for(field.second);
+                        }
+                        return false;
+                    }
+                    auto *fields = std::get_if<array_holder_t>(&evt.res);
+                    if (!fields)
+                        return false;
+                    auto &elements = fields->elements;
+                    for (std::size_t i = 0; i + 1 < elements.size(); i += 2) {
+                        auto *key = std::get_if<string_t>(&elements[i]);
+                        if (key && *key == "proto")
+                            return asked_for(elements[i + 1]);
+                    }
+                    return false;
+                }
+
                 template <typename Event>
                 void on_entry(Event const &, connection_fsm_type &fsm) {
                     LOG4CXX_TRACE(logger_states,
                                   "Conn#" << fsm.number() << ": state[authn]: entry");
-                    fsm.send_startup_message();
+                    pending_ = fsm.send_startup_message();
+                    if (pending_.empty())
+                        fsm.process_event(events::complete{});
                 }
 
                 void on_exit(const events::recv &evt, connection_fsm_type &fsm) {
                     boost::ignore_unused_variable_warning(evt);
                     LOG4CXX_TRACE(logger_states,
                                   "Conn#" << fsm.number() << ": state[authn]: exit by recv");
-                    //! @todo check answer
                 }
 
                 template <typename Event>
@@ -177,51 +439,75 @@ namespace redis_async {
                 >;
                 // clang-format on
 
-                events::execute query_;
+                /** Requests written to the socket and waiting for replies, oldest first */
+                std::deque<pending_query> pending_;
+
+                /** The next reply completes the last pending request */
+                bool last_reply() const {
+                    return pending_.empty() ||
+                           (pending_.size() == 1 && pending_.front().completed_by_next());
+                }
 
                 void on_entry(const events::execute &evt, connection_fsm_type &fsm) {
                     LOG4CXX_TRACE(logger_states,
                                   "Conn#" << fsm.number() << ": state[query]: entry by execute");
-                    query_ = evt;
-                    fsm.send(std::move(query_.buff));
+                    fsm.send_query(pending_, evt);
                 }
 
                 template <typename Event>
                 void on_entry(Event const &, connection_fsm_type &fsm) {
                     LOG4CXX_TRACE(logger_states,
                                   "Conn#" << fsm.number() << ": state[query]: entry");
-                    query_ = events::execute{};
+                    pending_.clear();
                 }
 
-                void on_exit(const error::query_error &err, connection_fsm_type &fsm) {
-                    LOG4CXX_TRACE(logger_states,
-                                  "Conn#" << fsm.number() << ": state[query]: exit by query_error");
-                    fsm.notify_error(*this, err);
-                    query_ = events::execute{};
+                void on_exit(const error::connection_error &err, connection_fsm_type &fsm) {
+                    LOG4CXX_TRACE(logger_states, "Conn#"
+                                                     << fsm.number()
+                                                     << ": state[query]: exit by connection_error");
+                    for (auto &pending : pending_) {
+                        if (pending.timed_out)
+                            continue;
+                        if (fsm.replayable(pending, &pending == &pending_.front()))
+                            fsm.replay_.push_back(std::move(pending.query));
+                        else
+                            fsm.notify_error(pending.query, err);
+                    }
+                    pending_.clear();
                 }
 
-                void on_exit(const events::recv &evt, connection_fsm_type &fsm) {
+                template <typename Event>
+                void on_exit(Event const &, connection_fsm_type &fsm) {
+                    LOG4CXX_TRACE(logger_states, "Conn#" << fsm.number()
+                                                         << ": state[query]: exit by "
+                                                         << demangle<Event>());
+                }
+            };
+
+            /** Replies come as they are pushed, no request waits for them */
+            struct subscribed : state {
+                void on_entry(const events::subscribe &evt, connection_fsm_type &fsm) {
                     LOG4CXX_TRACE(logger_states,
-                                  "Conn#" << fsm.number() << ": state[query]: exit by recv");
-                    fsm.notify_result(*this, evt.res);
-                    query_ = events::execute{};
+                                  "Conn#" << fsm.number() << ": state[subscribed]: entry");
+                    fsm.push_mode_ = true;
+                    fsm.send(evt.command);
                 }
 
                 template <typename Event>
                 void on_exit(Event const &, connection_fsm_type &fsm) {
                     LOG4CXX_TRACE(logger_states, "Conn#" << fsm.number()
-                                                         << ": state[query]: exit by "
+                                                         << ": state[subscribed]: exit by "
                                                          << demangle<Event>());
-                    query_ = events::execute{};
                 }
             };
 
             using initial_state = unplugged;
 
+            // mpl::vector holds 20 rows at most, the numbered one takes exactly as many as it says
             // clang-format off
-            using transition_table = mpl::vector<
-                /*  Start        Event                       Next        Action               */
-                /*+------------+---------------------------+-----------+---------------------+*/
+            using transition_table = mpl::vector25<
+                /*  Start        Event                       Next        Action      Guard        */
+                /*+------------+---------------------------+-----------+-----------+-------------+*/
                 tr<unplugged,   connection_options,         connecting, none>,
                 tr<unplugged,   events::terminate,          terminated, none>,
 
@@ -229,16 +515,29 @@ namespace redis_async {
                 tr<connecting,  error::connection_error,    terminated, on_connection_error>,
 
                 tr<authn,       events::complete,           idle,       none>,
-                tr<authn,       events::recv,               idle,       none>,
+                tr<authn,       events::recv,               none,       on_setup_reply, more_setup>,
+                tr<authn,       events::recv,               idle,       on_setup_reply, last_setup>,
+                tr<authn,       events::recv,               terminated, on_setup_error, bad_setup>,
+                tr<authn,       error::query_error,         terminated, on_setup_error>,
                 tr<authn,       error::connection_error,    terminated, on_connection_error>,
 
                 tr<idle,        events::execute,            query,      none>,
                 tr<idle,        events::terminate,          terminated, disconnect>,
                 tr<idle,        error::connection_error,    terminated, on_connection_error>,
 
-                tr<query,       events::recv,               idle,       none>,
-                tr<query,       error::query_error,         idle,       none>,
-                tr<query,       error::connection_error,    terminated, on_connection_error>
+                tr<query,       events::execute,            none,       pipeline_query>,
+                tr<query,       events::recv,               none,       on_reply,   more_pending>,
+                tr<query,       events::recv,               idle,       on_reply,   last_pending>,
+                tr<query,       error::query_error,         none,       on_reply,   more_pending>,
+                tr<query,       error::query_error,         idle,       on_reply,   last_pending>,
+                tr<query,       error::connection_error,    terminated, on_connection_error>,
+
+                tr<idle,        events::subscribe,          subscribed, none>,
+                tr<subscribed,  events::subscribe,          none,       send_subscription>,
+                tr<subscribed,  events::recv,               none,       on_push>,
+                tr<subscribed,  error::query_error,         none,       on_push>,
+                tr<subscribed,  events::terminate,          terminated, disconnect>,
+                tr<subscribed,  error::connection_error,    terminated, on_connection_error>
             >;
             // clang-format on
 
@@ -256,8 +555,7 @@ namespace redis_async {
             //@{
             using io_service_ptr = asio_config::io_service_ptr;
             using shared_base = std::enable_shared_from_this<shared_type>;
-            using asio_io_handler =
-                std::function<void(asio_config::error_code const &error, size_t bytes_transferred)>;
+            using write_buffer = events::execute::Buffer;
             //@}
 
             //@{
@@ -266,8 +564,10 @@ namespace redis_async {
                 , io_service_{svc}
                 , strand_{*svc}
                 , transport_{svc}
+                , connect_timer_{*svc}
+                , reply_timer_{*svc}
+                , incoming_{8192} // FIXME Magic number, move to configuration
                 , connection_number_{next_connection_number()} {
-                incoming_.prepare(8192); // FIXME Magic number, move to configuration
             }
 
             virtual ~connection_fsm_def() = default;
@@ -284,92 +584,156 @@ namespace redis_async {
 
                 conn_opts_ = opts;
                 auto _this = shared_base::shared_from_this();
+                connecting_ = true;
+                if (conn_opts_.connect_timeout.count()) {
+                    connect_timer_.expires_after(conn_opts_.connect_timeout);
+                    connect_timer_.async_wait([_this](asio_config::error_code ec) {
+                        if (!ec)
+                            _this->handle_connect_timeout();
+                    });
+                }
                 transport_.connect_async(
                     conn_opts_, [_this](asio_config::error_code ec) { _this->handle_connect(ec); });
             }
 
             void start_read() {
                 auto _this = shared_base::shared_from_this();
+                auto buff = incoming_.prepare(read_size);
                 transport_.async_read(
-                    incoming_, [_this](asio_config::error_code ec, size_t bytes_transferred) {
+                    buff, [_this](asio_config::error_code ec, size_t bytes_transferred) {
                         _this->handle_read(ec, bytes_transferred);
                     });
             }
 
-            void send_startup_message() {
-                if (conn_opts_.password.empty()) {
-                    fsm().process_event(events::complete{});
-                    return;
+            /**
+             * Write the commands preparing the connection for use, all in one write.
+             * @return names of the commands, in the order of their replies
+             */
+            std::deque<std::string> send_startup_message() {
+                std::deque<std::string> sent;
+                if (!conn_opts_.password.empty()) {
+                    if (conn_opts_.user.empty())
+                        send(single_command_t{"AUTH", conn_opts_.password});
+                    else
+                        send(single_command_t{"AUTH", conn_opts_.user, conn_opts_.password});
+                    sent.emplace_back("AUTH");
                 }
-                single_command_t cmd{"AUTH", conn_opts_.password};
-                events::execute::Buffer buff;
-                Protocol::serialize(buff, cmd);
-                send(std::move(buff));
-            }
-
-            void send(events::execute::Buffer &&m,
-                      const asio_io_handler &handler = asio_io_handler()) {
-                if (transport_.connected()) {
-                    auto msg = ::std::make_shared<events::execute::Buffer>(::std::move(m));
-                    auto _this = shared_base::shared_from_this();
-                    auto write_handler = [_this, handler, msg](asio_config::error_code ec,
-                                                               size_t sz) {
-                        if (handler)
-                            handler(ec, sz);
-                        else
-                            _this->handle_write(ec, sz);
-                    };
-                    transport_.async_write(boost::asio::buffer(msg->data(), msg->size()),
-                                           write_handler);
+                if (conn_opts_.protocol) {
+                    send(single_command_t{"HELLO", std::to_string(conn_opts_.protocol)});
+                    sent.emplace_back("HELLO");
+                }
+                if (!conn_opts_.database.empty()) {
+                    send(single_command_t{"SELECT", conn_opts_.database});
+                    sent.emplace_back("SELECT");
+                }
+                if (!conn_opts_.client_name.empty()) {
+                    send(single_command_t{"CLIENT", "SETNAME", conn_opts_.client_name});
+                    sent.emplace_back("CLIENT SETNAME");
+                }
+                if (conn_opts_.client_cache_size) {
+                    send(single_command_t{"CLIENT", "TRACKING", "ON"});
+                    sent.emplace_back("CLIENT TRACKING");
+                }
+                return sent;
+            }
+
+            /**
+             * Serialize the command to the outgoing buffer.
+             * Commands queued in one turn of the event loop, or while a write is
+             * in flight, go to the socket together in the next write.
+             */
+            template <typename Command>
+            void send(const Command &cmd) {
+                if (!transport_.connected())
+                    return;
+                Protocol::serialize(outgoing_, cmd);
+                schedule_flush();
+            }
+
+            /** Send the request and wait for its reply */
+            void send_query(std::deque<pending_query> &pending, const events::execute &evt) {
+                if (evt.asking) {
+                    pending.push_back(pending_query::asking());
+                    send(single_command_t{"ASKING"});
                 }
+                pending.push_back({evt});
+                send(pending.back().query.command);
+                watch_deadline(evt);
             }
 
             void close_transport() {
+                connect_timer_.cancel();
+                reply_timer_.cancel();
                 transport_.close();
             }
 
+            /** Arm the reply timer for the request if it expires before the armed deadline */
+            void watch_deadline(const events::execute &query) {
+                if (query.deadline == clock_type::time_point{})
+                    return;
+                if (reply_timer_armed_ && reply_timer_.expiry() <= query.deadline)
+                    return;
+                arm_reply_timer(query.deadline);
+            }
+
             //@{
             /** @connection events notifications */
-            template <typename Source>
-            void notify_result(Source &state, const result_t &res) {
-                if (state.query_.result) {
-                    auto result_cb = state.query_.result;
-                    auto error_cb = state.query_.error;
-                    auto conn = fsm().shared_from_this();
-                    fsm().async_notify([conn, result_cb, error_cb, res]() {
-                        LOG4CXX_TRACE(logger_def, "Conn#" << conn->number() << ": In async notify");
-                        try {
-                            result_cb(res);
-                        } catch (error::query_error const &e) {
-                            LOG4CXX_TRACE(logger_def,
-                                          "Conn#"
-                                              << conn->number()
-                                              << ": Query result handler throwed a query_error: "
-                                              << e.what());
-                            error_cb(e);
-                        } catch (error::rd_error const &e) {
-                            LOG4CXX_TRACE(logger_def,
-                                          "Conn#" << conn->number()
-                                                  << ": Query result handler throwed a db_error: "
-                                                  << e.what());
-                            error_cb(e);
-                        } catch (std::exception const &e) {
-                            LOG4CXX_TRACE(logger_def,
-                                          "Conn#" << conn->number()
-                                                  << ": Query result handler throwed an exception: "
-                                                  << e.what());
-                            error_cb(error::client_error(e));
-                        } catch (...) {
-                            LOG4CXX_TRACE(
-                                logger_def,
-                                "Conn#" << conn->number()
-                                        << ": Query result handler throwed an unknown exception");
-                            error_cb(error::client_error("Unknown exception"));
-                        }
-                    });
+            /** Deliver the reply the request waits for, moved out of the event */
+            void notify_result(events::execute &&query, const events::recv &evt) {
+                if (query.view)
+                    notify_result(std::move(query.view), std::move(query.error),
+                                  std::move(evt.view));
+                else if (query.flat)
+                    notify_result(std::move(query.flat), std::move(query.error),
+                                  std::move(evt.flat));
+                else if (query.decoder && query.decoder->completes_request())
+                    complete_request(query);
+                else if (query.decoder)
+                    notify_result(decoded_callback{&basic_reply_decoder::deliver},
+                                  std::move(query.error), std::move(query.decoder));
+                else
+                    notify_result(std::move(query.result), std::move(query.error),
+                                  std::move(evt.res));
+            }
+
+            /** Complete the request on this thread, the decoder calls its handler */
+            void complete_request(const events::execute &query) {
+                try {
+                    query.decoder->complete();
+                } catch (::std::exception const &e) {
+                    LOG4CXX_WARN(logger_def, "Conn#" << number()
+                                                     << ": Exception in completion handler "
+                                                     << e.what());
+                } catch (...) {
+                    LOG4CXX_WARN(logger_def,
+                                 "Conn#" << number() << ": Exception in completion handler");
                 }
             }
 
+            void notify_result(events::execute &&query, result_t &&res) {
+                notify_result(std::move(query.result), std::move(query.error), std::move(res));
+            }
+
+            /**
+             * Call the result callback through the strand, or right here in
+             * the read handler if the connection completes inline.
+             */
+            template <typename Callback, typename Reply>
+            void notify_result(Callback &&result_cb, error_callback &&error_cb, Reply &&res) {
+                if (!result_cb)
+                    return;
+                if (conn_opts_.inline_completion) {
+                    deliver_result(number(), result_cb, error_cb, std::move(res));
+                    return;
+                }
+                auto conn = fsm().shared_from_this();
+                fsm().async_notify([conn, result_cb = std::move(result_cb),
+                                    error_cb = std::move(error_cb), res = std::move(res)]() mutable {
+                    LOG4CXX_TRACE(logger_def, "Conn#" << conn->number() << ": In async notify");
+                    deliver_result(conn->number(), result_cb, error_cb, std::move(res));
+                });
+            }
+
             void notify_idle() {
                 try {
                     notifyIdleImpl();
@@ -398,11 +762,10 @@ namespace redis_async {
                 }
             }
 
-            template <typename State>
-            void notify_error(State &state, error::query_error const &qe) {
-                if (state.query_.error) {
+            void notify_error(const events::execute &query, error::rd_error const &qe) {
+                if (query.error) {
                     try {
-                        state.query_.error(qe);
+                        query.error(qe);
                     } catch (std::exception const &e) {
                         LOG4CXX_WARN(logger_def,
                                      "Query error handler throwed an exception: " << e.what());
@@ -419,6 +782,21 @@ namespace redis_async {
                 notifyErrorImpl(e);
             }
 
+            void notify_push(reply_view_t &&reply) {
+                try {
+                    notifyPushImpl(std::move(reply));
+                } catch (::std::exception const &e) {
+                    LOG4CXX_WARN(logger_def,
+                                 "Conn#" << number() << ": Exception in push handler " << e.what());
+                } catch (...) {
+                    LOG4CXX_WARN(logger_def, "Conn#" << number() << ": Exception in push handler");
+                }
+            }
+
+            void notify_push_error(error::query_error const &e) {
+                notifyPushErrorImpl(e);
+            }
+
             template <typename Handler>
             void async_notify(Handler &&h) {
                 strand_.post(::std::forward<Handler>(h));
@@ -429,6 +807,26 @@ namespace redis_async {
                 return conn_opts_;
             }
 
+            /** Requests written to the socket and waiting for replies */
+            size_t pending_requests() {
+                return fsm().template get_state<query &>().pending_.size();
+            }
+
+            /**
+             * The request may be sent again on another connection. Part of the
+             * reply of the first one may have been read already, it is not.
+             */
+            bool replayable(const pending_query &pending, bool first) const {
+                if (!conn_opts_.replay_requests || !is_idempotent(pending.query.command))
+                    return false;
+                return !first || (pending.replies.elements.empty() && incoming_.size() == 0);
+            }
+
+            /** Requests left without replies by a connection failure, to be sent again */
+            std::vector<events::execute> release_replay() {
+                return std::exchange(replay_, {});
+            }
+
             static size_t next_connection_number() {
                 static std::atomic<size_t> _number{0};
                 return _number++;
@@ -439,10 +837,13 @@ namespace redis_async {
             virtual void notifyIdleImpl() {}
             virtual void notifyTerminatedImpl() {}
             virtual void notifyErrorImpl(error::connection_error const &) {}
+            virtual void notifyPushImpl(reply_view_t &&) {}
+            virtual void notifyPushErrorImpl(error::query_error const &) {}
             // clang-format on
 
         protected:
             connection_options conn_opts_;
+            std::vector<events::execute> replay_;
 
         private:
             connection_fsm_type &fsm() {
@@ -453,9 +854,20 @@ namespace redis_async {
                 return static_cast<connection_fsm_type const &>(*this);
             }
 
+            void handle_connect_timeout() {
+                if (!connecting_)
+                    return;
+                connect_timed_out_ = true;
+                transport_.close();
+            }
+
             void handle_connect(asio_config::error_code ec) {
+                connecting_ = false;
+                connect_timer_.cancel();
                 if (!ec) {
                     fsm().process_event(events::complete{});
+                } else if (connect_timed_out_) {
+                    fsm().process_event(error::connection_error{"Connect timed out"});
                 } else {
                     fsm().process_event(error::connection_error{ec.message()});
                 }
@@ -463,8 +875,9 @@ namespace redis_async {
 
             void handle_read(asio_config::error_code ec, size_t bytes_transferred) {
                 if (!ec) {
+                    incoming_.commit(bytes_transferred);
                     // read message
-                    read_message(bytes_transferred);
+                    read_message();
                     // start async operation again
                     start_read();
                 } else {
@@ -473,32 +886,206 @@ namespace redis_async {
                 }
             }
 
-            void handle_write(asio_config::error_code ec, size_t) {
+            void arm_reply_timer(clock_type::time_point at) {
+                reply_timer_armed_ = true;
+                reply_timer_.expires_at(at);
+                auto _this = shared_base::shared_from_this();
+                reply_timer_.async_wait([_this](asio_config::error_code ec) {
+                    if (!ec)
+                        _this->handle_reply_timeout();
+                });
+            }
+
+            /**
+             * Fail the pending requests past their deadlines. They stay in the
+             * pipeline, their replies are read and dropped when they come.
+             */
+            void handle_reply_timeout() {
+                reply_timer_armed_ = false;
+                auto now = clock_type::now();
+                clock_type::time_point next{};
+                for (auto &pending : fsm().template get_state<query &>().pending_) {
+                    if (pending.timed_out)
+                        continue;
+                    auto deadline = pending.query.deadline;
+                    if (pending.query.expired(now)) {
+                        pending.timed_out = true;
+                        // The caller is answered, the request leaves the queue of the pool
+                        pending.query.ticket.reset();
+                        LOG4CXX_TRACE(logger_def, "Conn#" << number() << ": request timed out");
+                        notify_error(pending.query, error::timeout_error("Request timed out"));
+                    } else if (deadline != clock_type::time_point{} &&
+                               (next == clock_type::time_point{} || deadline < next)) {
+                        next = deadline;
+                    }
+                }
+                if (next != clock_type::time_point{})
+                    arm_reply_timer(next);
+            }
+
+            void schedule_flush() {
+                // A write in flight flushes the rest when it completes
+                if (flush_scheduled_ || write_in_flight_)
+                    return;
+                flush_scheduled_ = true;
+                auto _this = shared_base::shared_from_this();
+                io_service_->post([_this] {
+                    _this->flush_scheduled_ = false;
+                    _this->flush();
+                });
+            }
+
+            /**
+             * Write the outgoing buffer, at most max_flush_size bytes of it at
+             * once. The buffer is written in place, slice by slice, and the
+             * commands queued meanwhile wait until all of it is written.
+             */
+            void flush() {
+                if (write_in_flight_ || !transport_.connected())
+                    return;
+                if (written_ == writing_.size()) {
+                    if (outgoing_.empty())
+                        return;
+                    release_writing();
+                    std::swap(outgoing_, writing_);
+                }
+                auto size = writing_.size() - written_;
+                auto limit = conn_opts_.max_flush_size;
+                if (limit && size > limit)
+                    size = limit;
+                write_in_flight_ = true;
+                auto _this = shared_base::shared_from_this();
+                transport_.async_write(boost::asio::buffer(writing_.data() + written_, size),
+                                       [_this](asio_config::error_code ec, size_t sz) {
+                                           _this->handle_write(ec, sz);
+                                       });
+            }
+
+            void handle_write(asio_config::error_code ec, size_t sz) {
+                write_in_flight_ = false;
+                written_ += sz;
+                if (ec || written_ >= writing_.size())
+                    release_writing();
                 if (ec) {
                     // Socket error - force termination
                     fsm().process_event(error::connection_error(ec.message()));
+                    return;
+                }
+                flush();
+            }
+
+            /** Empty the written buffer, it takes the next commands */
+            void release_writing() {
+                if (writing_.capacity() > max_spare_write_buffer)
+                    write_buffer{}.swap(writing_);
+                else
+                    writing_.clear();
+                written_ = 0;
+            }
+
+            void read_message() {
+                while (incoming_.size()) {
+                    iterator from = incoming_.data();
+                    iterator to = from + incoming_.size();
+                    if (!parse_reply(front_query(), from, to)) {
+                        // Keep the partial reply in the buffer, the parser goes on
+                        // from where it stopped when the rest arrives.
+                        break;
+                    }
+                }
+            }
+
+            /** The oldest pending request, the next reply is for it */
+            const events::execute *front_query() {
+                auto &pending = fsm().template get_state<query &>().pending_;
+                return pending.empty() ? nullptr : &pending.front().query;
+            }
+
+            /**
+             * Parse the next reply into the form the request expects. RESP3 push
+             * frames are not replies, they go to the push handler and never to a request.
+             */
+            bool parse_reply(const events::execute *front, iterator from, iterator to) {
+                if (*from == '>')
+                    return dispatch_push(parse_view(from, to));
+                if (push_mode_)
+                    return dispatch(parse_view(from, to));
+                if (front && front->view)
+                    return dispatch(parse_view(from, to));
+                if (front && front->flat)
+                    return dispatch(flat_parser_.parse(from, to));
+                if (front && front->decoder) {
+                    decoding_parser_.builder().target(front->decoder.get());
+                    return dispatch(decoding_parser_.parse(from, to));
                 }
+                return dispatch(parser_.parse(from, to));
             }
 
-            void read_message(size_t max_bytes) {
-                while (max_bytes) {
-                    using handler_t = handler_parse_result_t<connection_fsm_type>;
-                    auto data = incoming_.data();
-                    auto parsed_result =
-                        redis_async::details::raw_parse(iterator::begin(data), iterator::end(data));
-                    auto consumed = std::visit(handler_t{fsm()}, parsed_result);
-                    if (!consumed)
-                        consumed = max_bytes;
+            /**
+             * Find the end of the reply first, then build its view in one pass,
+             * when the whole reply is in one chunk of the buffer.
+             */
+            basic_parse_result_t<view_t> parse_view(iterator from, iterator to) {
+                auto scanned = scanner_.parse(from, to);
+                if (auto *reply = std::get_if<reply_scanner_t::positive_result_type>(&scanned))
+                    return view_parser_.parse(from, from + reply->consumed);
+                if (auto *err = std::get_if<error_t>(&scanned))
+                    return std::move(*err);
+                return std::get<protocol_error_t>(scanned);
+            }
+
+            bool dispatch_push(basic_parse_result_t<view_t> &&parsed_result) {
+                using positive_t = basic_positive_parse_result_t<view_t>;
+                if (stream_parser_t::need_more(parsed_result))
+                    return false;
+                if (auto *push = std::get_if<positive_t>(&parsed_result)) {
+                    auto consumed = push->consumed;
+                    notify_push({std::move(push->result), incoming_.chunk()});
                     incoming_.consume(consumed);
-                    max_bytes -= consumed;
+                    return true;
+                }
+                if (auto *err = std::get_if<error_t>(&parsed_result)) {
+                    LOG4CXX_WARN(logger_def,
+                                 "Conn#" << number() << ": Error in push frame " << err->str);
+                    incoming_.consume(err->consumed);
+                    return true;
                 }
+                return dispatch(std::move(parsed_result));
+            }
+
+            template <typename ParseResult>
+            bool dispatch(ParseResult &&parsed_result) {
+                using handler_t = handler_parse_result_t<connection_fsm_type>;
+                if (stream_parser_t::need_more(parsed_result))
+                    return false;
+                auto consumed = std::visit(handler_t{fsm(), incoming_.chunk()}, parsed_result);
+                if (!consumed)
+                    consumed = incoming_.size();
+                incoming_.consume(consumed);
+                return true;
             }
 
         private:
             asio_config::io_service_ptr io_service_;
             asio_config::io_service::strand strand_;
             transport_type transport_;
+            boost::asio::steady_timer connect_timer_;
+            boost::asio::steady_timer reply_timer_;
+            bool connecting_ = false;
+            bool connect_timed_out_ = false;
+            bool reply_timer_armed_ = false;
+            bool push_mode_ = false; ///< Subscribed, replies are parsed as views and pushed
             buffer incoming_;
+            write_buffer outgoing_; ///< Commands waiting for the next write
+            write_buffer writing_;  ///< Bytes being written, up to written_ they are
+            size_t written_ = 0;
+            bool write_in_flight_ = false;
+            bool flush_scheduled_ = false;
+            stream_parser_t parser_;
+            reply_scanner_t scanner_;
+            view_parser_t view_parser_;
+            flat_parser_t flat_parser_;
+            decoding_parser_t decoding_parser_;
             size_t connection_number_;
         };
 
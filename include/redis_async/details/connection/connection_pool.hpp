@@ -11,10 +11,19 @@
 #include <redis_async/asio_config.hpp>
 #include <redis_async/commands.hpp>
 #include <redis_async/common.hpp>
+#include <redis_async/details/client_cache.hpp>
 
 namespace redis_async {
     namespace details {
 
+        /**
+         * Delay of a reconnect attempt: reconnect_delay doubled with every failed
+         * attempt up to max_reconnect_delay, shortened by up to a half at random
+         * so that clients do not reconnect all at once.
+         */
+        std::chrono::milliseconds reconnect_delay(connection_options const &co, size_t attempt,
+                                                  size_t random);
+
         /**
          * Container of connections to the same database
          */
@@ -25,20 +34,46 @@ namespace redis_async {
             using connection_pool_ptr = ::std::shared_ptr<connection_pool>;
 
         public:
+            /** The connections keep the cache coherent if it is given */
             static connection_pool_ptr create(io_service_ptr service, size_t pool_size,
-                                              connection_options const &co);
+                                              connection_options const &co,
+                                              client_cache_ptr cache = {});
 
             ~connection_pool();
 
             rdalias const &alias() const;
-            void get_connection(command_wrapper_t &&cmd, query_result_callback &&conn_cb,
-                                error_callback &&err);
+            /**
+             * Requests fail with error::timeout_error if not complete in the
+             * timeout, socket_timeout of the connection options if it is zero.
+             * @param asking Send ASKING before the command, a cluster node redirected it with ASK
+             * @return false if the request queue is full and admission is try_once
+             */
+            bool get_connection(command_wrapper_t &&cmd, query_result_callback &&conn_cb,
+                                error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject, bool asking = false);
+            bool get_connection(command_wrapper_t &&cmd, reply_view_callback &&conn_cb,
+                                error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject, bool asking = false);
+            bool get_connection(command_wrapper_t &&cmd, flat_reply_callback &&conn_cb,
+                                error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject, bool asking = false);
+            bool get_connection(command_wrapper_t &&cmd, reply_decoder_ptr &&decoder,
+                                error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject, bool asking = false);
+            /** Requests submitted and not answered yet */
+            size_t queue_depth() const;
+            /** Serialized size of these requests */
+            size_t queue_bytes() const;
             void close(simple_callback);
 
         private:
-            connection_pool(io_service_ptr service, size_t pool_size, connection_options const &co);
+            connection_pool(io_service_ptr service, size_t pool_size, connection_options const &co,
+                            client_cache_ptr cache);
 
-            void create_new_connection();
             void connection_ready(connection_ptr c);
             void connection_terminated(connection_ptr c);
             void connection_error(connection_ptr c, error::connection_error const &ec);
@@ -5,23 +5,53 @@
 #ifndef REDIS_ASYNC_EVENTS_HPP
 #define REDIS_ASYNC_EVENTS_HPP
 
+#include <redis_async/commands.hpp>
 #include <redis_async/common.hpp>
 #include <redis_async/rd_types.hpp>
 
+#include <chrono>
+
 namespace redis_async {
     namespace details {
 
+        struct queue_ticket;
+
         namespace events {
 
             struct execute {
                 using Buffer = std::vector<char>;
 
-                Buffer buff;
-                query_result_callback result;
-                error_callback error;
+                command_wrapper_t command{};
+                query_result_callback result{};
+                error_callback error{};
+                /** Set instead of result to get the reply without copying its strings */
+                reply_view_callback view{};
+                /** Set instead of result to get the reply as a flat_reply_t */
+                flat_reply_callback flat{};
+                /** Set instead of result to decode the reply into a typed value */
+                reply_decoder_ptr decoder{};
+                /** Number of commands in a batch, zero for a single command */
+                std::size_t batch = 0;
+                /** Send ASKING first, a cluster node redirected the request with ASK */
+                bool asking = false;
+                /** The request fails with timeout_error after it, unset for no deadline */
+                std::chrono::steady_clock::time_point deadline{};
+                /** Place of the request in the queue of the pool, freed with the last copy */
+                std::shared_ptr<queue_ticket> ticket{};
+
+                bool expired(std::chrono::steady_clock::time_point now) const {
+                    return deadline != std::chrono::steady_clock::time_point{} && deadline <= now;
+                }
             };
+            /** A reply, moved out of the event by the action handling it */
             struct recv {
-                result_t res;
+                mutable result_t res{};
+                mutable reply_view_t view{};
+                mutable flat_reply_t flat{};
+            };
+            /** (Un)subscribe command, switches the connection to the push stream */
+            struct subscribe {
+                single_command_t command;
             };
             struct terminate {};
             struct complete {};
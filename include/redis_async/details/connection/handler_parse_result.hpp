@@ -15,8 +15,9 @@ namespace redis_async {
         template <typename FSM>
         struct handler_parse_result_t {
 
-            explicit handler_parse_result_t(FSM &fsm)
-                : m_fsm(fsm) {
+            explicit handler_parse_result_t(FSM &fsm, buffer_chunk_ptr chunk = {})
+                : m_fsm(fsm)
+                , m_chunk(std::move(chunk)) {
             }
 
             std::size_t operator()(protocol_error_t &err) const {
@@ -34,8 +35,25 @@ namespace redis_async {
                 return res.consumed;
             }
 
+            std::size_t operator()(basic_positive_parse_result_t<view_t> &res) const {
+                m_fsm.process_event(events::recv{{}, {std::move(res.result), m_chunk}});
+                return res.consumed;
+            }
+
+            std::size_t operator()(basic_positive_parse_result_t<basic_reply_decoder *> &res) const {
+                // the value is in the decoder of the request
+                m_fsm.process_event(events::recv{});
+                return res.consumed;
+            }
+
+            std::size_t operator()(basic_positive_parse_result_t<flat_reply_t> &res) const {
+                m_fsm.process_event(events::recv{{}, {}, std::move(res.result)});
+                return res.consumed;
+            }
+
         private:
             FSM &m_fsm;
+            buffer_chunk_ptr m_chunk; ///< Chunk of the receive buffer views refer to
         };
 
     } // namespace details
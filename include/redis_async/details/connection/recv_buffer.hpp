@@ -0,0 +1,89 @@
+//
+// Created by niko on 15.09.2021.
+//
+
+#ifndef REDIS_ASYNC_RECV_BUFFER_HPP
+#define REDIS_ASYNC_RECV_BUFFER_HPP
+
+#include <redis_async/rd_types.hpp>
+
+#include <boost/asio/buffer.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace redis_async {
+    namespace details {
+
+        /**
+         * Receive buffer made of reference counted chunks.
+         *
+         * Bytes once read are never changed, so replies may refer to them by
+         * sharing the chunk. While nobody shares the chunk, it is reused for the
+         * next reads; otherwise the unread tail is moved into a new chunk.
+         */
+        class recv_buffer_t {
+        public:
+            explicit recv_buffer_t(std::size_t chunk_size)
+                : chunk_size_{chunk_size} {
+            }
+
+            /** Space to read at least `size` bytes into */
+            boost::asio::mutable_buffer prepare(std::size_t size) {
+                if (begin_ == end_ && chunk_.use_count() == 1) {
+                    begin_ = end_ = 0;
+                }
+                if (capacity_ - end_ < size) {
+                    grow(size);
+                }
+                return {chunk_.get() + end_, capacity_ - end_};
+            }
+
+            void commit(std::size_t size) {
+                end_ += size;
+            }
+
+            const char *data() const {
+                return chunk_.get() + begin_;
+            }
+
+            std::size_t size() const {
+                return end_ - begin_;
+            }
+
+            void consume(std::size_t size) {
+                begin_ += std::min(size, end_ - begin_);
+            }
+
+            /** The chunk the unread bytes live in */
+            buffer_chunk_ptr chunk() const {
+                return chunk_;
+            }
+
+        private:
+            void grow(std::size_t size) {
+                auto used = end_ - begin_;
+                if (chunk_.use_count() == 1 && used + size <= capacity_) {
+                    std::memmove(chunk_.get(), chunk_.get() + begin_, used);
+                } else {
+                    auto capacity = std::max(chunk_size_, 2 * used + size);
+                    std::shared_ptr<char[]> chunk{new char[capacity]};
+                    if (used)
+                        std::memcpy(chunk.get(), chunk_.get() + begin_, used);
+                    chunk_ = std::move(chunk);
+                    capacity_ = capacity;
+                }
+                begin_ = 0;
+                end_ = used;
+            }
+
+            std::size_t chunk_size_;
+            std::shared_ptr<char[]> chunk_;
+            std::size_t capacity_ = 0;
+            std::size_t begin_ = 0; ///< First unread byte
+            std::size_t end_ = 0;   ///< End of the received bytes
+        };
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_RECV_BUFFER_HPP
@@ -0,0 +1,56 @@
+//
+// Created by niko on 05.10.2021.
+//
+
+#ifndef REDIS_ASYNC_SUBSCRIBER_HPP
+#define REDIS_ASYNC_SUBSCRIBER_HPP
+
+#include <boost/noncopyable.hpp>
+#include <memory>
+
+#include <redis_async/asio_config.hpp>
+#include <redis_async/common.hpp>
+
+namespace redis_async {
+    namespace details {
+
+        /**
+         * Subscriptions of a database on a connection of their own.
+         * A channel is subscribed on the server once, for its first local
+         * handler, and its messages are passed to all the handlers.
+         */
+        class subscriber : public ::std::enable_shared_from_this<subscriber>,
+                           private boost::noncopyable {
+        public:
+            using io_service_ptr = asio_config::io_service_ptr;
+            using subscriber_ptr = ::std::shared_ptr<subscriber>;
+
+        public:
+            /** The connection is opened with the first subscription */
+            static subscriber_ptr create(io_service_ptr service, connection_options const &co);
+
+            ~subscriber();
+
+            rdalias const &alias() const;
+            /**
+             * Can be called from any thread, the subscription is made on the
+             * event loop. Handlers are called from the event loop thread.
+             */
+            subscription_id subscribe(subscription_kind kind, std::string channel,
+                                      message_callback &&handler, error_callback &&err);
+            /** The handler may still get messages received before the call */
+            void unsubscribe(subscription_id id);
+            void close();
+
+        private:
+            subscriber(io_service_ptr service, connection_options const &co);
+
+            struct impl;
+            using pimpl = ::std::unique_ptr<impl>;
+            pimpl pimpl_;
+        };
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_SUBSCRIBER_HPP
@@ -29,6 +29,9 @@ namespace redis_async {
 
             template <typename BufferType, typename HandlerType>
             void async_read(BufferType &buffer, HandlerType handler) {
+                // Linux turns quick ack off again by itself
+                if (options_.quick_ack)
+                    set_quick_ack();
                 boost::asio::async_read(socket, buffer, boost::asio::transfer_at_least(1), handler);
             }
 
@@ -40,11 +43,22 @@ namespace redis_async {
         private:
             tcp::resolver resolver_;
             socket_type socket;
+            connection_options options_;
+
+            /** Buffer sizes of the connection string, set before connect */
+            void apply_buffer_sizes();
+            /** The rest of the socket options, set once connected */
+            void apply_options();
+            void set_quick_ack();
 
             void handle_resolve(redis_async::details::tcp_transport::error_code ec,
                                 tcp::resolver::iterator endpoint_iterator,
                                 const connect_callback &);
+            /** Try the endpoints in turn, as boost::asio::async_connect does */
+            void connect_next(tcp::resolver::iterator endpoint_iterator, error_code ec,
+                              const connect_callback &);
             void handle_connect(redis_async::details::tcp_transport::error_code ec,
+                                tcp::resolver::iterator endpoint_iterator,
                                 const connect_callback &);
         };
 
@@ -0,0 +1,70 @@
+//
+// Created by niko on 20.09.2021.
+//
+
+#ifndef REDIS_ASYNC_MPSC_QUEUE_HPP
+#define REDIS_ASYNC_MPSC_QUEUE_HPP
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace redis_async {
+    namespace details {
+
+        /**
+         * Unbounded lock-free queue of many producers and a single consumer.
+         * A push is one atomic exchange, wait-free for producers. The consumer
+         * may see the queue empty while a push is half done, the pushed value
+         * is seen by the next pop after the push returns.
+         */
+        template <typename T>
+        class mpsc_queue : private boost::noncopyable {
+        public:
+            mpsc_queue()
+                : head_{new node}
+                , tail_{head_.load(std::memory_order_relaxed)} {
+            }
+
+            ~mpsc_queue() {
+                while (tail_) {
+                    auto next = tail_->next.load(std::memory_order_relaxed);
+                    delete tail_;
+                    tail_ = next;
+                }
+            }
+
+            /** Can be called from any thread */
+            void push(T &&value) {
+                auto n = new node{std::move(value)};
+                auto prev = head_.exchange(n, std::memory_order_acq_rel);
+                prev->next.store(n, std::memory_order_release);
+            }
+
+            /** Can be called only from the consumer thread */
+            std::optional<T> pop() {
+                auto next = tail_->next.load(std::memory_order_acquire);
+                if (!next)
+                    return std::nullopt;
+                std::optional<T> value{std::move(next->value)};
+                delete tail_;
+                tail_ = next; // The popped node becomes the stub
+                return value;
+            }
+
+        private:
+            struct node {
+                T value{};
+                std::atomic<node *> next{nullptr};
+            };
+
+            std::atomic<node *> head_; ///< Last pushed node, producers side
+            node *tail_;               ///< Stub node before the first value, consumer side
+        };
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_MPSC_QUEUE_HPP
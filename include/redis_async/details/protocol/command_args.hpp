@@ -7,6 +7,8 @@
 
 #include <redis_async/commands.hpp>
 
+#include <charconv>
+
 namespace redis_async {
     namespace cmd {
 
@@ -88,7 +90,7 @@ namespace redis_async {
             }
 
             inline CmdArgs &CmdArgs::operator<<(const std::string_view &arg) {
-                m_cmd.arguments.emplace_back(arg.data(), arg.size());
+                m_cmd.arguments.push_back(arg);
                 return *this;
             }
 
@@ -102,7 +104,17 @@ namespace redis_async {
                       typename std::enable_if<
                           std::is_arithmetic<typename std::decay<T>::type>::value, int>::type>
             inline CmdArgs &CmdArgs::operator<<(T &&arg) {
-                return _append(std::to_string(std::forward<T>(arg)));
+                using value_type = typename std::decay<T>::type;
+                if constexpr (std::is_integral<value_type>::value &&
+                              !std::is_same<value_type, bool>::value) {
+                    // Formatted on the stack, the argument copies it inline
+                    char buff[24];
+                    auto res = std::to_chars(buff, buff + sizeof(buff), arg);
+                    return operator<<(
+                        std::string_view{buff, static_cast<std::size_t>(res.ptr - buff)});
+                } else {
+                    return _append(std::to_string(std::forward<T>(arg)));
+                }
             }
 
             template <std::size_t N, typename... Args>
@@ -114,7 +126,7 @@ namespace redis_async {
             }
 
             inline CmdArgs &CmdArgs::_append(std::string arg) {
-                m_cmd.arguments.emplace_back(std::move(arg));
+                m_cmd.arguments.push_back(arg);
                 return *this;
             }
 
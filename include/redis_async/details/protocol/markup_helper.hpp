@@ -36,6 +36,16 @@ namespace redis_async {
                     result_t{boost::lexical_cast<int_t>(str)}, wrapped_string.consumed}};
             }
 
+            static auto markup_double(positive_parse_result_t &wrapped_string) -> parse_result_t {
+                auto &str = std::get<string_t>(wrapped_string.result);
+                return parse_result_t{positive_parse_result_t{
+                    result_t{boost::lexical_cast<double>(str)}, wrapped_string.consumed}};
+            }
+
+            static auto markup_bool(bool value, size_t consumed) -> parse_result_t {
+                return parse_result_t{positive_parse_result_t{result_t{value}, consumed}};
+            }
+
             static auto markup_protocol_error(error::errc ec) -> parse_result_t {
                 return parse_result_t{protocol_error_t{error::make_error_code(ec)}};
             }
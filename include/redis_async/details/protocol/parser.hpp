@@ -145,11 +145,174 @@ namespace redis_async {
             }
         };
 
+        template <typename Iterator>
+        struct null_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using parser_t = string_parser_t<Iterator>;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *wrapped_string = std::get_if<positive_parse_result_t>(&result);
+                if (!wrapped_string) {
+                    return result;
+                }
+                if (!std::get<string_t>(wrapped_string->result).empty())
+                    return helper::markup_protocol_error(error::errc::parser_error);
+                return helper::markup_nil(wrapped_string->consumed);
+            }
+        };
+
+        template <typename Iterator>
+        struct double_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using parser_t = string_parser_t<Iterator>;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *wrapped_string = std::get_if<positive_parse_result_t>(&result);
+                if (!wrapped_string) {
+                    return result;
+                }
+                try {
+                    return helper::markup_double(*wrapped_string);
+                } catch (const std::exception &) {
+                    return helper::markup_protocol_error(error::errc::parser_error);
+                }
+            }
+        };
+
+        template <typename Iterator>
+        struct boolean_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using parser_t = string_parser_t<Iterator>;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *wrapped_string = std::get_if<positive_parse_result_t>(&result);
+                if (!wrapped_string) {
+                    return result;
+                }
+                auto &str = std::get<string_t>(wrapped_string->result);
+                if (str != "t" && str != "f")
+                    return helper::markup_protocol_error(error::errc::parser_error);
+                return helper::markup_bool(str == "t", wrapped_string->consumed);
+            }
+        };
+
+        template <typename Iterator>
+        struct blob_error_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using parser_t = bulk_string_parser_t<Iterator>;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *wrapped_string = std::get_if<positive_parse_result_t>(&result);
+                if (!wrapped_string) {
+                    return result;
+                }
+                if (!std::holds_alternative<string_t>(wrapped_string->result))
+                    return helper::markup_protocol_error(error::errc::count_range);
+                return helper::markup_error(*wrapped_string);
+            }
+        };
+
+        /** Verbatim string, the format and the colon before the text are dropped */
+        template <typename Iterator>
+        struct verbatim_string_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using parser_t = bulk_string_parser_t<Iterator>;
+                static constexpr std::size_t format_size = 4;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *wrapped_string = std::get_if<positive_parse_result_t>(&result);
+                if (!wrapped_string) {
+                    return result;
+                }
+                auto *str = std::get_if<string_t>(&wrapped_string->result);
+                if (!str || str->size() < format_size)
+                    return helper::markup_protocol_error(error::errc::count_range);
+                str->erase(0, format_size);
+                return result;
+            }
+        };
+
+        template <typename Iterator>
+        struct map_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using helper = markup_helper_t<Iterator>;
+                using count_parser_t = int_parser_t<Iterator>;
+                using element_t = positive_parse_result_t;
+                auto count_result = count_parser_t::apply(from, to, already_consumed);
+                auto *count_wrapped = std::get_if<positive_parse_result_t>(&count_result);
+                if (!count_wrapped) {
+                    return count_result;
+                }
+                auto count = std::get<int_t>(count_wrapped->result);
+                if (count < 0)
+                    return helper::markup_protocol_error(error::errc::count_range);
+
+                map_holder_t map;
+                map.elements.reserve(count);
+                Iterator element_from = from + (count_wrapped->consumed - already_consumed);
+                std::size_t consumed = count_wrapped->consumed;
+
+                while (count) {
+                    result_t pair[2];
+                    for (auto &item : pair) {
+                        auto element_result = raw_parse<Iterator>(element_from, to);
+                        auto *element = std::get_if<element_t>(&element_result);
+                        if (!element) {
+                            return element_result;
+                        }
+                        element_from += element->consumed;
+                        item = std::move(element->result);
+                        consumed += element->consumed;
+                    }
+                    map.elements.emplace_back(std::move(pair[0]), std::move(pair[1]));
+                    --count;
+                }
+
+                return positive_parse_result_t{std::move(map), consumed};
+            }
+        };
+
+        /** Attribute is skipped, the result is the value which follows it */
+        template <typename Iterator>
+        struct attribute_parser_t {
+            static parse_result_t apply(const Iterator &from, const Iterator &to,
+                                        std::size_t already_consumed) {
+                using parser_t = map_parser_t<Iterator>;
+
+                auto result = parser_t::apply(from, to, already_consumed);
+                auto *attribute = std::get_if<positive_parse_result_t>(&result);
+                if (!attribute) {
+                    return result;
+                }
+                auto value_from = from + (attribute->consumed - already_consumed);
+                auto value_result = raw_parse<Iterator>(value_from, to);
+                if (auto *value = std::get_if<positive_parse_result_t>(&value_result))
+                    value->consumed += attribute->consumed;
+                else if (auto *err = std::get_if<error_t>(&value_result))
+                    err->consumed += attribute->consumed;
+                return value_result;
+            }
+        };
+
         template <typename Iterator>
         using primary_parser_t =
             std::variant<protocol_error_t, string_parser_t<Iterator>, int_parser_t<Iterator>,
                          error_parser_t<Iterator>, bulk_string_parser_t<Iterator>,
-                         array_parser_t<Iterator>>;
+                         array_parser_t<Iterator>, null_parser_t<Iterator>,
+                         double_parser_t<Iterator>, boolean_parser_t<Iterator>,
+                         blob_error_parser_t<Iterator>, verbatim_string_parser_t<Iterator>,
+                         map_parser_t<Iterator>, attribute_parser_t<Iterator>>;
 
         template <typename Iterator>
         struct unwrap_primary_parser_t {
@@ -192,7 +355,27 @@ namespace redis_async {
                 case '$':
                     return bulk_string_parser_t<Iterator>{};
                 case '*':
+                // RESP3 set and push are arrays
+                case '~':
+                case '>':
                     return array_parser_t<Iterator>{};
+                case '_':
+                    return null_parser_t<Iterator>{};
+                case ',':
+                    return double_parser_t<Iterator>{};
+                case '#':
+                    return boolean_parser_t<Iterator>{};
+                // RESP3 big number is kept as a string
+                case '(':
+                    return string_parser_t<Iterator>{};
+                case '!':
+                    return blob_error_parser_t<Iterator>{};
+                case '=':
+                    return verbatim_string_parser_t<Iterator>{};
+                case '%':
+                    return map_parser_t<Iterator>{};
+                case '|':
+                    return attribute_parser_t<Iterator>{};
                 }
                 // wrong introduction;
                 return protocol_error_t{error::make_error_code(error::errc::wrong_introduction)};
@@ -19,12 +19,18 @@ namespace redis_async {
             size_t consumed;
         };
 
-        struct positive_parse_result_t {
-            result_t result;
+        template <typename Result>
+        struct basic_positive_parse_result_t {
+            Result result;
             size_t consumed;
         };
 
-        using parse_result_t = std::variant<protocol_error_t, error_t, positive_parse_result_t>;
+        template <typename Result>
+        using basic_parse_result_t =
+            std::variant<protocol_error_t, error_t, basic_positive_parse_result_t<Result>>;
+
+        using positive_parse_result_t = basic_positive_parse_result_t<result_t>;
+        using parse_result_t = basic_parse_result_t<result_t>;
 
     } // namespace details
 } // namespace redis_async
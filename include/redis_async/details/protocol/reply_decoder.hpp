@@ -0,0 +1,684 @@
+//
+// Created by niko on 17.09.2021.
+//
+
+#ifndef REDIS_ASYNC_REPLY_DECODER_HPP
+#define REDIS_ASYNC_REPLY_DECODER_HPP
+
+#include <redis_async/common.hpp>
+#include <redis_async/error.hpp>
+#include <redis_async/rd_types.hpp>
+#include <redis_async/reply_traits.hpp>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/lexical_cast.hpp>
+#include <exception>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace redis_async {
+    namespace details {
+
+        template <typename T>
+        [[noreturn]] void decode_mismatch(const char *reply) {
+            throw error::client_error(std::string{"Cannot decode "} + reply + " reply into " +
+                                      demangle<T>());
+        }
+
+        /**
+         * Decoder of a value of type T, fed by the stream parser in the wire order.
+         * done() tells the value is complete, take() moves it out and makes the
+         * decoder ready for the next value.
+         * @throws error::client_error if the reply does not fit the type
+         */
+        template <typename T, typename Enable = void>
+        class value_decoder_t {
+            static_assert(sizeof(T) == 0,
+                          "No reply decoder for the type, specialize redis_async::reply_traits");
+        };
+
+        /** Decoder of a value made of one reply element */
+        template <typename T>
+        class scalar_decoder_t {
+        public:
+            void string(std::string_view) {
+                decode_mismatch<T>("string");
+            }
+            void integer(int_t) {
+                decode_mismatch<T>("integer");
+            }
+            void floating(double) {
+                decode_mismatch<T>("double");
+            }
+            void boolean(bool) {
+                decode_mismatch<T>("boolean");
+            }
+            void nil() {
+                decode_mismatch<T>("nil");
+            }
+            void open_array(std::size_t) {
+                decode_mismatch<T>("array");
+            }
+            void close_array() {
+            }
+            void open_map(std::size_t) {
+                decode_mismatch<T>("map");
+            }
+            void close_map() {
+            }
+
+            bool done() const {
+                return value_.has_value();
+            }
+            T take() {
+                T value = std::move(*value_);
+                value_.reset();
+                return value;
+            }
+
+        protected:
+            void complete(T &&value) {
+                value_ = std::move(value);
+            }
+
+        private:
+            std::optional<T> value_;
+        };
+
+        template <>
+        class value_decoder_t<std::string> : public scalar_decoder_t<std::string> {
+        public:
+            void string(std::string_view str) {
+                complete(std::string{str});
+            }
+        };
+
+        /** Numbers are decoded from integer, double and boolean replies or from numeric strings */
+        template <typename T>
+        class value_decoder_t<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+            : public scalar_decoder_t<T> {
+        public:
+            void string(std::string_view str) {
+                T value;
+                if (!boost::conversion::try_lexical_convert(str.data(), str.size(), value))
+                    decode_mismatch<T>("non-numeric string");
+                this->complete(std::move(value));
+            }
+            void integer(int_t value) {
+                this->complete(static_cast<T>(value));
+            }
+            void floating(double value) {
+                this->complete(static_cast<T>(value));
+            }
+            void boolean(bool value) {
+                this->complete(static_cast<T>(value));
+            }
+        };
+
+        /** Nil is decoded into an empty optional */
+        template <typename T>
+        class value_decoder_t<std::optional<T>> {
+        public:
+            void string(std::string_view str) {
+                value_.string(str);
+                collect();
+            }
+            void integer(int_t value) {
+                value_.integer(value);
+                collect();
+            }
+            void floating(double value) {
+                value_.floating(value);
+                collect();
+            }
+            void boolean(bool value) {
+                value_.boolean(value);
+                collect();
+            }
+            void nil() {
+                if (nested_)
+                    value_.nil();
+                else
+                    result_.emplace();
+                collect();
+            }
+            void open_array(std::size_t count) {
+                ++nested_;
+                value_.open_array(count);
+            }
+            void close_array() {
+                --nested_;
+                value_.close_array();
+                collect();
+            }
+            void open_map(std::size_t count) {
+                ++nested_;
+                value_.open_map(count);
+            }
+            void close_map() {
+                --nested_;
+                value_.close_map();
+                collect();
+            }
+
+            bool done() const {
+                return result_.has_value();
+            }
+            std::optional<T> take() {
+                auto value = std::move(*result_);
+                result_.reset();
+                return value;
+            }
+
+        private:
+            void collect() {
+                if (value_.done())
+                    result_.emplace(value_.take());
+            }
+
+            value_decoder_t<T> value_;
+            std::optional<std::optional<T>> result_;
+            std::size_t nested_ = 0; ///< Depth of arrays and maps inside of the value
+        };
+
+        /**
+         * Decoder of a value made of an array reply.
+         * Derived decoders start the value with the number of elements, and
+         * decode elements by forwarding the events to the current element decoder.
+         * A map reply is decoded as the array of its keys and values in turn.
+         */
+        template <typename T, typename Derived>
+        class array_decoder_t {
+        public:
+            void string(std::string_view str) {
+                if (!depth_)
+                    decode_mismatch<T>("string");
+                derived().forward([str](auto &element) { element.string(str); });
+            }
+            void integer(int_t value) {
+                if (!depth_)
+                    decode_mismatch<T>("integer");
+                derived().forward([value](auto &element) { element.integer(value); });
+            }
+            void floating(double value) {
+                if (!depth_)
+                    decode_mismatch<T>("double");
+                derived().forward([value](auto &element) { element.floating(value); });
+            }
+            void boolean(bool value) {
+                if (!depth_)
+                    decode_mismatch<T>("boolean");
+                derived().forward([value](auto &element) { element.boolean(value); });
+            }
+            void nil() {
+                if (!depth_)
+                    decode_mismatch<T>("nil");
+                derived().forward([](auto &element) { element.nil(); });
+            }
+            void open_array(std::size_t count) {
+                if (!depth_++) {
+                    derived().start(count);
+                    return;
+                }
+                derived().forward([count](auto &element) { element.open_array(count); });
+            }
+            void close_array() {
+                if (!--depth_) {
+                    done_ = true;
+                    return;
+                }
+                derived().forward([](auto &element) { element.close_array(); });
+            }
+            void open_map(std::size_t count) {
+                if (!depth_++) {
+                    derived().start(count * 2);
+                    return;
+                }
+                derived().forward([count](auto &element) { element.open_map(count); });
+            }
+            void close_map() {
+                if (!--depth_) {
+                    done_ = true;
+                    return;
+                }
+                derived().forward([](auto &element) { element.close_map(); });
+            }
+
+            bool done() const {
+                return done_;
+            }
+            T take() {
+                done_ = false;
+                return std::move(value_);
+            }
+
+        protected:
+            T value_{};
+
+        private:
+            Derived &derived() {
+                return static_cast<Derived &>(*this);
+            }
+
+            std::size_t depth_ = 0; ///< Depth of arrays and maps, the value's own one included
+            bool done_ = false;
+        };
+
+        template <typename T, typename Allocator>
+        class value_decoder_t<std::vector<T, Allocator>>
+            : public array_decoder_t<std::vector<T, Allocator>,
+                                     value_decoder_t<std::vector<T, Allocator>>> {
+        public:
+            void start(std::size_t count) {
+                this->value_.clear();
+                this->value_.reserve(count);
+            }
+            template <typename Event>
+            void forward(Event &&event) {
+                event(element_);
+                if (element_.done())
+                    this->value_.push_back(element_.take());
+            }
+
+        private:
+            value_decoder_t<T> element_;
+        };
+
+        template <typename T, typename = void>
+        struct has_reserve : std::false_type {};
+
+        template <typename T>
+        struct has_reserve<T, std::void_t<decltype(std::declval<T &>().reserve(0))>>
+            : std::true_type {};
+
+        /** Decoder of a map from a map reply or an array of keys followed by their values */
+        template <typename Map>
+        class map_decoder_t : public array_decoder_t<Map, map_decoder_t<Map>> {
+        public:
+            void start(std::size_t count) {
+                if (count % 2)
+                    decode_mismatch<Map>("odd sized array");
+                this->value_.clear();
+                if constexpr (has_reserve<Map>::value)
+                    this->value_.reserve(count / 2);
+            }
+            template <typename Event>
+            void forward(Event &&event) {
+                if (!key_) {
+                    event(key_decoder_);
+                    if (key_decoder_.done())
+                        key_.emplace(key_decoder_.take());
+                    return;
+                }
+                event(mapped_decoder_);
+                if (mapped_decoder_.done()) {
+                    this->value_.insert_or_assign(std::move(*key_), mapped_decoder_.take());
+                    key_.reset();
+                }
+            }
+
+        private:
+            value_decoder_t<typename Map::key_type> key_decoder_;
+            value_decoder_t<typename Map::mapped_type> mapped_decoder_;
+            std::optional<typename Map::key_type> key_;
+        };
+
+        template <typename Key, typename T, typename Hash, typename KeyEqual, typename Allocator>
+        class value_decoder_t<std::unordered_map<Key, T, Hash, KeyEqual, Allocator>>
+            : public map_decoder_t<std::unordered_map<Key, T, Hash, KeyEqual, Allocator>> {};
+
+        template <typename Key, typename T, typename Compare, typename Allocator>
+        class value_decoder_t<std::map<Key, T, Compare, Allocator>>
+            : public map_decoder_t<std::map<Key, T, Compare, Allocator>> {};
+
+        /** A tuple is decoded from an array of exactly as many elements */
+        template <typename... Ts>
+        class value_decoder_t<std::tuple<Ts...>>
+            : public array_decoder_t<std::tuple<Ts...>, value_decoder_t<std::tuple<Ts...>>> {
+        public:
+            void start(std::size_t count) {
+                if (count != sizeof...(Ts))
+                    throw error::client_error("Cannot decode array of " + std::to_string(count) +
+                                              " elements into " + demangle<std::tuple<Ts...>>());
+                index_ = 0;
+            }
+            template <typename Event>
+            void forward(Event &&event) {
+                forward(event, std::index_sequence_for<Ts...>{});
+            }
+
+        private:
+            template <typename Event, std::size_t... Is>
+            void forward(Event &event, std::index_sequence<Is...>) {
+                (void)((Is == index_ ? (forward_to<Is>(event), true) : false) || ...);
+            }
+            template <std::size_t I, typename Event>
+            void forward_to(Event &event) {
+                auto &element = std::get<I>(elements_);
+                event(element);
+                if (element.done()) {
+                    std::get<I>(this->value_) = element.take();
+                    ++index_;
+                }
+            }
+
+            std::tuple<value_decoder_t<Ts>...> elements_;
+            std::size_t index_ = 0; ///< Element being decoded
+        };
+
+        /** User types are decoded into their wire type, then converted */
+        template <typename T>
+        class value_decoder_t<T, std::void_t<typename reply_traits<T>::wire_type>> {
+        public:
+            using traits_type = reply_traits<T>;
+
+            void string(std::string_view str) {
+                wire_.string(str);
+            }
+            void integer(int_t value) {
+                wire_.integer(value);
+            }
+            void floating(double value) {
+                wire_.floating(value);
+            }
+            void boolean(bool value) {
+                wire_.boolean(value);
+            }
+            void nil() {
+                wire_.nil();
+            }
+            void open_array(std::size_t count) {
+                wire_.open_array(count);
+            }
+            void close_array() {
+                wire_.close_array();
+            }
+            void open_map(std::size_t count) {
+                wire_.open_map(count);
+            }
+            void close_map() {
+                wire_.close_map();
+            }
+
+            bool done() const {
+                return wire_.done();
+            }
+            T take() {
+                return traits_type::convert(wire_.take());
+            }
+
+        private:
+            value_decoder_t<typename traits_type::wire_type> wire_;
+        };
+
+        /**
+         * Type erased decoder of a reply, owned by the request.
+         * The first decoding error is kept and the rest of the reply is skipped.
+         */
+        class basic_reply_decoder {
+        public:
+            virtual ~basic_reply_decoder() = default;
+
+            void string(std::string_view str) {
+                guarded([&] { string_impl(str); });
+            }
+            void integer(int_t value) {
+                guarded([&] { integer_impl(value); });
+            }
+            void floating(double value) {
+                guarded([&] { floating_impl(value); });
+            }
+            void boolean(bool value) {
+                guarded([&] { boolean_impl(value); });
+            }
+            void nil() {
+                guarded([&] { nil_impl(); });
+            }
+            void open_array(std::size_t count) {
+                guarded([&] { open_array_impl(count); });
+            }
+            void close_array() {
+                guarded([&] { close_array_impl(); });
+            }
+            void open_map(std::size_t count) {
+                guarded([&] { open_map_impl(count); });
+            }
+            void close_map() {
+                guarded([&] { close_map_impl(); });
+            }
+
+            /**
+             * Pass the decoded value to the result callback.
+             * @throws error::client_error if the reply could not be decoded
+             */
+            void deliver() {
+                if (error_)
+                    throw *error_;
+                deliver_impl();
+            }
+
+            /**
+             * The decoder owns the completion of the request, the connection
+             * completes it right away instead of posting the result callback.
+             */
+            virtual bool completes_request() const {
+                return false;
+            }
+
+            /** Complete the request with the decoded value or the decoding error */
+            void complete() {
+                if (error_)
+                    fail(*error_);
+                else
+                    deliver_impl();
+            }
+
+            /** Complete the request with an error */
+            virtual void fail(error::rd_error const &) {
+            }
+
+        private:
+            template <typename Event>
+            void guarded(Event &&event) {
+                if (error_)
+                    return;
+                try {
+                    event();
+                } catch (error::client_error const &e) {
+                    error_ = e;
+                }
+            }
+
+            virtual void string_impl(std::string_view str) = 0;
+            virtual void integer_impl(int_t value) = 0;
+            virtual void floating_impl(double value) = 0;
+            virtual void boolean_impl(bool value) = 0;
+            virtual void nil_impl() = 0;
+            virtual void open_array_impl(std::size_t count) = 0;
+            virtual void close_array_impl() = 0;
+            virtual void open_map_impl(std::size_t count) = 0;
+            virtual void close_map_impl() = 0;
+            virtual void deliver_impl() = 0;
+
+            std::optional<error::client_error> error_;
+        };
+
+        /** Feed a reply parsed already, a reply assembled by the client, to the decoder */
+        inline void decode(basic_reply_decoder &decoder, const result_t &value) {
+            std::visit(
+                [&decoder](const auto &v) {
+                    using type = std::decay_t<decltype(v)>;
+                    if constexpr (std::is_same_v<type, int_t>) {
+                        decoder.integer(v);
+                    } else if constexpr (std::is_same_v<type, string_t>) {
+                        decoder.string(v);
+                    } else if constexpr (std::is_same_v<type, nil_t>) {
+                        decoder.nil();
+                    } else if constexpr (std::is_same_v<type, double>) {
+                        decoder.floating(v);
+                    } else if constexpr (std::is_same_v<type, bool>) {
+                        decoder.boolean(v);
+                    } else if constexpr (std::is_same_v<type, array_holder_t>) {
+                        decoder.open_array(v.elements.size());
+                        for (auto &e : v.elements)
+                            decode(decoder, e);
+                        decoder.close_array();
+                    } else {
+                        decoder.open_map(v.elements.size());
+                        for (auto &e : v.elements) {
+                            decode(decoder, e.first);
+                            decode(decoder, e.second);
+                        }
+                        decoder.close_map();
+                    }
+                },
+                value);
+        }
+
+        template <typename T>
+        class reply_decoder_t : public basic_reply_decoder {
+        public:
+            explicit reply_decoder_t(typed_result_callback<T> &&result)
+                : result_{std::move(result)} {
+            }
+
+        private:
+            void string_impl(std::string_view str) override {
+                value_.string(str);
+            }
+            void integer_impl(int_t value) override {
+                value_.integer(value);
+            }
+            void floating_impl(double value) override {
+                value_.floating(value);
+            }
+            void boolean_impl(bool value) override {
+                value_.boolean(value);
+            }
+            void nil_impl() override {
+                value_.nil();
+            }
+            void open_array_impl(std::size_t count) override {
+                value_.open_array(count);
+            }
+            void close_array_impl() override {
+                value_.close_array();
+            }
+            void open_map_impl(std::size_t count) override {
+                value_.open_map(count);
+            }
+            void close_map_impl() override {
+                value_.close_map();
+            }
+            void deliver_impl() override {
+                if (!value_.done())
+                    throw error::client_error("Incomplete reply for " + demangle<T>());
+                if (result_)
+                    result_(value_.take());
+            }
+
+            value_decoder_t<T> value_;
+            typed_result_callback<T> result_;
+        };
+
+        /** Exception pointer keeping the type of the library exception */
+        inline std::exception_ptr make_error_ptr(error::rd_error const &e) {
+            if (auto err = dynamic_cast<error::query_error const *>(&e))
+                return std::make_exception_ptr(*err);
+            if (auto err = dynamic_cast<error::connection_error const *>(&e))
+                return std::make_exception_ptr(*err);
+            if (auto err = dynamic_cast<error::client_error const *>(&e))
+                return std::make_exception_ptr(*err);
+            if (auto err = dynamic_cast<error::timeout_error const *>(&e))
+                return std::make_exception_ptr(*err);
+            if (auto err = dynamic_cast<error::queue_full_error const *>(&e))
+                return std::make_exception_ptr(*err);
+            return std::make_exception_ptr(e);
+        }
+
+        /**
+         * Decoder completing an asynchronous operation of Asio, with the
+         * signature void(std::exception_ptr, T). The handler is called
+         * through its associated executor, inline when it is the one of
+         * the connection.
+         */
+        template <typename T, typename Handler>
+        class async_reply_decoder_t : public basic_reply_decoder {
+        public:
+            explicit async_reply_decoder_t(Handler &&handler)
+                : handler_{std::move(handler)}
+                , work_{boost::asio::make_work_guard(handler_)} {
+            }
+
+            bool completes_request() const override {
+                return true;
+            }
+
+            void fail(error::rd_error const &e) override {
+                invoke(make_error_ptr(e), T{});
+            }
+
+        private:
+            void string_impl(std::string_view str) override {
+                value_.string(str);
+            }
+            void integer_impl(int_t value) override {
+                value_.integer(value);
+            }
+            void floating_impl(double value) override {
+                value_.floating(value);
+            }
+            void boolean_impl(bool value) override {
+                value_.boolean(value);
+            }
+            void nil_impl() override {
+                value_.nil();
+            }
+            void open_array_impl(std::size_t count) override {
+                value_.open_array(count);
+            }
+            void close_array_impl() override {
+                value_.close_array();
+            }
+            void open_map_impl(std::size_t count) override {
+                value_.open_map(count);
+            }
+            void close_map_impl() override {
+                value_.close_map();
+            }
+            void deliver_impl() override {
+                if (!value_.done())
+                    fail(error::client_error("Incomplete reply for " + demangle<T>()));
+                else
+                    invoke(nullptr, value_.take());
+            }
+
+            void invoke(std::exception_ptr err, T &&value) {
+                if (completed_)
+                    return;
+                completed_ = true;
+                auto ex = boost::asio::get_associated_executor(handler_);
+                boost::asio::dispatch(
+                    ex, [handler = std::move(handler_), err, value = std::move(value)]() mutable {
+                        handler(err, std::move(value));
+                    });
+                work_.reset();
+            }
+
+            Handler handler_;
+            boost::asio::executor_work_guard<boost::asio::associated_executor_t<Handler>> work_;
+            value_decoder_t<T> value_;
+            bool completed_ = false;
+        };
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_REPLY_DECODER_HPP
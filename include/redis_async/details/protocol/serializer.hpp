@@ -7,6 +7,7 @@
 
 #include <redis_async/commands.hpp>
 
+#include <charconv>
 #include <cstring>
 
 namespace redis_async {
@@ -31,7 +32,7 @@ namespace redis_async {
                                  + size_for_int(cmd.arguments.size()) /* args size */
                                  + terminator_size;
 
-                for (const auto &arg : cmd.arguments) {
+                for (auto arg : cmd.arguments) {
                     sz += 1                          /* $ */
                           + size_for_int(arg.size()) /* argument size */
                           + terminator_size + arg.size() + terminator_size;
@@ -39,22 +40,40 @@ namespace redis_async {
                 return sz;
             }
 
+            inline static std::size_t command_size(const command_container_t &cont) {
+                std::size_t sz = 0;
+                for (const auto &cmd : cont)
+                    sz += command_size(cmd);
+                return sz;
+            }
+
+            inline static std::size_t command_size(const command_wrapper_t &cmd) {
+                return std::visit([](const auto &c) { return command_size(c); }, cmd);
+            }
+
+            /** Write `type` followed by `count` and the terminator */
+            inline static char *serialize_header(char *out, char type, std::size_t count) {
+                *out++ = type;
+                out = std::to_chars(out, out + 20, count).ptr;
+                *out++ = '\r';
+                *out++ = '\n';
+                return out;
+            }
+
             template <typename DynamicBuffer>
             inline static void serialize(DynamicBuffer &buff, const single_command_t &cmd) {
                 auto total = buff.size();
-                auto size = command_size(cmd);
-                buff.resize(total + size);
-                total += snprintf(buff.data() + total, size, "*%zu\r\n", cmd.arguments.size());
-
-                for (const auto &arg : cmd.arguments) {
-                    total += snprintf(buff.data() + total, size, "$%zu\r\n", arg.size());
+                buff.resize(total + command_size(cmd));
+                auto out = serialize_header(buff.data() + total, '*', cmd.arguments.size());
 
+                for (auto arg : cmd.arguments) {
+                    out = serialize_header(out, '$', arg.size());
                     if (!arg.empty()) {
-                        std::memcpy(buff.data() + total, arg.data(), arg.size());
-                        total += arg.size();
+                        std::memcpy(out, arg.data(), arg.size());
+                        out += arg.size();
                     }
-                    buff[total++] = '\r';
-                    buff[total++] = '\n';
+                    *out++ = '\r';
+                    *out++ = '\n';
                 }
             }
 
@@ -64,21 +83,10 @@ namespace redis_async {
                     Protocol::serialize(buff, cmd);
                 }
             }
-        };
-
-        template <typename DynamicBuffer>
-        class command_serializer_visitor {
-        private:
-            DynamicBuffer &buff_;
-
-        public:
-            command_serializer_visitor(DynamicBuffer &buff)
-                : buff_{buff} {
-            }
 
-            template <typename T>
-            void operator()(const T &value) const {
-                Protocol::serialize(buff_, value);
+            template <typename DynamicBuffer>
+            inline static void serialize(DynamicBuffer &buff, const command_wrapper_t &cmd) {
+                std::visit([&buff](const auto &c) { Protocol::serialize(buff, c); }, cmd);
             }
         };
 
@@ -0,0 +1,586 @@
+//
+// Created by niko on 14.09.2021.
+//
+
+#ifndef REDIS_ASYNC_STREAM_PARSER_HPP
+#define REDIS_ASYNC_STREAM_PARSER_HPP
+
+#include <redis_async/details/protocol/parser.hpp>
+#include <redis_async/details/protocol/reply_decoder.hpp>
+#include <redis_async/error.hpp>
+#include <redis_async/flat_reply.hpp>
+#include <redis_async/rd_types.hpp>
+
+#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace redis_async {
+    namespace details {
+
+        /**
+         * Builder of reply values, fed by the stream parser in the wire order.
+         * Arrays are opened with the number of their elements and closed after the last one,
+         * maps with the number of their pairs, keys and values follow in turn.
+         */
+        template <typename Value, typename Array, typename Map>
+        class tree_builder_t {
+        public:
+            using result_type = Value;
+
+            void integer(int_t value) {
+                complete(value);
+            }
+
+            void floating(double value) {
+                complete(value);
+            }
+
+            void boolean(bool value) {
+                complete(value);
+            }
+
+            void nil() {
+                complete(nil_t{});
+            }
+
+            void open_array(std::size_t count) {
+                stack_.emplace_back();
+                stack_.back().elements.reserve(count);
+            }
+
+            void close_array() {
+                auto array = std::move(stack_.back());
+                stack_.pop_back();
+                complete(std::move(array));
+            }
+
+            /** Keys and values are collected as an array, then paired */
+            void open_map(std::size_t count) {
+                open_array(count * 2);
+            }
+
+            void close_map() {
+                auto &elements = stack_.back().elements;
+                Map map;
+                map.elements.reserve(elements.size() / 2);
+                for (std::size_t i = 0; i + 1 < elements.size(); i += 2)
+                    map.elements.emplace_back(std::move(elements[i]), std::move(elements[i + 1]));
+                stack_.pop_back();
+                complete(std::move(map));
+            }
+
+            result_type result() {
+                return std::move(result_);
+            }
+
+            void reset() {
+                stack_.clear();
+            }
+
+        protected:
+            void complete(result_type &&value) {
+                if (stack_.empty())
+                    result_ = std::move(value);
+                else
+                    stack_.back().elements.push_back(std::move(value));
+            }
+
+        private:
+            std::vector<Array> stack_; ///< Arrays being built, innermost last
+            result_type result_;
+        };
+
+        /** Builds result_t, copying strings out of the buffer */
+        struct result_builder_t : tree_builder_t<result_t, array_holder_t, map_holder_t> {
+            template <typename Iterator>
+            void string(const Iterator &from, const Iterator &to) {
+                complete(string_t{from, to});
+            }
+        };
+
+        /** Builds view_t, referring to strings in a contiguous buffer */
+        struct view_builder_t : tree_builder_t<view_t, view_array_t, view_map_t> {
+            void string(const char *from, const char *to) {
+                complete(std::string_view{from, static_cast<std::size_t>(to - from)});
+            }
+        };
+
+        /** Builds nothing, counts values of the reply to find out where it ends */
+        class counting_builder_t {
+        public:
+            using result_type = std::size_t;
+
+            template <typename Iterator>
+            void string(const Iterator &, const Iterator &) {
+                ++count_;
+            }
+            void integer(int_t) {
+                ++count_;
+            }
+            void floating(double) {
+                ++count_;
+            }
+            void boolean(bool) {
+                ++count_;
+            }
+            void nil() {
+                ++count_;
+            }
+            void open_array(std::size_t) {
+                ++count_;
+            }
+            void close_array() {
+            }
+            void open_map(std::size_t) {
+                ++count_;
+            }
+            void close_map() {
+            }
+            result_type result() {
+                auto count = count_;
+                count_ = 0;
+                return count;
+            }
+            void reset() {
+                count_ = 0;
+            }
+
+        private:
+            std::size_t count_ = 0;
+        };
+
+        /**
+         * Builds flat_reply_t. Nodes and strings are collected in buffers reused
+         * from reply to reply, then moved into the reply with one allocation.
+         */
+        class flat_builder_t {
+        public:
+            using result_type = flat_reply_t;
+
+            template <typename Iterator>
+            void string(const Iterator &from, const Iterator &to) {
+                auto offset = strings_.size();
+                strings_.append(from, to);
+                complete(node_type::string, strings_.size() - offset, offset);
+            }
+            void integer(int_t value) {
+                complete(node_type::integer, 0, value);
+            }
+            void floating(double value) {
+                int_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                complete(node_type::floating, 0, bits);
+            }
+            void boolean(bool value) {
+                complete(node_type::boolean, 0, value);
+            }
+            void nil() {
+                complete(node_type::nil, 0, 0);
+            }
+            void open_array(std::size_t count) {
+                open(node_type::array, count);
+            }
+            void close_array() {
+                auto index = arrays_.back();
+                arrays_.pop_back();
+                nodes_[index].next = static_cast<std::uint32_t>(nodes_.size() - index);
+            }
+            /** Keys and values of a map follow it in turn */
+            void open_map(std::size_t count) {
+                open(node_type::map, count * 2);
+            }
+            void close_map() {
+                close_array();
+            }
+
+            result_type result() {
+                flat_reply_t reply{nodes_.size(), strings_.size()};
+                std::copy(nodes_.begin(), nodes_.end(), reply.nodes());
+                std::copy(strings_.begin(), strings_.end(), reply.strings());
+                reset();
+                return reply;
+            }
+            void reset() {
+                nodes_.clear();
+                strings_.clear();
+                arrays_.clear();
+            }
+
+        private:
+            void complete(node_type type, std::size_t size, int_t value) {
+                nodes_.push_back({type, static_cast<std::uint32_t>(size), 1, value});
+            }
+            void open(node_type type, std::size_t count) {
+                arrays_.push_back(nodes_.size());
+                nodes_.push_back({type, static_cast<std::uint32_t>(count), 1, 0});
+            }
+
+            std::vector<flat_node_t> nodes_;
+            std::string strings_;
+            std::vector<std::size_t> arrays_; ///< Indices of the arrays and maps being built
+        };
+
+        /**
+         * Passes the reply straight to the decoder of the request it is for,
+         * with strings referring to a contiguous buffer.
+         */
+        class decoding_builder_t {
+        public:
+            using result_type = basic_reply_decoder *;
+
+            /** The decoder of the request the next reply is for */
+            void target(basic_reply_decoder *decoder) {
+                decoder_ = decoder;
+            }
+
+            void string(const char *from, const char *to) {
+                decoder_->string({from, static_cast<std::size_t>(to - from)});
+            }
+            void integer(int_t value) {
+                decoder_->integer(value);
+            }
+            void floating(double value) {
+                decoder_->floating(value);
+            }
+            void boolean(bool value) {
+                decoder_->boolean(value);
+            }
+            void nil() {
+                decoder_->nil();
+            }
+            void open_array(std::size_t count) {
+                decoder_->open_array(count);
+            }
+            void close_array() {
+                decoder_->close_array();
+            }
+            void open_map(std::size_t count) {
+                decoder_->open_map(count);
+            }
+            void close_map() {
+                decoder_->close_map();
+            }
+            result_type result() {
+                return decoder_;
+            }
+            void reset() {
+            }
+
+        private:
+            basic_reply_decoder *decoder_ = nullptr;
+        };
+
+        /**
+         * Resumable parser of the reply stream.
+         *
+         * Unlike raw_parse, it remembers how far the current reply has been parsed
+         * and the arrays built so far, so every byte is looked at once, however
+         * many reads the reply is split into. The caller keeps the unparsed reply
+         * in the buffer: on "need more" nothing is consumed, and the next call must
+         * start at the same position with the buffer extended.
+         *
+         * RESP3 types are parsed as well: sets and pushes are built as arrays, big
+         * numbers and verbatim strings (without the format) as strings, attributes
+         * are skipped.
+         */
+        template <typename Builder>
+        class basic_stream_parser_t {
+        public:
+            using builder_type = Builder;
+            using result_type = basic_parse_result_t<typename builder_type::result_type>;
+            using positive_result_type =
+                basic_positive_parse_result_t<typename builder_type::result_type>;
+
+            /**
+             * Continue parsing the reply which starts at `from`.
+             * @return positive result or server error with the size of the whole
+             *         reply, protocol error not_enough_data if the reply is
+             *         incomplete, any other protocol error if the stream is broken.
+             */
+            template <typename Iterator>
+            result_type parse(const Iterator &from, const Iterator &to);
+
+            /** Drop the state of a partially parsed reply */
+            void reset() {
+                builder_.reset();
+                stack_.clear();
+                error_.reset();
+                offset_ = 0;
+                scanned_ = 0;
+                skipped_ = 0;
+            }
+
+            builder_type &builder() {
+                return builder_;
+            }
+
+            template <typename ParseResult>
+            static bool need_more(const ParseResult &res) {
+                auto *err = std::get_if<protocol_error_t>(&res);
+                return err && err->code == error::make_error_code(error::errc::not_enough_data);
+            }
+
+        private:
+            /** Array, set, push, map or attribute being parsed */
+            struct aggregate_t {
+                char type;
+                int_t left; ///< Elements left, keys and values of a map counted apart
+            };
+
+            result_type protocol_error(error::errc ec) {
+                reset();
+                return protocol_error_t{error::make_error_code(ec)};
+            }
+
+            static result_type not_enough_data() {
+                return protocol_error_t{error::make_error_code(error::errc::not_enough_data)};
+            }
+
+            static bool introduction(char c) {
+                switch (c) {
+                case '+':
+                case '-':
+                case ':':
+                case '$':
+                case '*':
+                case '_':
+                case ',':
+                case '#':
+                case '(':
+                case '!':
+                case '=':
+                case '%':
+                case '~':
+                case '|':
+                case '>':
+                    return true;
+                }
+                return false;
+            }
+
+            template <typename Iterator>
+            static bool parse_int(const Iterator &from, const Iterator &to, int_t &value) {
+                return boost::conversion::try_lexical_convert(std::string{from, to}, value);
+            }
+
+            /** Values inside of an attribute are not built */
+            bool building() const {
+                return !skipped_;
+            }
+
+            void open(char type, std::size_t count) {
+                if (!building())
+                    return;
+                if (type == '%')
+                    builder_.open_map(count);
+                else
+                    builder_.open_array(count);
+            }
+
+            void close(char type) {
+                if (!building())
+                    return;
+                if (type == '%')
+                    builder_.close_map();
+                else
+                    builder_.close_array();
+            }
+
+            builder_type builder_;
+            std::vector<aggregate_t> stack_; ///< Aggregates being parsed, innermost last
+            std::optional<string_t> error_;  ///< First error element of an array
+            std::size_t offset_ = 0;         ///< Parsed bytes of the current reply
+            std::size_t scanned_ = 0;        ///< Bytes of the current line without terminator
+            std::size_t skipped_ = 0;        ///< Depth of the attributes being skipped
+        };
+
+        template <typename Builder>
+        template <typename Iterator>
+        auto basic_stream_parser_t<Builder>::parse(const Iterator &from, const Iterator &to)
+            -> result_type {
+            static constexpr std::size_t terminator_size = 2;
+            static constexpr std::size_t verbatim_format_size = 4; ///< "txt:"
+
+            while (true) {
+                Iterator head = from + offset_;
+                if (head == to)
+                    return not_enough_data();
+                if (!introduction(*head))
+                    return protocol_error(error::errc::wrong_introduction);
+
+                // Find the end of the type line, skipping what was scanned by the last call
+                Iterator line = std::next(head);
+                Iterator eol =
+                    std::search(line + scanned_, to, terminator.begin(), terminator.end());
+                if (eol == to) {
+                    auto left = static_cast<std::size_t>(std::distance(line, to));
+                    // '\r' may be the last byte, scan it again with the next chunk
+                    scanned_ = left ? left - 1 : 0;
+                    return not_enough_data();
+                }
+                Iterator next = eol + terminator_size;
+                // Error message of a simple or a blob error
+                std::optional<string_t> error;
+
+                switch (*head) {
+                case '+':
+                case '(':
+                    if (building())
+                        builder_.string(line, eol);
+                    break;
+                case '-':
+                    error = string_t{line, eol};
+                    break;
+                case ':': {
+                    int_t number;
+                    if (!parse_int(line, eol, number))
+                        return protocol_error(error::errc::count_conversion);
+                    if (building())
+                        builder_.integer(number);
+                    break;
+                }
+                case '_':
+                    if (line != eol)
+                        return protocol_error(error::errc::parser_error);
+                    if (building())
+                        builder_.nil();
+                    break;
+                case ',': {
+                    double number;
+                    if (!boost::conversion::try_lexical_convert(std::string{line, eol}, number))
+                        return protocol_error(error::errc::parser_error);
+                    if (building())
+                        builder_.floating(number);
+                    break;
+                }
+                case '#':
+                    if (std::distance(line, eol) != 1 || (*line != 't' && *line != 'f'))
+                        return protocol_error(error::errc::parser_error);
+                    if (building())
+                        builder_.boolean(*line == 't');
+                    break;
+                case '$':
+                case '!':
+                case '=': {
+                    int_t count;
+                    if (!parse_int(line, eol, count))
+                        return protocol_error(error::errc::count_conversion);
+                    if (count == -1 && *head == '$') {
+                        if (building())
+                            builder_.nil();
+                        break;
+                    }
+                    if (count < (*head == '=' ? int_t(verbatim_format_size) : 0))
+                        return protocol_error(error::errc::count_range);
+                    auto left = static_cast<std::size_t>(std::distance(next, to));
+                    if (left < count + terminator_size) {
+                        // The header is short, it is cheaper to read it again than to keep it
+                        scanned_ = 0;
+                        return not_enough_data();
+                    }
+                    Iterator tail = next + count;
+                    if (!std::equal(tail, tail + terminator_size, terminator.begin(),
+                                    terminator.end()))
+                        return protocol_error(error::errc::bulk_terminator);
+                    if (*head == '!')
+                        error = string_t{next, tail};
+                    else if (building())
+                        builder_.string(*head == '=' ? next + verbatim_format_size : next, tail);
+                    next = tail + terminator_size;
+                    break;
+                }
+                case '*':
+                case '~':
+                case '>':
+                case '%':
+                case '|': {
+                    int_t count;
+                    if (!parse_int(line, eol, count))
+                        return protocol_error(error::errc::count_conversion);
+                    if (count == -1 && *head == '*') {
+                        if (building())
+                            builder_.nil();
+                        break;
+                    }
+                    if (count < 0)
+                        return protocol_error(error::errc::count_range);
+                    auto elements = *head == '%' || *head == '|' ? count * 2 : count;
+                    // An attribute describes the value which follows it, it is not a value
+                    bool attribute = *head == '|';
+                    if (!attribute) {
+                        open(*head, count);
+                        if (!elements) {
+                            close(*head);
+                            break;
+                        }
+                    }
+                    if (elements) {
+                        if (attribute)
+                            ++skipped_;
+                        stack_.push_back({*head, elements});
+                    }
+                    offset_ += std::distance(head, next);
+                    scanned_ = 0;
+                    continue;
+                }
+                }
+
+                if (error) {
+                    if (stack_.empty()) {
+                        auto consumed = offset_ + std::distance(head, next);
+                        reset();
+                        return error_t{std::move(*error), consumed};
+                    }
+                    if (building()) {
+                        if (!error_)
+                            error_ = std::move(error);
+                        builder_.nil();
+                    }
+                }
+
+                offset_ += std::distance(head, next);
+                scanned_ = 0;
+
+                // Close the aggregates the value completes
+                bool value = true;
+                while (value && !stack_.empty() && !--stack_.back().left) {
+                    auto type = stack_.back().type;
+                    stack_.pop_back();
+                    if (type == '|') {
+                        // The attribute is not an element, the value it describes is
+                        --skipped_;
+                        value = false;
+                    } else {
+                        close(type);
+                    }
+                }
+                if (value && stack_.empty()) {
+                    auto consumed = offset_;
+                    auto error = std::move(error_);
+                    auto result = builder_.result();
+                    reset();
+                    if (error)
+                        return error_t{std::move(*error), consumed};
+                    return positive_result_type{std::move(result), consumed};
+                }
+            }
+        }
+
+        /** Parser of replies into result_t */
+        using stream_parser_t = basic_stream_parser_t<result_builder_t>;
+        /** Parser which only finds the ends of replies */
+        using reply_scanner_t = basic_stream_parser_t<counting_builder_t>;
+        /** Parser of a complete reply in a contiguous buffer into view_t */
+        using view_parser_t = basic_stream_parser_t<view_builder_t>;
+        /** Parser of replies into flat_reply_t */
+        using flat_parser_t = basic_stream_parser_t<flat_builder_t>;
+        /** Parser which decodes replies into the types requests expect */
+        using decoding_parser_t = basic_stream_parser_t<decoding_builder_t>;
+
+    } // namespace details
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_STREAM_PARSER_HPP
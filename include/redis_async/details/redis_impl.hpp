@@ -10,43 +10,100 @@
 #include <redis_async/common.hpp>
 
 #include <boost/noncopyable.hpp>
+#include <atomic>
 #include <map>
+#include <vector>
 
 namespace redis_async {
     namespace details {
 
         struct connection_pool;
+        class subscriber;
+        class client_cache;
+        class cluster;
 
         class redis_impl : private boost::noncopyable {
             typedef std::shared_ptr<connection_pool> connection_pool_ptr;
-            typedef std::map<rdalias, connection_pool_ptr> pools_map;
+            /** Pool of every shard for an alias */
+            typedef std::vector<connection_pool_ptr> shard_pools;
+            typedef std::map<rdalias, shard_pools> pools_map;
+            typedef std::shared_ptr<subscriber> subscriber_ptr;
+            typedef std::map<rdalias, subscriber_ptr> subscribers_map;
+            typedef std::shared_ptr<client_cache> client_cache_ptr;
+            typedef std::map<rdalias, client_cache_ptr> caches_map;
+            typedef std::shared_ptr<cluster> cluster_ptr;
+            typedef std::map<rdalias, cluster_ptr> clusters_map;
 
         public:
             explicit redis_impl(size_t pool_size);
             virtual ~redis_impl();
 
             void set_defaults(size_t pool_size);
+            void set_threads(size_t threads);
             void add_connection(std::string const &connection_string,
                                 optional_size pool_size = optional_size());
             void add_connection(const connection_options &options,
                                 optional_size pool_size = optional_size());
-            void get_connection(rdalias &&alias, command_wrapper_t &&cmd,
-                                query_result_callback &&conn_cb, error_callback &&err);
+            bool get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                query_result_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject);
+            bool get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                reply_view_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject);
+            bool get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                flat_reply_callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject);
+            bool get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                reply_decoder_ptr &&decoder, error_callback &&err,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0},
+                                admission adm = admission::reject);
+            /** Requests of all the shards of the alias not answered yet */
+            size_t queue_depth(rdalias const &alias);
+            size_t queue_bytes(rdalias const &alias);
+            /** Counters of the client side cache of the alias, zeros if it has none */
+            cache_stats_t cache_stats(rdalias const &alias);
+
+            subscription_id subscribe(rdalias const &alias, subscription_kind kind,
+                                      std::string channel, message_callback &&handler,
+                                      error_callback &&err);
+            void unsubscribe(rdalias const &alias, subscription_id id);
 
             void run();
             void stop();
 
             asio_config::io_service_ptr io_service() {
-                return service_;
+                return services_.front();
             }
 
         private:
-            connection_pool_ptr add_pool(const connection_options &co,
-                                         optional_size pool_size = optional_size());
+            shard_pools const &get_pools(rdalias const &alias);
+            /** Pools of the alias, of all the nodes for a cluster */
+            shard_pools alias_pools(rdalias const &alias);
+            cluster_ptr get_cluster(rdalias const &alias);
+            size_t next_shard();
+            /** Send the command to the pool of the alias, or to the node of a cluster */
+            template <typename Callback>
+            bool submit(rdalias const &alias, size_t shard, command_wrapper_t &&cmd,
+                        Callback &&conn_cb, error_callback &&err, std::chrono::milliseconds timeout,
+                        admission adm);
+            subscriber_ptr const &get_subscriber(rdalias const &alias);
+            void add_pool(connection_options co, optional_size pool_size = optional_size());
+            void run_shard(size_t shard);
 
-            asio_config::io_service_ptr service_;
+            /** Event loops, one per thread, each with its own connections */
+            std::vector<asio_config::io_service_ptr> services_;
+            std::atomic<size_t> next_shard_;
             size_t pool_size_;
             pools_map connections_;
+            /** Subscriptions of an alias, on the first event loop */
+            subscribers_map subscribers_;
+            /** Client side cache of an alias, shared by its shards */
+            caches_map caches_;
+            /** Cluster aliases, their node pools are not in connections_ */
+            clusters_map clusters_;
 
             enum state_type { running, closing, closed };
             state_type state_;
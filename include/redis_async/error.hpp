@@ -5,8 +5,12 @@
 #ifndef REDIS_ASYNC_ERROR_HPP
 #define REDIS_ASYNC_ERROR_HPP
 
+#include <optional>
 #include <stdexcept>
 #include <system_error>
+#include <vector>
+
+#include <redis_async/rd_types.hpp>
 
 namespace redis_async {
     namespace error {
@@ -61,6 +65,38 @@ namespace redis_async {
             explicit query_error(const char *msg);
         };
 
+        /**
+         * @brief Some commands of a batch failed, the others did not.
+         * Carries the replies to all the commands, nil_t for the failed ones,
+         * and the errors of the failed ones. The message is of the first error.
+         */
+        class batch_error : public query_error {
+        public:
+            batch_error(std::vector<result_t> &&replies,
+                        std::vector<std::optional<query_error>> &&errors);
+
+            std::vector<result_t> replies;
+            std::vector<std::optional<query_error>> errors; ///< Of every command, set if it failed
+        };
+
+        /**
+         * @brief A request or a connect did not complete in time.
+         */
+        class timeout_error : public rd_error {
+        public:
+            explicit timeout_error(const std::string &msg);
+            explicit timeout_error(const char *msg);
+        };
+
+        /**
+         * @brief The request queue of the connection pool is full.
+         */
+        class queue_full_error : public rd_error {
+        public:
+            explicit queue_full_error(const std::string &msg);
+            explicit queue_full_error(const char *msg);
+        };
+
         /**
          * @brief An exception was caught in a callback.
          * @see @ref errors
@@ -0,0 +1,263 @@
+//
+// Created by niko on 16.09.2021.
+//
+
+#ifndef REDIS_ASYNC_FLAT_REPLY_HPP
+#define REDIS_ASYNC_FLAT_REPLY_HPP
+
+#include <redis_async/error.hpp>
+#include <redis_async/rd_types.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string_view>
+
+namespace redis_async {
+
+    namespace details {
+        class flat_builder_t;
+    } // namespace details
+
+    /** Floating, boolean and map nodes come with RESP3 only */
+    enum class node_type : std::uint8_t { integer, string, nil, array, floating, boolean, map };
+
+    /**
+     * Node of a flat reply. Elements of an array follow it in the wire order,
+     * so a subtree is a contiguous range of nodes. Keys and values of a map
+     * follow it in turn.
+     */
+    struct flat_node_t {
+        node_type type;
+        std::uint32_t size; ///< Length of a string or number of elements of an array or a map
+        std::uint32_t next; ///< Distance to the node after the subtree
+        int_t value; ///< Integer, bits of a double or offset of a string in the string area
+    };
+
+    /**
+     * @brief Position in a flat reply.
+     * Cheap to copy, valid while the reply lives.
+     */
+    class reply_cursor_t {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = reply_cursor_t;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const reply_cursor_t *;
+            using reference = reply_cursor_t;
+
+            iterator() = default;
+
+            reply_cursor_t operator*() const {
+                return {node_, strings_};
+            }
+
+            iterator &operator++() {
+                node_ += node_->next;
+                return *this;
+            }
+            iterator operator++(int) {
+                auto tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            bool operator==(const iterator &rhs) const {
+                return node_ == rhs.node_;
+            }
+            bool operator!=(const iterator &rhs) const {
+                return node_ != rhs.node_;
+            }
+
+        private:
+            friend class reply_cursor_t;
+            iterator(const flat_node_t *node, const char *strings)
+                : node_{node}
+                , strings_{strings} {
+            }
+
+            const flat_node_t *node_ = nullptr;
+            const char *strings_ = nullptr;
+        };
+
+        reply_cursor_t(const flat_node_t *node, const char *strings)
+            : node_{node}
+            , strings_{strings} {
+        }
+
+        node_type type() const {
+            return node_->type;
+        }
+        bool is_nil() const {
+            return node_->type == node_type::nil;
+        }
+
+        /** @throws error::client_error if the node is not an integer */
+        int_t integer() const {
+            expect(node_type::integer, "integer");
+            return node_->value;
+        }
+
+        /** @throws error::client_error if the node is not a string */
+        std::string_view string() const {
+            expect(node_type::string, "string");
+            return {strings_ + node_->value, node_->size};
+        }
+
+        /** @throws error::client_error if the node is not a double */
+        double floating() const {
+            expect(node_type::floating, "double");
+            return as_double();
+        }
+
+        /** @throws error::client_error if the node is not a boolean */
+        bool boolean() const {
+            expect(node_type::boolean, "boolean");
+            return node_->value != 0;
+        }
+
+        //@{
+        /**
+         * @name Elements of an array, in the wire order.
+         * A map is walked as its keys and values in turn, size() counts both.
+         */
+        /** @throws error::client_error if the node is neither an array nor a map */
+        std::size_t size() const {
+            expect_aggregate();
+            return node_->size;
+        }
+        iterator begin() const {
+            expect_aggregate();
+            return {node_ + 1, strings_};
+        }
+        iterator end() const {
+            return {node_ + node_->next, strings_};
+        }
+        /** Linear in the number of elements before the one needed */
+        reply_cursor_t operator[](std::size_t index) const {
+            return *std::next(begin(), index);
+        }
+        //@}
+
+        /**
+         * Call the visitor with int_t, std::string_view, nil_t, double, bool or,
+         * for an array or a map, with the cursor itself.
+         */
+        template <typename Visitor>
+        decltype(auto) visit(Visitor &&vis) const {
+            switch (node_->type) {
+            case node_type::integer:
+                return vis(node_->value);
+            case node_type::string:
+                return vis(std::string_view{strings_ + node_->value, node_->size});
+            case node_type::nil:
+                return vis(nil_t{});
+            case node_type::floating:
+                return vis(as_double());
+            case node_type::boolean:
+                return vis(node_->value != 0);
+            default:
+                return vis(*this);
+            }
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const reply_cursor_t &cursor) {
+            if (cursor.type() != node_type::array && cursor.type() != node_type::map)
+                return cursor.visit([&out](const auto &v) -> std::ostream & { return out << v; });
+            out << (cursor.type() == node_type::map ? "{MAP_t}\n" : "{ARRAY_t}\n");
+            for (auto item : cursor)
+                out << '\t' << item << '\n';
+            return out;
+        }
+
+    private:
+        void expect(node_type type, const char *name) const {
+            if (node_->type != type)
+                throw error::client_error(std::string{"Reply node is not "} + name);
+        }
+        void expect_aggregate() const {
+            if (node_->type != node_type::array && node_->type != node_type::map)
+                throw error::client_error("Reply node is not array");
+        }
+        double as_double() const {
+            double value;
+            std::memcpy(&value, &node_->value, sizeof(value));
+            return value;
+        }
+
+        const flat_node_t *node_;
+        const char *strings_;
+    };
+
+    /**
+     * @brief Reply with all its nodes and strings in a single allocation.
+     * Nodes are walked with reply_cursor_t starting at root().
+     */
+    class flat_reply_t {
+    public:
+        flat_reply_t() = default;
+        flat_reply_t(flat_reply_t &&) = default;
+        flat_reply_t &operator=(flat_reply_t &&) = default;
+
+        flat_reply_t(const flat_reply_t &rhs)
+            : flat_reply_t(rhs.nodes_, rhs.bytes_) {
+            std::copy(rhs.arena_.get(), rhs.arena_.get() + slots(), arena_.get());
+        }
+        flat_reply_t &operator=(const flat_reply_t &rhs) {
+            if (this != &rhs)
+                *this = flat_reply_t{rhs};
+            return *this;
+        }
+
+        bool empty() const {
+            return nodes_ == 0;
+        }
+        /** Total number of nodes */
+        std::size_t size() const {
+            return nodes_;
+        }
+
+        /** @pre !empty() */
+        reply_cursor_t root() const {
+            return {arena_.get(), strings()};
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const flat_reply_t &reply) {
+            if (reply.empty())
+                return out << "{EMPTY}";
+            return out << reply.root();
+        }
+
+    private:
+        friend class details::flat_builder_t;
+
+        flat_reply_t(std::size_t nodes, std::size_t bytes)
+            : arena_{new flat_node_t[nodes + (bytes + sizeof(flat_node_t) - 1) /
+                                                 sizeof(flat_node_t)]}
+            , nodes_{nodes}
+            , bytes_{bytes} {
+        }
+
+        /** Nodes followed by the room for the strings */
+        std::size_t slots() const {
+            return nodes_ + (bytes_ + sizeof(flat_node_t) - 1) / sizeof(flat_node_t);
+        }
+        flat_node_t *nodes() const {
+            return arena_.get();
+        }
+        char *strings() const {
+            return reinterpret_cast<char *>(arena_.get() + nodes_);
+        }
+
+        std::unique_ptr<flat_node_t[]> arena_;
+        std::size_t nodes_ = 0;
+        std::size_t bytes_ = 0;
+    };
+
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_FLAT_REPLY_HPP
@@ -17,7 +17,7 @@ namespace redis_async {
 #ifdef REDIS_ASYNC_WITH_BOOST_FIBERS
     template <typename _Res>
     using promise = ::boost::fibers::promise<_Res>;
-    using fiber = ::boost::fibers::fibert
+    using fiber = ::boost::fibers::fiber;
 #else
     template <typename TRes>
     using promise = ::std::promise<TRes>;
@@ -6,6 +6,9 @@
 #define REDIS_ASYNC_RD_TYPES_HPP
 
 #include <iostream>
+#include <memory>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -22,17 +25,97 @@ namespace redis_async {
 
     // forward declaration
     struct array_holder_t;
-    using result_t = std::variant<int_t, string_t, nil_t, array_holder_t>;
+    struct map_holder_t;
+    /** Double, boolean and map replies come with RESP3 only */
+    using result_t =
+        std::variant<int_t, string_t, nil_t, array_holder_t, double, bool, map_holder_t>;
 
     struct array_holder_t {
         using recursive_array_t = std::vector<result_t>;
         recursive_array_t elements;
-        friend std::ostream &operator<<(std::ostream &out, const redis_async::array_holder_t &ah) {
-            out << "{ARRAY_t}\n";
-            for (const auto &item : ah.elements)
-                std::visit([&out](const auto &v) { out << '\t' << v << '\n'; }, item);
-            return out;
+    };
+
+    /** RESP3 map, pairs are in the wire order */
+    struct map_holder_t {
+        using recursive_map_t = std::vector<std::pair<result_t, result_t>>;
+        recursive_map_t elements;
+    };
+
+    inline std::ostream &operator<<(std::ostream &out, const map_holder_t &mh);
+
+    inline std::ostream &operator<<(std::ostream &out, const array_holder_t &ah) {
+        out << "{ARRAY_t}\n";
+        for (const auto &item : ah.elements)
+            std::visit([&out](const auto &v) { out << '\t' << v << '\n'; }, item);
+        return out;
+    }
+
+    inline std::ostream &operator<<(std::ostream &out, const map_holder_t &mh) {
+        out << "{MAP_t}\n";
+        for (const auto &item : mh.elements) {
+            std::visit([&out](const auto &v) { out << '\t' << v; }, item.first);
+            std::visit([&out](const auto &v) { out << " => " << v << '\n'; }, item.second);
+        }
+        return out;
+    }
+
+    // forward declaration
+    struct view_array_t;
+    struct view_map_t;
+    /** Reply value whose strings refer to the receive buffer */
+    using view_t =
+        std::variant<int_t, std::string_view, nil_t, view_array_t, double, bool, view_map_t>;
+
+    struct view_array_t {
+        using recursive_array_t = std::vector<view_t>;
+        recursive_array_t elements;
+    };
+
+    struct view_map_t {
+        using recursive_map_t = std::vector<std::pair<view_t, view_t>>;
+        recursive_map_t elements;
+    };
+
+    inline std::ostream &operator<<(std::ostream &out, const view_map_t &mh);
+
+    inline std::ostream &operator<<(std::ostream &out, const view_array_t &ah) {
+        out << "{ARRAY_t}\n";
+        for (const auto &item : ah.elements)
+            std::visit([&out](const auto &v) { out << '\t' << v << '\n'; }, item);
+        return out;
+    }
+
+    inline std::ostream &operator<<(std::ostream &out, const view_map_t &mh) {
+        out << "{MAP_t}\n";
+        for (const auto &item : mh.elements) {
+            std::visit([&out](const auto &v) { out << '\t' << v; }, item.first);
+            std::visit([&out](const auto &v) { out << " => " << v << '\n'; }, item.second);
         }
+        return out;
+    }
+
+    /** Immutable chunk of the receive buffer */
+    using buffer_chunk_ptr = std::shared_ptr<const char[]>;
+
+    /**
+     * @brief Reply which does not copy strings out of the receive buffer.
+     * The string views stay valid as long as the reply (or a copy of its chunk) lives.
+     */
+    struct reply_view_t {
+        view_t value{};
+        buffer_chunk_ptr chunk{}; ///< Keeps the bytes `value` refers to alive
+    };
+
+    /**
+     * @brief Message of a subscribed channel.
+     * All handlers of the channel get the same message, the strings refer to
+     * the receive buffer as in reply_view_t.
+     */
+    struct pubsub_message_t {
+        std::string_view pattern; ///< Pattern the channel matched, empty if not by PSUBSCRIBE
+        std::string_view channel;
+        std::string_view payload;
+        buffer_chunk_ptr chunk; ///< Keeps the bytes of the strings alive
     };
 
 } // namespace redis_async
@@ -9,6 +9,10 @@
 #include <redis_async/command_options.hpp>
 #include <redis_async/commands.hpp>
 #include <redis_async/common.hpp>
+#include <redis_async/details/protocol/reply_decoder.hpp>
+
+#include <boost/asio/async_result.hpp>
+#include <exception>
 
 namespace redis_async {
 
@@ -36,18 +40,201 @@ namespace redis_async {
         static void add_connection(connection_options const &co,
                                    optional_size pool_size = optional_size());
 
+        /**
+         *    @brief Set the number of event loop threads run() starts.
+         *
+         *    Each thread owns a shard of every connection pool. Requests go to
+         *    the shard of the calling thread, if it is an event loop thread,
+         *    or to the shards in turn.
+         *    @throws redis_async::error::client_error if connections were added.
+         */
+        static void set_threads(size_t threads);
+
+        /** Run the event loops, blocks until stop() */
         static void run();
         static void stop();
 
         static asio_config::io_service_ptr io_service();
 
+        /**
+         *    @brief Execute a command.
+         *
+         *    @param timeout The request fails with error::timeout_error if it is
+         *             not complete in time. Zero means socket_timeout of the
+         *             connection string, no timeout if it is not set either.
+         *    @note A request which has waited in the queue of the pool past its
+         *          deadline is dropped without being sent.
+         *    @note If the request queue of the pool is full, see max_queue_size and
+         *          max_queue_bytes of the connection string, error callback gets
+         *          error::queue_full_error.
+         *    @note With client_cache_size in the connection string GET, HGET and
+         *          MGET may be answered from the client side cache.
+         */
         static void execute(rdalias &&alias, single_command_t &&cmd,
-                             query_result_callback &&result, error_callback &&error);
+                            query_result_callback &&result, error_callback &&error,
+                            std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+        /**
+         *    @brief Execute a command if the request queue of the pool has room.
+         *
+         *    @return false if the queue is full, the callbacks are not called then
+         *            and the caller should slow down.
+         */
+        static bool try_execute(rdalias &&alias, single_command_t &&cmd,
+                                query_result_callback &&result, error_callback &&error,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+        /** @brief Execute a command decoding the reply into T, if the queue has room */
+        template <typename T>
+        static bool try_execute(rdalias &&alias, single_command_t &&cmd,
+                                typed_result_callback<T> &&result, error_callback &&error,
+                                std::chrono::milliseconds timeout = std::chrono::milliseconds{0}) {
+            return execute_decoded(std::move(alias), std::move(cmd),
+                                   std::make_shared<details::reply_decoder_t<T>>(std::move(result)),
+                                   std::move(error), timeout, details::admission::try_once);
+        }
+
+        /** @brief Requests of the alias submitted and not answered yet */
+        static size_t queue_depth(rdalias const &alias);
+        /** @brief Serialized size of these requests */
+        static size_t queue_bytes(rdalias const &alias);
+        /** @brief Counters of the client side cache of the alias */
+        static cache_stats_t cache_stats(rdalias const &alias);
+
+        /**
+         *    @brief Execute a command, getting the reply without copying its strings.
+         *
+         *    Strings of the reply refer to the receive buffer of the connection,
+         *    which is kept alive while the reply_view_t is.
+         */
+        static void execute_view(rdalias &&alias, single_command_t &&cmd,
+                                 reply_view_callback &&result, error_callback &&error,
+                                 std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+        /**
+         *    @brief Execute a command, getting the reply as a flat_reply_t.
+         *
+         *    All nodes and strings of the reply live in one allocation, arrays
+         *    are walked with reply_cursor_t.
+         */
+        static void execute_flat(rdalias &&alias, single_command_t &&cmd,
+                                 flat_reply_callback &&result, error_callback &&error,
+                                 std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+        /**
+         *    @brief Execute a command, decoding the reply into T while it is parsed.
+         *
+         *    Supported are arithmetic types, std::string, std::optional (nil),
+         *    std::vector, std::map and std::unordered_map (from an array of keys
+         *    and values), std::pair, std::tuple and types with reply_traits.
+         *    @code{.cpp}
+         *    rd_service::execute<std::unordered_map<std::string, std::string>>(
+         *        "main"_rd, cmd::hgetall("key"), [](auto fields) {}, error_handler);
+         *    @endcode
+         *    @note If the reply does not fit T, error callback gets error::client_error.
+         */
+        template <typename T>
+        static void execute(rdalias &&alias, single_command_t &&cmd,
+                            typed_result_callback<T> &&result, error_callback &&error,
+                            std::chrono::milliseconds timeout = std::chrono::milliseconds{0}) {
+            execute_decoded(std::move(alias), std::move(cmd),
+                            std::make_shared<details::reply_decoder_t<T>>(std::move(result)),
+                            std::move(error), timeout, details::admission::reject);
+        }
+
+        /**
+         *    @brief Execute a command as an asynchronous operation of Asio.
+         *
+         *    The reply is decoded into T, as by execute<T>. The completion
+         *    signature is void(std::exception_ptr, T), so any completion
+         *    token works: a callback, boost::asio::use_future or
+         *    boost::asio::use_awaitable.
+         *    @code{.cpp}
+         *    auto value = co_await rd_service::async_execute<std::string>(
+         *        "main"_rd, cmd::get("key"), boost::asio::use_awaitable);
+         *    @endcode
+         *    @note The handler is called from the thread of the connection through
+         *          its associated executor, without a hop through the strand.
+         *    @note If the request queue of the pool is full, the operation waits
+         *          in the pool until there is room for it.
+         */
+        template <typename T, typename CompletionToken>
+        static auto async_execute(rdalias alias, single_command_t cmd, CompletionToken &&token) {
+            return async_execute<T>(std::move(alias), std::move(cmd), std::chrono::milliseconds{0},
+                                    std::forward<CompletionToken>(token));
+        }
+
+        /**
+         *    @brief Execute a command as an asynchronous operation of Asio,
+         *    completing with error::timeout_error if the reply does not come in time.
+         */
+        template <typename T, typename CompletionToken>
+        static auto async_execute(rdalias alias, single_command_t cmd,
+                                  std::chrono::milliseconds timeout, CompletionToken &&token) {
+            return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, T)>(
+                [timeout](auto &&handler, rdalias &&alias, single_command_t &&cmd) {
+                    using handler_type = std::decay_t<decltype(handler)>;
+                    auto decoder = std::make_shared<details::async_reply_decoder_t<T, handler_type>>(
+                        std::move(handler));
+                    // Shares the lifetime of the request with the decoder,
+                    // small enough not to be allocated by std::function
+                    auto target = decoder.get();
+                    execute_decoded(std::move(alias), std::move(cmd), std::move(decoder),
+                                    [target](error::rd_error const &e) { target->fail(e); },
+                                    timeout, details::admission::wait);
+                },
+                token, std::move(alias), std::move(cmd));
+        }
+
+        /**
+         *    @brief Execute a batch of commands.
+         *
+         *    All commands are written to the connection at once, the results are
+         *    delivered to the single callback when the last reply arrives.
+         *    @throws redis_async::error::client_error if the batch is empty.
+         *    @note A command failing on the server does not fail the batch, its
+         *          reply carries the error. Error callback is called only if no
+         *          replies come, on a connection failure or a timeout.
+         */
+        static void execute(rdalias &&alias, command_container_t &&cmds,
+                            batch_result_callback &&result, error_callback &&error,
+                            std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+        /**
+         *    @brief Subscribe to a channel.
+         *
+         *    Subscriptions of an alias share a connection of their own. A
+         *    channel is subscribed on the server once, for its first handler,
+         *    and unsubscribed with its last one. All handlers of the channel get
+         *    the same message, its strings refer to the receive buffer.
+         *    @return Id to unsubscribe the handler with
+         *    @note Handlers are called from the event loop thread and must not
+         *          block. They are subscribed again after a reconnect.
+         *    @note If the server rejects the subscription, error callback gets
+         *          the error and the handler is removed.
+         */
+        static subscription_id subscribe(rdalias &&alias, std::string channel,
+                                         message_callback &&handler, error_callback &&error);
+        /** @brief Subscribe to the channels matching the pattern, see subscribe */
+        static subscription_id psubscribe(rdalias &&alias, std::string pattern,
+                                          message_callback &&handler, error_callback &&error);
+        /**
+         * @brief Subscribe to a shard channel, see subscribe
+         * @throw error::client_error for a cluster alias, its subscriptions go to one node
+         */
+        static subscription_id ssubscribe(rdalias &&alias, std::string channel,
+                                          message_callback &&handler, error_callback &&error);
+        /** @brief Remove the handler, it may still get the messages already received */
+        static void unsubscribe(rdalias &&alias, subscription_id id);
 
     private:
         // No instances
         rd_service() = default;
 
+        static bool execute_decoded(rdalias &&alias, single_command_t &&cmd,
+                                    reply_decoder_ptr &&decoder, error_callback &&error,
+                                    std::chrono::milliseconds timeout, details::admission adm);
+
         using pimpl = std::shared_ptr<details::redis_impl>;
         static pimpl &impl_ptr();
         static pimpl impl(size_t pool_size = DEFAULT_POOL_SIZE);
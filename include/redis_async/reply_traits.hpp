@@ -0,0 +1,42 @@
+//
+// Created by niko on 17.09.2021.
+//
+
+#ifndef REDIS_ASYNC_REPLY_TRAITS_HPP
+#define REDIS_ASYNC_REPLY_TRAITS_HPP
+
+#include <tuple>
+#include <utility>
+
+namespace redis_async {
+
+    /**
+     * @brief Customization point to decode replies into user types.
+     *
+     * The reply is decoded into `wire_type` first, which may be any type
+     * rd_service::execute<T> supports, then converted.
+     * @code{.cpp}
+     * template <>
+     * struct redis_async::reply_traits<point> {
+     *     using wire_type = std::tuple<double, double>;
+     *     static point convert(wire_type &&v) {
+     *         return {std::get<0>(v), std::get<1>(v)};
+     *     }
+     * };
+     * @endcode
+     */
+    template <typename T, typename Enable = void>
+    struct reply_traits {};
+
+    /** A pair is decoded from an array of two elements */
+    template <typename First, typename Second>
+    struct reply_traits<std::pair<First, Second>> {
+        using wire_type = std::tuple<First, Second>;
+        static std::pair<First, Second> convert(wire_type &&v) {
+            return {std::move(std::get<0>(v)), std::move(std::get<1>(v))};
+        }
+    };
+
+} // namespace redis_async
+
+#endif // REDIS_ASYNC_REPLY_TRAITS_HPP
@@ -5,7 +5,35 @@
 #include <redis_async/commands.hpp>
 #include <redis_async/details/protocol/command_args.hpp>
 
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+#include <iterator>
+
 namespace redis_async {
+
+    bool is_idempotent(const single_command_t &cmd) {
+        // Commands that do not change the data
+        static constexpr std::string_view read_only[] = {
+            "DBSIZE", "ECHO",     "EXISTS",   "GET",        "GETRANGE", "HEXISTS", "HGET",
+            "HGETALL", "HKEYS",   "HLEN",     "HMGET",      "HSTRLEN",  "HVALS",   "KEYS",
+            "LINDEX", "LLEN",     "LRANGE",   "MGET",       "PING",     "PTTL",    "SCARD",
+            "SISMEMBER", "SMEMBERS", "SMISMEMBER", "STRLEN", "TTL",     "TYPE",    "ZCARD",
+            "ZRANGE", "ZSCORE"};
+        if (cmd.arguments.empty())
+            return false;
+        auto name = cmd.arguments[0];
+        return std::any_of(std::begin(read_only), std::end(read_only),
+                           [name](std::string_view c) { return boost::iequals(c, name); });
+    }
+
+    bool is_idempotent(const command_wrapper_t &cmd) {
+        if (auto *single = std::get_if<single_command_t>(&cmd))
+            return is_idempotent(*single);
+        auto &batch = std::get<command_container_t>(cmd);
+        return std::all_of(batch.begin(), batch.end(),
+                           [](const single_command_t &c) { return is_idempotent(c); });
+    }
     namespace cmd {
 
         using details::CmdArgs;
@@ -155,6 +183,10 @@ namespace redis_async {
             return {"HGET", key, field};
         }
 
+        single_command_t hgetall(std::string_view key) {
+            return {"HGETALL", key};
+        }
+
         single_command_t hkeys(std::string_view key) {
             return {"HKEYS", key};
         }
@@ -312,5 +344,13 @@ namespace redis_async {
             return std::move(args.cmd());
         }
 
+        single_command_t publish(std::string_view channel, std::string_view message) {
+            return {"PUBLISH", channel, message};
+        }
+
+        single_command_t spublish(std::string_view channel, std::string_view message) {
+            return {"SPUBLISH", channel, message};
+        }
+
     } // namespace cmd
 } // namespace redis_async
\ No newline at end of file
@@ -28,6 +28,19 @@ namespace redis_async {
             set_auth_opts(auth, opts);
             auto parameter_string = split_path(path, opts);
             parse_parameters(parameter_string, opts);
+            // A cluster has the only database, its nodes are found by the address
+            if (opts.cluster) {
+                if (opts.schema != "tcp")
+                    throw error::connection_error("cluster requires tcp connection");
+                if (!opts.database.empty() && opts.database != "0")
+                    throw error::connection_error("cluster has no database " + opts.database);
+            }
+            // Invalidation messages come as push frames of RESP3
+            if (opts.client_cache_size) {
+                if (opts.protocol == 2)
+                    throw error::connection_error("client cache requires protocol 3");
+                opts.protocol = 3;
+            }
 
             return opts;
         }
@@ -41,6 +54,7 @@ namespace redis_async {
                                connection_options &opts);
         static std::chrono::milliseconds _parse_timeout_option(const std::string &str);
         static bool parse_bool_option(const std::string &str);
+        static std::size_t parse_size_option(const std::string &str);
     };
 
     auto connect_string_parser::split_uri(const std::string &uri, connection_options &opts)
@@ -80,7 +94,14 @@ namespace redis_async {
             // No auth info.
             return;
         }
-        opts.password = auth;
+        // user:password, or the password alone
+        auto pos = auth.find(':');
+        if (pos == std::string::npos) {
+            opts.password = auth;
+            return;
+        }
+        opts.user = auth.substr(0, pos);
+        opts.password = auth.substr(pos + 1);
     }
     auto connect_string_parser::split_path(const std::string &path, connection_options &opts)
         -> std::string {
@@ -94,8 +115,11 @@ namespace redis_async {
         if (pos != std::string::npos) {
             // Might specified a db number.
             try {
-                auto db = path.substr(pos + 1);
-                std::stoi(db);
+                auto db = path.substr(pos + 1, parameter_pos - pos - 1);
+                std::size_t parsed = 0;
+                std::stoi(db, &parsed);
+                if (parsed != db.size())
+                    throw std::invalid_argument(db);
                 opts.database = std::move(db);
                 opts.uri = path.substr(0, pos);
             } catch (const std::exception &) {
@@ -137,10 +161,54 @@ namespace redis_async {
                                            connection_options &opts) {
         if (key == "keep_alive") {
             opts.keep_alive = parse_bool_option(val);
+        } else if (key == "keep_alive_idle") {
+            opts.keep_alive_idle = _parse_timeout_option(val);
+        } else if (key == "keep_alive_interval") {
+            opts.keep_alive_interval = _parse_timeout_option(val);
+        } else if (key == "keep_alive_count") {
+            opts.keep_alive_count = parse_size_option(val);
+        } else if (key == "tcp_nodelay") {
+            opts.tcp_nodelay = parse_bool_option(val);
+        } else if (key == "recv_buffer_size") {
+            opts.recv_buffer_size = parse_size_option(val);
+        } else if (key == "send_buffer_size") {
+            opts.send_buffer_size = parse_size_option(val);
+        } else if (key == "quick_ack") {
+            opts.quick_ack = parse_bool_option(val);
         } else if (key == "connect_timeout") {
             opts.connect_timeout = _parse_timeout_option(val);
         } else if (key == "socket_timeout") {
             opts.socket_timeout = _parse_timeout_option(val);
+        } else if (key == "inline_completion") {
+            opts.inline_completion = parse_bool_option(val);
+        } else if (key == "max_connections") {
+            opts.max_connections = parse_size_option(val);
+        } else if (key == "min_idle") {
+            opts.min_idle = parse_size_option(val);
+        } else if (key == "idle_timeout") {
+            opts.idle_timeout = _parse_timeout_option(val);
+        } else if (key == "max_flush_size") {
+            opts.max_flush_size = parse_size_option(val);
+        } else if (key == "max_queue_size") {
+            opts.max_queue_size = parse_size_option(val);
+        } else if (key == "max_queue_bytes") {
+            opts.max_queue_bytes = parse_size_option(val);
+        } else if (key == "reconnect_delay") {
+            opts.reconnect_delay = _parse_timeout_option(val);
+        } else if (key == "max_reconnect_delay") {
+            opts.max_reconnect_delay = _parse_timeout_option(val);
+        } else if (key == "replay_requests") {
+            opts.replay_requests = parse_bool_option(val);
+        } else if (key == "cluster") {
+            opts.cluster = parse_bool_option(val);
+        } else if (key == "client_cache_size") {
+            opts.client_cache_size = parse_size_option(val);
+        } else if (key == "client_name") {
+            opts.client_name = val;
+        } else if (key == "protocol") {
+            if (val != "2" && val != "3")
+                throw error::connection_error("unsupported protocol version: " + val);
+            opts.protocol = std::stoi(val);
         } else {
             throw error::connection_error("unknown uri parameter " + key);
         }
@@ -174,6 +242,26 @@ namespace redis_async {
         }
         throw error::connection_error("invalid uri parameter of bool type: " + str);
     }
+    std::size_t connect_string_parser::parse_size_option(const std::string &str) {
+        std::size_t size = 0;
+        std::string unit;
+        try {
+            std::size_t pos = 0;
+            size = std::stoul(str, &pos);
+            unit = str.substr(pos);
+        } catch (const std::exception &e) {
+            throw error::connection_error("invalid uri parameter of size type: " + str);
+        }
+        if (unit.empty()) {
+            return size;
+        } else if (unit == "k") {
+            return size * 1024;
+        } else if (unit == "m") {
+            return size * 1024 * 1024;
+        } else {
+            throw error::connection_error("unknown size unit: " + unit);
+        }
+    }
 
     connection_options connection_options::parse(const std::string &uri) {
         return connect_string_parser()(uri);
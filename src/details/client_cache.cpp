@@ -0,0 +1,363 @@
+//
+// Created by niko on 08.10.2021.
+//
+
+#include <redis_async/details/client_cache.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace redis_async {
+    namespace details {
+
+        namespace {
+            /** Approximate memory taken by a key and by a field beside their bytes */
+            constexpr size_t entry_overhead = 96;
+            constexpr size_t field_overhead = 64;
+
+            enum class read_kind { none, get, hget, mget };
+
+            read_kind kind_of(const single_command_t &cmd) {
+                auto &args = cmd.arguments;
+                if (args.empty())
+                    return read_kind::none;
+                auto name = args[0];
+                if (args.size() == 2 && boost::iequals(name, "GET"))
+                    return read_kind::get;
+                if (args.size() == 3 && boost::iequals(name, "HGET"))
+                    return read_kind::hget;
+                if (args.size() >= 2 && boost::iequals(name, "MGET"))
+                    return read_kind::mget;
+                return read_kind::none;
+            }
+
+            size_t size_of(const result_t &value) {
+                auto *str = std::get_if<string_t>(&value);
+                return str ? str->size() : 0;
+            }
+
+            /** A value can be cached, errors and unexpected replies are not */
+            bool scalar(const result_t &value) {
+                return std::holds_alternative<string_t>(value) ||
+                       std::holds_alternative<nil_t>(value);
+            }
+        } // namespace
+
+        struct client_cache::impl {
+            /** Most recently used keys first, they point to the keys of the entries */
+            using lru_list = ::std::list<const ::std::string *>;
+            /** Connections the server tracks a key for */
+            using readers_t = ::std::vector<const void *>;
+
+            struct entry_t {
+                ::std::optional<result_t> value; ///< Reply to GET
+                ::std::map<::std::string, result_t, ::std::less<>> fields; ///< Replies to HGET
+                size_t bytes;
+                lru_list::iterator lru;
+                readers_t readers;
+            };
+            using entries_map = ::std::map<::std::string, entry_t, ::std::less<>>;
+
+            /** Keys of the requests sent to fill the cache */
+            struct pending_t {
+                size_t fills = 0;
+                bool invalidated = false; ///< Changed after a request was sent, its reply is stale
+                readers_t readers;
+            };
+            using pending_map = ::std::map<::std::string, pending_t, ::std::less<>>;
+
+            mutable ::std::mutex mutex_;
+            size_t max_bytes_;
+            size_t bytes_;
+            entries_map entries_;
+            lru_list lru_;
+            pending_map pending_;
+            cache_stats_t stats_;
+
+            explicit impl(size_t max_bytes)
+                : max_bytes_(max_bytes)
+                , bytes_(0) {
+            }
+
+            entry_t *find(std::string_view key) {
+                auto found = entries_.find(key);
+                if (found == entries_.end())
+                    return nullptr;
+                lru_.splice(lru_.begin(), lru_, found->second.lru);
+                return &found->second;
+            }
+
+            bool lookup(const single_command_t &cmd, result_t &value) {
+                auto &args = cmd.arguments;
+                ::std::lock_guard<::std::mutex> lock(mutex_);
+                switch (kind_of(cmd)) {
+                case read_kind::get:
+                    if (auto *entry = find(args[1]); entry && entry->value) {
+                        value = *entry->value;
+                        return hit();
+                    }
+                    break;
+                case read_kind::hget:
+                    if (auto *entry = find(args[1])) {
+                        auto field = entry->fields.find(args[2]);
+                        if (field != entry->fields.end()) {
+                            value = field->second;
+                            return hit();
+                        }
+                    }
+                    break;
+                case read_kind::mget: {
+                    array_holder_t values;
+                    values.elements.reserve(args.size() - 1);
+                    for (size_t i = 1; i < args.size(); ++i) {
+                        auto *entry = find(args[i]);
+                        if (!entry || !entry->value)
+                            return miss();
+                        values.elements.push_back(*entry->value);
+                    }
+                    value = ::std::move(values);
+                    return hit();
+                }
+                case read_kind::none:
+                    break;
+                }
+                return miss();
+            }
+
+            bool hit() {
+                ++stats_.hits;
+                return true;
+            }
+            bool miss() {
+                ++stats_.misses;
+                return false;
+            }
+
+            void start_fill(const single_command_t &cmd) {
+                auto &args = cmd.arguments;
+                ::std::lock_guard<::std::mutex> lock(mutex_);
+                auto last = kind_of(cmd) == read_kind::mget ? args.size() : 2;
+                for (size_t i = 1; i < last; ++i) {
+                    auto found = pending_.find(args[i]);
+                    if (found == pending_.end())
+                        found = pending_.emplace(::std::string{args[i]}, pending_t{}).first;
+                    ++found->second.fills;
+                }
+            }
+
+            void complete_fill(const single_command_t &cmd, const result_t *value) {
+                auto &args = cmd.arguments;
+                auto kind = kind_of(cmd);
+                ::std::lock_guard<::std::mutex> lock(mutex_);
+                auto *values = value ? ::std::get_if<array_holder_t>(value) : nullptr;
+                if (kind == read_kind::mget && values && values->elements.size() != args.size() - 1)
+                    values = nullptr;
+                auto last = kind == read_kind::mget ? args.size() : 2;
+                for (size_t i = 1; i < last; ++i) {
+                    auto found = pending_.find(args[i]);
+                    if (found == pending_.end())
+                        continue;
+                    bool fresh = !found->second.invalidated;
+                    auto readers = found->second.readers;
+                    if (!--found->second.fills)
+                        pending_.erase(found);
+                    if (!fresh || !value)
+                        continue;
+                    if (kind == read_kind::get && scalar(*value))
+                        add_readers(store(args[1], *value), readers);
+                    else if (kind == read_kind::hget && scalar(*value))
+                        add_readers(store(args[1], args[2], *value), readers);
+                    else if (values && scalar(values->elements[i - 1]))
+                        add_readers(store(args[i], values->elements[i - 1]), readers);
+                }
+                evict();
+            }
+
+            void sent(const single_command_t &cmd, const void *reader) {
+                auto &args = cmd.arguments;
+                auto last = kind_of(cmd) == read_kind::mget ? args.size() : 2;
+                ::std::lock_guard<::std::mutex> lock(mutex_);
+                for (size_t i = 1; i < last; ++i) {
+                    auto found = pending_.find(args[i]);
+                    if (found != pending_.end())
+                        add_reader(found->second.readers, reader);
+                }
+            }
+
+            static void add_reader(readers_t &readers, const void *reader) {
+                if (::std::find(readers.begin(), readers.end(), reader) == readers.end())
+                    readers.push_back(reader);
+            }
+            static void add_readers(entry_t &entry, const readers_t &readers) {
+                for (auto *reader : readers)
+                    add_reader(entry.readers, reader);
+            }
+            static bool read_by(const readers_t &readers, const void *reader) {
+                return ::std::find(readers.begin(), readers.end(), reader) != readers.end();
+            }
+
+            /** Cache the reply to GET */
+            entry_t &store(std::string_view key, const result_t &value) {
+                auto &entry = entry_of(key);
+                bytes_ -= entry.bytes;
+                if (entry.value)
+                    entry.bytes -= size_of(*entry.value);
+                entry.value = value;
+                entry.bytes += size_of(value);
+                bytes_ += entry.bytes;
+                return entry;
+            }
+
+            /** Cache the reply to HGET */
+            entry_t &store(std::string_view key, std::string_view field, const result_t &value) {
+                auto &entry = entry_of(key);
+                bytes_ -= entry.bytes;
+                auto cached = entry.fields.find(field);
+                if (cached == entry.fields.end()) {
+                    cached = entry.fields.emplace(::std::string{field}, nil_t{}).first;
+                    entry.bytes += field.size() + field_overhead;
+                }
+                entry.bytes -= size_of(cached->second);
+                cached->second = value;
+                entry.bytes += size_of(value);
+                bytes_ += entry.bytes;
+                return entry;
+            }
+
+            entry_t &entry_of(std::string_view key) {
+                auto found = entries_.find(key);
+                if (found != entries_.end()) {
+                    lru_.splice(lru_.begin(), lru_, found->second.lru);
+                    return found->second;
+                }
+                found = entries_.emplace(::std::string{key}, entry_t{}).first;
+                lru_.push_front(&found->first);
+                found->second.lru = lru_.begin();
+                found->second.bytes = key.size() + entry_overhead;
+                bytes_ += found->second.bytes;
+                return found->second;
+            }
+
+            void evict() {
+                while (bytes_ > max_bytes_ && !lru_.empty()) {
+                    auto found = entries_.find(*lru_.back());
+                    erase(found);
+                    ++stats_.evictions;
+                }
+            }
+
+            void erase(entries_map::iterator found) {
+                bytes_ -= found->second.bytes;
+                lru_.erase(found->second.lru);
+                entries_.erase(found);
+            }
+
+            void invalidate(std::string_view key) {
+                auto found = entries_.find(key);
+                if (found != entries_.end()) {
+                    erase(found);
+                    ++stats_.invalidations;
+                }
+                auto pending = pending_.find(key);
+                if (pending != pending_.end())
+                    pending->second.invalidated = true;
+            }
+
+            void invalidate_all() {
+                stats_.invalidations += entries_.size();
+                entries_.clear();
+                lru_.clear();
+                bytes_ = 0;
+                for (auto &pending : pending_)
+                    pending.second.invalidated = true;
+            }
+
+            void forget_reader(const void *reader) {
+                for (auto found = entries_.begin(); found != entries_.end();) {
+                    auto next = ::std::next(found);
+                    if (read_by(found->second.readers, reader)) {
+                        erase(found);
+                        ++stats_.invalidations;
+                    }
+                    found = next;
+                }
+                for (auto &pending : pending_) {
+                    if (read_by(pending.second.readers, reader))
+                        pending.second.invalidated = true;
+                }
+            }
+        };
+
+        client_cache::client_cache(size_t max_bytes)
+            : pimpl_(new impl(max_bytes)) {
+        }
+
+        client_cache::~client_cache() = default;
+
+        bool client_cache::cacheable(const single_command_t &cmd) {
+            return kind_of(cmd) != read_kind::none;
+        }
+
+        bool client_cache::lookup(const single_command_t &cmd, result_t &value) {
+            return pimpl_->lookup(cmd, value);
+        }
+
+        client_cache::fill_ptr client_cache::start_fill(const single_command_t &cmd) {
+            pimpl_->start_fill(cmd);
+            auto fill = std::make_shared<fill_t>();
+            fill->command = cmd;
+            return fill;
+        }
+
+        void client_cache::complete_fill(const fill_ptr &fill, const result_t *value) {
+            if (fill->done.exchange(true))
+                return;
+            pimpl_->complete_fill(fill->command, value);
+        }
+
+        void client_cache::on_push(const reply_view_t &reply) {
+            // ["invalidate", [key, ...]] or ["invalidate", nil] when the database is flushed
+            auto *frame = std::get_if<view_array_t>(&reply.value);
+            if (!frame || frame->elements.size() != 2)
+                return;
+            auto *type = std::get_if<std::string_view>(&frame->elements[0]);
+            if (!type || *type != "invalidate")
+                return;
+            std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+            auto *keys = std::get_if<view_array_t>(&frame->elements[1]);
+            if (!keys) {
+                pimpl_->invalidate_all();
+                return;
+            }
+            for (auto &key : keys->elements) {
+                if (auto *str = std::get_if<std::string_view>(&key))
+                    pimpl_->invalidate(*str);
+            }
+        }
+
+        void client_cache::sent(const single_command_t &cmd, const void *reader) {
+            if (cacheable(cmd))
+                pimpl_->sent(cmd, reader);
+        }
+
+        void client_cache::forget_reader(const void *reader) {
+            std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+            pimpl_->forget_reader(reader);
+        }
+
+        cache_stats_t client_cache::stats() const {
+            std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+            auto stats = pimpl_->stats_;
+            stats.entries = pimpl_->entries_.size();
+            stats.bytes = pimpl_->bytes_;
+            return stats;
+        }
+
+    } // namespace details
+} // namespace redis_async
@@ -0,0 +1,592 @@
+//
+// Created by niko on 11.10.2021.
+//
+
+#include <redis_async/details/cluster.hpp>
+#include <redis_async/details/connection/base_connection.hpp>
+#include <redis_async/details/connection/connection_pool.hpp>
+#include <redis_async/details/protocol/reply_decoder.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+namespace redis_async {
+    namespace details {
+
+        namespace {
+            constexpr size_t no_node = std::numeric_limits<size_t>::max();
+            /** A request redirected more times fails with the last redirection */
+            constexpr size_t max_redirects = 5;
+
+            /** CRC16-CCITT (XMODEM) table, the one the cluster hashes keys with */
+            constexpr std::array<std::uint16_t, 256> make_crc16_table() {
+                std::array<std::uint16_t, 256> table{};
+                for (unsigned i = 0; i < 256; ++i) {
+                    std::uint16_t crc = i << 8;
+                    for (int bit = 0; bit < 8; ++bit)
+                        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+                    table[i] = crc;
+                }
+                return table;
+            }
+            constexpr auto crc16_table = make_crc16_table();
+
+            std::uint16_t crc16(std::string_view data) {
+                std::uint16_t crc = 0;
+                for (unsigned char c : data)
+                    crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ c) & 0xff];
+                return crc;
+            }
+
+            bool is_one_of(std::string_view name, std::initializer_list<std::string_view> names) {
+                return std::any_of(names.begin(), names.end(),
+                                   [name](std::string_view n) { return boost::iequals(n, name); });
+            }
+
+            /** Redirection of a request to another node */
+            struct redirect_t {
+                bool moved; ///< The slot has moved for good, ASK redirects this request only
+                size_t slot;
+                std::string address;
+            };
+
+            /** Parse "MOVED 3999 127.0.0.1:6381" or "ASK 3999 127.0.0.1:6381" */
+            bool parse_redirect(std::string_view msg, redirect_t &to) {
+                auto space = msg.find(' ');
+                if (space == std::string_view::npos)
+                    return false;
+                auto kind = msg.substr(0, space);
+                if (kind != "MOVED" && kind != "ASK")
+                    return false;
+                to.moved = kind == "MOVED";
+                msg.remove_prefix(space + 1);
+                auto parsed = std::from_chars(msg.data(), msg.data() + msg.size(), to.slot);
+                if (parsed.ec != std::errc{} || to.slot >= cluster_slots || *parsed.ptr != ' ')
+                    return false;
+                msg.remove_prefix(parsed.ptr - msg.data() + 1);
+                to.address = std::string{msg};
+                return !to.address.empty();
+            }
+
+            /** How the replies of the parts of a split command make its reply */
+            enum class merge_kind {
+                none,   ///< Not split
+                values, ///< MGET, values in the order of the keys
+                sum     ///< DEL, EXISTS and UNLINK, a sum of the counts
+            };
+
+            merge_kind merge_of(const single_command_t &cmd) {
+                if (cmd.arguments.size() < 3)
+                    return merge_kind::none;
+                std::string_view name = cmd.arguments[0];
+                if (boost::iequals(name, "MGET"))
+                    return merge_kind::values;
+                if (is_one_of(name, {"DEL", "EXISTS", "UNLINK"}))
+                    return merge_kind::sum;
+                return merge_kind::none;
+            }
+
+            /** Host of a host:port address */
+            std::string host_of(std::string const &address) {
+                return address.substr(0, address.rfind(':'));
+            }
+        } // namespace
+
+        std::uint16_t key_slot(std::string_view key) {
+            auto open = key.find('{');
+            if (open != std::string_view::npos) {
+                auto close = key.find('}', open + 1);
+                if (close != std::string_view::npos && close != open + 1)
+                    key = key.substr(open + 1, close - open - 1);
+            }
+            return crc16(key) & (cluster_slots - 1);
+        }
+
+        std::optional<std::string_view> command_key(const single_command_t &cmd) {
+            auto &args = cmd.arguments;
+            if (args.size() < 2)
+                return {};
+            std::string_view name = args[0];
+            if (is_one_of(name, {"PING", "ECHO", "INFO", "DBSIZE", "KEYS", "SCAN", "RANDOMKEY",
+                                 "FLUSHDB", "FLUSHALL", "CLUSTER", "CONFIG", "CLIENT", "COMMAND",
+                                 "SCRIPT", "FUNCTION", "SELECT", "TIME", "WAIT", "PUBLISH"}))
+                return {};
+            // The key follows a subcommand or an operation
+            if (is_one_of(name, {"BITOP", "OBJECT", "MEMORY", "XINFO"}))
+                return args.size() > 2 ? std::optional<std::string_view>{args[2]} : std::nullopt;
+            // The keys follow their number
+            if (is_one_of(name,
+                          {"EVAL", "EVALSHA", "EVAL_RO", "EVALSHA_RO", "FCALL", "FCALL_RO"})) {
+                if (args.size() < 4 || args[2] == "0")
+                    return {};
+                return std::string_view{args[3]};
+            }
+            if (is_one_of(name, {"XREAD", "XREADGROUP"})) {
+                auto streams = std::find_if(args.begin(), args.end(), [](std::string_view arg) {
+                    return boost::iequals(arg, "STREAMS");
+                });
+                if (streams == args.end() || std::next(streams) == args.end())
+                    return {};
+                return std::string_view{*std::next(streams)};
+            }
+            return std::string_view{args[1]};
+        }
+
+        std::vector<key_group_t> split_by_slot(const single_command_t &cmd) {
+            std::vector<key_group_t> groups;
+            if (merge_of(cmd) == merge_kind::none)
+                return groups;
+            auto &args = cmd.arguments;
+            std::map<std::uint16_t, size_t> group_of;
+            for (size_t i = 1; i < args.size(); ++i) {
+                auto found = group_of.emplace(key_slot(args[i]), groups.size());
+                if (found.second)
+                    groups.push_back({single_command_t{args[0]}, {}});
+                auto &group = groups[found.first->second];
+                group.command.arguments.push_back(args[i]);
+                group.positions.push_back(i - 1);
+            }
+            return groups;
+        }
+
+        struct cluster::impl {
+            struct node_t {
+                std::string address; ///< host:port
+                shard_pools pools;
+            };
+
+            using clock_type = std::chrono::steady_clock;
+
+            /** A request kept to be sent again to another node */
+            template <typename Callback>
+            struct request_t {
+                command_wrapper_t command;
+                Callback callback;
+                error_callback error;
+                clock_type::time_point deadline; ///< None if the request has no timeout
+                admission adm;
+                size_t shard;
+                size_t redirects;
+            };
+            template <typename Callback>
+            using request_ptr = std::shared_ptr<request_t<Callback>>;
+
+            connection_options co_;
+            pools_factory factory_;
+            mutable std::mutex mutex_;
+            /** Nodes are never removed, a node leaving the cluster serves no slots */
+            std::vector<node_t> nodes_;
+            /** Node of every slot, no_node until the slot table is read */
+            std::vector<size_t> slots_;
+            bool closed_;
+            std::atomic_bool refreshing_;
+
+            impl(connection_options const &co, pools_factory &&factory)
+                : co_(co)
+                , factory_(std::move(factory))
+                , slots_(cluster_slots, no_node)
+                , closed_(false)
+                , refreshing_(false) {
+                auto seed = co_.uri.find(':') == std::string::npos ? co_.uri + ":6379" : co_.uri;
+                nodes_.push_back({seed, factory_(co_)});
+            }
+
+            rdalias const &alias() const {
+                return co_.alias;
+            }
+
+            //@{
+            /** @name Nodes, called with the mutex locked */
+            size_t node_of(std::string const &address) {
+                auto found = std::find_if(nodes_.begin(), nodes_.end(),
+                                          [&](const node_t &n) { return n.address == address; });
+                if (found != nodes_.end())
+                    return found - nodes_.begin();
+                if (closed_)
+                    return no_node;
+                LOG4CXX_INFO(logger_def, "Cluster " << alias() << " node " << address);
+                auto node_co = co_;
+                node_co.uri = address;
+                nodes_.push_back({address, factory_(node_co)});
+                return nodes_.size() - 1;
+            }
+            connection_pool_ptr pool_of(size_t node, size_t shard) const {
+                auto &pools = nodes_[node].pools;
+                return pools[shard % pools.size()];
+            }
+            /** Node of the slot of the command, the first node if it is not known */
+            size_t route(const command_wrapper_t &cmd) const {
+                std::optional<std::string_view> key;
+                if (auto *single = std::get_if<single_command_t>(&cmd)) {
+                    key = command_key(*single);
+                } else {
+                    for (auto &c : std::get<command_container_t>(cmd))
+                        if ((key = command_key(c)))
+                            break;
+                }
+                auto node = key ? slots_[key_slot(*key)] : no_node;
+                return node == no_node ? 0 : node;
+            }
+            //@}
+
+            //@{
+            /** @name Requests */
+            /** The timeout runs from here, through all the redirects */
+            template <typename Callback>
+            request_ptr<Callback> request(size_t shard, command_wrapper_t &&cmd,
+                                          Callback &&callback, error_callback &&err,
+                                          std::chrono::milliseconds timeout, admission adm) const {
+                if (timeout.count() == 0)
+                    timeout = co_.socket_timeout;
+                clock_type::time_point deadline{};
+                if (timeout.count())
+                    deadline = clock_type::now() + timeout;
+                return std::make_shared<request_t<Callback>>(request_t<Callback>{
+                    std::move(cmd), std::move(callback), std::move(err), deadline, adm, shard, 0});
+            }
+
+            /** Replies of the parts of a split command, merged once all are there */
+            template <typename Callback>
+            struct gather_t {
+                gather_t(request_ptr<Callback> req, merge_kind kind, size_t keys, size_t parts)
+                    : req(std::move(req))
+                    , kind(kind)
+                    , values(kind == merge_kind::values ? keys : 0)
+                    , sum(0)
+                    , left(parts)
+                    , failed(false) {
+                }
+
+                void add(const std::vector<size_t> &positions, result_t &&res) {
+                    if (kind == merge_kind::values) {
+                        auto *part = std::get_if<array_holder_t>(&res);
+                        if (!part || part->elements.size() != positions.size())
+                            return fail(error::client_error("Unexpected reply to a split command"));
+                        for (size_t i = 0; i < positions.size(); ++i)
+                            values[positions[i]] = std::move(part->elements[i]);
+                    } else {
+                        auto *count = std::get_if<int_t>(&res);
+                        if (!count)
+                            return fail(error::client_error("Unexpected reply to a split command"));
+                        sum += *count;
+                    }
+                    if (--left == 0 && !failed)
+                        deliver(req->callback);
+                }
+                /** The first error fails the command, the other parts are ignored */
+                void fail(error::rd_error const &e) {
+                    if (!failed.exchange(true))
+                        impl::fail(req, e);
+                }
+
+                result_t merged() {
+                    if (kind == merge_kind::values)
+                        return array_holder_t{std::move(values)};
+                    return int_t{sum};
+                }
+                void deliver(const query_result_callback &result) {
+                    result(merged());
+                }
+                void deliver(const reply_decoder_ptr &decoder) {
+                    decode(*decoder, merged());
+                    if (decoder->completes_request())
+                        decoder->complete();
+                    else
+                        decoder->deliver();
+                }
+
+                request_ptr<Callback> req;
+                merge_kind kind;
+                std::vector<result_t> values;
+                std::atomic<int_t> sum;
+                std::atomic<size_t> left;
+                std::atomic_bool failed;
+            };
+
+            template <typename Callback>
+            bool execute(const cluster_ptr &self, const request_ptr<Callback> &req) {
+                if constexpr (std::is_same<Callback, query_result_callback>::value ||
+                              std::is_same<Callback, reply_decoder_ptr>::value) {
+                    if (auto *single = std::get_if<single_command_t>(&req->command)) {
+                        auto groups = split_by_slot(*single);
+                        if (groups.size() > 1)
+                            return scatter(self, req, merge_of(*single), std::move(groups));
+                    }
+                }
+                connection_pool_ptr pool;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    pool = pool_of(route(req->command), req->shard);
+                }
+                return send(self, req, pool, false);
+            }
+
+            /**
+             * Send the parts of a split command as separate requests, all at
+             * once. Each of them is redirected on its own.
+             */
+            template <typename Callback>
+            bool scatter(const cluster_ptr &self, const request_ptr<Callback> &req,
+                         merge_kind kind, std::vector<key_group_t> &&groups) {
+                auto gather = std::make_shared<gather_t<Callback>>(
+                    req, kind, req_keys(req->command), groups.size());
+                for (size_t i = 0; i < groups.size(); ++i) {
+                    auto part = request(
+                        req->shard, std::move(groups[i].command),
+                        query_result_callback{
+                            [gather, positions = std::move(groups[i].positions)](result_t res) {
+                                gather->add(positions, std::move(res));
+                            }},
+                        [gather](error::rd_error const &e) { gather->fail(e); },
+                        std::chrono::milliseconds{0}, req->adm);
+                    part->deadline = req->deadline;
+                    if (execute(self, part))
+                        continue;
+                    // Nothing is sent yet, the caller is told the queue is full
+                    if (i == 0)
+                        return false;
+                    gather->fail(error::queue_full_error("Request queue is full"));
+                    break;
+                }
+                return true;
+            }
+
+            static size_t req_keys(const command_wrapper_t &cmd) {
+                return std::get<single_command_t>(cmd).arguments.size() - 1;
+            }
+
+            /**
+             * The command is copied, the request keeps it to be redirected. The
+             * pool gets the time left to the deadline of the request.
+             */
+            template <typename Callback>
+            static bool send(const cluster_ptr &self, const request_ptr<Callback> &req,
+                             const connection_pool_ptr &pool, bool asking) {
+                std::chrono::milliseconds timeout{0};
+                if (req->deadline != clock_type::time_point{}) {
+                    auto left = std::chrono::ceil<std::chrono::milliseconds>(req->deadline -
+                                                                             clock_type::now());
+                    if (left.count() <= 0) {
+                        fail(req, error::timeout_error("Request timed out"));
+                        return true;
+                    }
+                    timeout = left;
+                }
+                auto cmd = req->command;
+                return pool->get_connection(
+                    std::move(cmd), result_of(req),
+                    [self, req](error::rd_error const &e) { self->pimpl_->redirect(self, req, e); },
+                    timeout, req->adm, asking);
+            }
+
+            template <typename Callback>
+            static Callback result_of(const request_ptr<Callback> &req) {
+                if constexpr (std::is_same<Callback, reply_decoder_ptr>::value)
+                    return req->callback;
+                else
+                    return [req](auto reply) { req->callback(std::move(reply)); };
+            }
+
+            /**
+             * Send the request to the node of a MOVED or ASK reply. A batch is
+             * sent again only if it does not write, a part of it has been run.
+             */
+            template <typename Callback>
+            void redirect(const cluster_ptr &self, const request_ptr<Callback> &req,
+                          error::rd_error const &e) {
+                auto *qe = dynamic_cast<error::query_error const *>(&e);
+                redirect_t to;
+                if (!qe || !parse_redirect(qe->what(), to)) {
+                    fail(req, e);
+                    return;
+                }
+                if (to.address.front() == ':')
+                    to.address = host_of(address_of(0)) + to.address;
+                connection_pool_ptr pool;
+                auto node = no_node;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    node = node_of(to.address);
+                    if (node != no_node && to.moved)
+                        slots_[to.slot] = node;
+                    if (node != no_node && req->redirects < max_redirects &&
+                        (std::holds_alternative<single_command_t>(req->command) ||
+                         is_idempotent(req->command)))
+                        pool = pool_of(node, req->shard);
+                }
+                if (to.moved && node != no_node)
+                    refresh(self, node);
+                if (!pool) {
+                    fail(req, e);
+                    return;
+                }
+                ++req->redirects;
+                LOG4CXX_TRACE(logger_def, "Cluster " << alias() << ": " << qe->what());
+                if (!send(self, req, pool, !to.moved))
+                    fail(req, error::queue_full_error("Request queue is full"));
+            }
+
+            template <typename Callback>
+            static void fail(const request_ptr<Callback> &req, error::rd_error const &e) {
+                if (req->error)
+                    req->error(e);
+            }
+            //@}
+
+            //@{
+            /** @name Slot table */
+            std::string address_of(size_t node) const {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return nodes_[node].address;
+            }
+
+            void refresh(const cluster_ptr &self, size_t node) {
+                if (refreshing_.exchange(true))
+                    return;
+                connection_pool_ptr pool;
+                std::string host;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    pool = pool_of(node, 0);
+                    host = host_of(nodes_[node].address);
+                }
+                pool->get_connection(
+                    single_command_t{"CLUSTER", "SLOTS"},
+                    [self, host](result_t res) {
+                        self->pimpl_->update(res, host);
+                        self->pimpl_->refreshing_ = false;
+                    },
+                    [self](error::rd_error const &e) {
+                        LOG4CXX_WARN(logger_def, "Cluster " << self->alias()
+                                                            << " slots not read: " << e.what());
+                        self->pimpl_->refreshing_ = false;
+                    });
+            }
+
+            /**
+             * Apply the reply to CLUSTER SLOTS, ranges of slots with their master
+             * and replicas: [[start, end, [host, port, id], ...], ...]
+             * @param host Host of the node answering, an empty host means this one
+             */
+            void update(const result_t &res, std::string const &host) {
+                auto *ranges = std::get_if<array_holder_t>(&res);
+                if (!ranges) {
+                    LOG4CXX_WARN(logger_def, "Cluster " << alias() << " unexpected slots reply");
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto &range : ranges->elements) {
+                    auto *e = std::get_if<array_holder_t>(&range);
+                    if (!e || e->elements.size() < 3)
+                        continue;
+                    auto *start = std::get_if<int_t>(&e->elements[0]);
+                    auto *end = std::get_if<int_t>(&e->elements[1]);
+                    auto *master = std::get_if<array_holder_t>(&e->elements[2]);
+                    if (!start || !end || !master || master->elements.size() < 2)
+                        continue;
+                    auto *master_host = std::get_if<string_t>(&master->elements[0]);
+                    auto *port = std::get_if<int_t>(&master->elements[1]);
+                    if (!master_host || !port)
+                        continue;
+                    auto address = master_host->empty() || *master_host == "?" ? host
+                                                                              : *master_host;
+                    auto node = node_of(address + ":" + std::to_string(*port));
+                    if (node == no_node)
+                        return;
+                    for (auto slot = std::max<int_t>(*start, 0);
+                         slot <= *end && slot < static_cast<int_t>(cluster_slots); ++slot)
+                        slots_[slot] = node;
+                }
+                LOG4CXX_INFO(logger_def, "Cluster " << alias() << " slot table of " << nodes_.size()
+                                                    << " nodes");
+            }
+            //@}
+        };
+
+        cluster::cluster_ptr cluster::create(connection_options const &co,
+                                             pools_factory &&factory) {
+            cluster_ptr c(new cluster(co, std::move(factory)));
+            c->refresh();
+            return c;
+        }
+
+        cluster::cluster(connection_options const &co, pools_factory &&factory)
+            : pimpl_(new impl(co, std::move(factory))) {
+        }
+
+        cluster::~cluster() = default;
+
+        rdalias const &cluster::alias() const {
+            return pimpl_->alias();
+        }
+
+        bool cluster::get_connection(size_t shard, command_wrapper_t &&cmd,
+                                     query_result_callback &&conn_cb, error_callback &&err,
+                                     std::chrono::milliseconds timeout, admission adm) {
+            return pimpl_->execute(shared_from_this(),
+                                   pimpl_->request(shard, std::move(cmd), std::move(conn_cb),
+                                                   std::move(err), timeout, adm));
+        }
+
+        bool cluster::get_connection(size_t shard, command_wrapper_t &&cmd,
+                                     reply_view_callback &&conn_cb, error_callback &&err,
+                                     std::chrono::milliseconds timeout, admission adm) {
+            return pimpl_->execute(shared_from_this(),
+                                   pimpl_->request(shard, std::move(cmd), std::move(conn_cb),
+                                                   std::move(err), timeout, adm));
+        }
+
+        bool cluster::get_connection(size_t shard, command_wrapper_t &&cmd,
+                                     flat_reply_callback &&conn_cb, error_callback &&err,
+                                     std::chrono::milliseconds timeout, admission adm) {
+            return pimpl_->execute(shared_from_this(),
+                                   pimpl_->request(shard, std::move(cmd), std::move(conn_cb),
+                                                   std::move(err), timeout, adm));
+        }
+
+        bool cluster::get_connection(size_t shard, command_wrapper_t &&cmd,
+                                     reply_decoder_ptr &&decoder, error_callback &&err,
+                                     std::chrono::milliseconds timeout, admission adm) {
+            return pimpl_->execute(shared_from_this(),
+                                   pimpl_->request(shard, std::move(cmd), std::move(decoder),
+                                                   std::move(err), timeout, adm));
+        }
+
+        void cluster::refresh() {
+            pimpl_->refresh(shared_from_this(), 0);
+        }
+
+        std::string cluster::node_address(std::uint16_t slot) const {
+            std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+            auto node = pimpl_->slots_[slot % cluster_slots];
+            return node == no_node ? std::string{} : pimpl_->nodes_[node].address;
+        }
+
+        std::vector<cluster::connection_pool_ptr> cluster::pools() const {
+            std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+            std::vector<connection_pool_ptr> pools;
+            for (auto &node : pimpl_->nodes_)
+                pools.insert(pools.end(), node.pools.begin(), node.pools.end());
+            return pools;
+        }
+
+        std::vector<cluster::connection_pool_ptr> cluster::close() {
+            {
+                std::lock_guard<std::mutex> lock(pimpl_->mutex_);
+                pimpl_->closed_ = true;
+            }
+            return pools();
+        }
+
+    } // namespace details
+} // namespace redis_async
@@ -51,6 +51,15 @@ namespace redis_async {
         void basic_connection::terminate() {
             terminateImpl();
         }
+        size_t basic_connection::outstanding() {
+            return outstandingImpl();
+        }
+        std::vector<events::execute> basic_connection::take_replay() {
+            return takeReplayImpl();
+        }
+        void basic_connection::subscribe(single_command_t &&cmd) {
+            subscribeImpl(std::move(cmd));
+        }
 
     } // namespace details
 } // namespace redis_async
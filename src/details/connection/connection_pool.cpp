@@ -5,46 +5,161 @@
 #include <redis_async/details/connection/base_connection.hpp>
 #include <redis_async/details/connection/connection_pool.hpp>
 #include <redis_async/details/connection/events.hpp>
+#include <redis_async/details/mpsc_queue.hpp>
 #include <redis_async/details/protocol/serializer.hpp>
 
-#include <mutex>
-#include <queue>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
 #include <utility>
 
 namespace redis_async {
     namespace details {
 
+        ::std::chrono::milliseconds reconnect_delay(connection_options const &co, size_t attempt,
+                                                    size_t random) {
+            auto delay = co.reconnect_delay.count();
+            auto limit = std::max(co.max_reconnect_delay.count(), delay);
+            for (size_t i = 1; i < attempt && delay < limit; ++i)
+                delay *= 2;
+            delay = std::min(delay, limit);
+            auto half = delay / 2;
+            return ::std::chrono::milliseconds{delay - half + random % (half + 1)};
+        }
+
+        /** Requests of a pool and their bytes, counted until the requests are answered */
+        struct queue_budget {
+            ::std::atomic<size_t> requests{0};
+            ::std::atomic<size_t> bytes{0};
+            size_t max_requests;
+            size_t max_bytes;
+            ::std::atomic_bool waiting{false}; ///< Requests wait in the pool for room
+            simple_callback on_room;           ///< Called on release while requests wait
+
+            queue_budget(size_t max_requests, size_t max_bytes)
+                : max_requests(max_requests)
+                , max_bytes(max_bytes) {
+            }
+
+            /**
+             * Can be called from any thread. A single request is let in whatever its size.
+             * Nothing is added past a limit, other producers only see the count of a
+             * request turned away for its bytes.
+             */
+            bool acquire(size_t size, bool notify = true) {
+                auto count = requests.load(::std::memory_order_acquire);
+                do {
+                    if (max_requests && count >= max_requests)
+                        return false;
+                } while (!requests.compare_exchange_weak(count, count + 1,
+                                                         ::std::memory_order_acq_rel));
+                auto total = bytes.load(::std::memory_order_acquire);
+                do {
+                    if (max_bytes && total + size > max_bytes &&
+                        requests.load(::std::memory_order_acquire) > 1) {
+                        release(0, notify);
+                        return false;
+                    }
+                } while (!bytes.compare_exchange_weak(total, total + size,
+                                                      ::std::memory_order_acq_rel));
+                return true;
+            }
+
+            void release(size_t size, bool notify = true) {
+                requests.fetch_sub(1, ::std::memory_order_acq_rel);
+                bytes.fetch_sub(size, ::std::memory_order_acq_rel);
+                if (notify && waiting.load(::std::memory_order_acquire) && on_room)
+                    on_room();
+            }
+        };
+
+        struct queue_ticket {
+            ::std::shared_ptr<queue_budget> budget;
+            size_t bytes;
+
+            queue_ticket(::std::shared_ptr<queue_budget> budget, size_t bytes)
+                : budget(::std::move(budget))
+                , bytes(bytes) {
+            }
+            ~queue_ticket() {
+                budget->release(bytes);
+            }
+        };
+
+        /**
+         * Requests are submitted from any thread through a lock-free queue,
+         * the rest of the pool state is owned by the thread running the io_service.
+         */
         struct connection_pool::impl {
+            using clock_type = ::std::chrono::steady_clock;
             using connections_container = ::std::vector<connection_ptr>;
-            using connections_queue = ::std::queue<connection_ptr>;
-            using request_callbacks_queue = ::std::queue<events::execute>;
-            using mutex_type = ::std::recursive_mutex;
-            using lock_type = ::std::lock_guard<mutex_type>;
+            struct idle_connection {
+                connection_ptr conn;
+                clock_type::time_point since;
+            };
+            /** The most recently idle connection is the back one, the one to use first */
+            using connections_queue = ::std::deque<idle_connection>;
+            /** Requests waiting for a connection, oldest first */
+            using request_callbacks_queue = ::std::deque<events::execute>;
+            using submission_queue = mpsc_queue<events::execute>;
             using atomic_flag = ::std::atomic_bool;
 
             io_service_ptr service_;
             size_t pool_size_;
             connection_options co_;
-            mutex_type event_mutex_;
-            mutex_type conn_mutex_;
+            client_cache_ptr cache_; ///< Invalidated by push frames of the connections
             connections_container connections_;
             connections_queue ready_connections_;
+            connections_container busy_connections_;
+            connections_container fresh_connections_; ///< Created and not ready yet
+            ::std::minstd_rand random_;
             request_callbacks_queue queue_;
+            request_callbacks_queue parked_; ///< Requests waiting for room in the budget
+            ::std::shared_ptr<queue_budget> budget_;
+            submission_queue submitted_;
+            atomic_flag drain_scheduled_;
+            atomic_flag room_scheduled_;
             atomic_flag closed_;
+            bool terminated_;
             simple_callback closed_callback_;
-
-            impl(io_service_ptr service, size_t pool_size, connection_options co)
+            ::boost::asio::steady_timer maintenance_timer_;
+            ::boost::asio::steady_timer queue_timer_; ///< Fires at the nearest deadline in queue_
+            bool queue_timer_armed_;
+            ::boost::asio::steady_timer reconnect_timer_;
+            size_t reconnect_attempt_; ///< Failed connects in a row, none once a connection is up
+            bool reconnect_scheduled_;
+
+            /** Period of warming up and reaping of idle connections */
+            static constexpr ::std::chrono::seconds maintenance_interval{1};
+
+            impl(io_service_ptr service, size_t pool_size, connection_options co,
+                 client_cache_ptr cache)
                 : service_(std::move(service))
                 , pool_size_(pool_size)
                 , co_(std::move(co))
-                , closed_(false) {
+                , cache_(std::move(cache))
+                , budget_(::std::make_shared<queue_budget>(co_.max_queue_size, co_.max_queue_bytes))
+                , drain_scheduled_(false)
+                , room_scheduled_(false)
+                , closed_(false)
+                , terminated_(false)
+                , maintenance_timer_(*service_)
+                , queue_timer_(*service_)
+                , queue_timer_armed_(false)
+                , reconnect_timer_(*service_)
+                , reconnect_attempt_(0)
+                , reconnect_scheduled_(false) {
                 if (pool_size_ == 0)
                     throw error::connection_error("Database connection pool size cannot be zero");
 
                 if (co_.uri.empty())
                     throw error::connection_error("No URI in database connection string");
 
-                LOG4CXX_INFO(logger_def, "Connection pool max size " << pool_size);
+                LOG4CXX_INFO(logger_def, "Connection pool max size " << pool_size << " min idle "
+                                                                     << co_.min_idle);
             }
 
             rdalias const &alias() const {
@@ -54,65 +169,289 @@ namespace redis_async {
             //@{
             /** @name Connection granular work */
             bool get_idle_connection(connection_ptr &conn) {
-                if (closed_)
-                    return false;
-                lock_type lock{conn_mutex_};
                 if (!ready_connections_.empty()) {
-                    conn = ready_connections_.front();
-                    ready_connections_.pop();
+                    conn = std::move(ready_connections_.back().conn);
+                    ready_connections_.pop_back();
                     return true;
                 }
                 return false;
             }
             void add_idle_connection(connection_ptr conn) {
                 if (!closed_) {
-                    lock_type lock{conn_mutex_};
-                    ready_connections_.push(std::move(conn));
-                    LOG4CXX_INFO(logger_def, alias()
-                                             << " idle connections " << ready_connections_.size());
+                    ready_connections_.push_back({std::move(conn), clock_type::now()});
+                }
+            }
+            void remove_idle_connection(const connection_ptr &conn) {
+                auto f = std::find_if(ready_connections_.begin(), ready_connections_.end(),
+                                      [&conn](const idle_connection &c) { return c.conn == conn; });
+                if (f != ready_connections_.end()) {
+                    ready_connections_.erase(f);
+                }
+            }
+            /**
+             * Pick a connection that already has requests in flight, to pipeline
+             * the next request behind them. Of two random busy connections the
+             * one with fewer outstanding requests is taken, so a slow request
+             * does not hold up many others.
+             */
+            bool get_busy_connection(connection_ptr &conn) {
+                auto count = busy_connections_.size();
+                if (count == 0)
+                    return false;
+                if (count == 1) {
+                    conn = busy_connections_.front();
+                    return true;
+                }
+                auto first = random_() % count;
+                auto second = (first + 1 + random_() % (count - 1)) % count;
+                auto &a = busy_connections_[first];
+                auto &b = busy_connections_[second];
+                conn = a->outstanding() <= b->outstanding() ? a : b;
+                return true;
+            }
+            void add_busy_connection(connection_ptr conn) {
+                busy_connections_.push_back(std::move(conn));
+            }
+            void remove_busy_connection(const connection_ptr &conn) {
+                auto f = std::find(busy_connections_.begin(), busy_connections_.end(), conn);
+                if (f != busy_connections_.end()) {
+                    busy_connections_.erase(f);
                 }
             }
             void erase_connection(const connection_ptr &conn) {
                 LOG4CXX_INFO(logger_def, "Erase connection from the connection pool");
-                lock_type lock{conn_mutex_};
                 auto f = std::find(connections_.begin(), connections_.end(), conn);
                 if (f != connections_.end()) {
                     connections_.erase(f);
                 }
+                remove_busy_connection(conn);
+                remove_idle_connection(conn);
+                remove_fresh_connection(conn);
+            }
+            /** The connection is set up for the first time */
+            bool remove_fresh_connection(const connection_ptr &conn) {
+                auto f = std::find(fresh_connections_.begin(), fresh_connections_.end(), conn);
+                if (f == fresh_connections_.end())
+                    return false;
+                fresh_connections_.erase(f);
+                return true;
+            }
+            //@}
+
+            //@{
+            /** @name Pool sizing */
+            /** Connections that are idle or still connecting */
+            size_t warm_connections() const {
+                return connections_.size() - busy_connections_.size();
+            }
+            /** Open connections up to the minimum of idle ones */
+            void warm_up(const connection_pool_ptr &pool) {
+                auto target = std::max<size_t>(co_.min_idle, 1);
+                while (!closed_ && !reconnecting() && warm_connections() < target &&
+                       connections_.size() < pool_size_)
+                    create_new_connection(pool);
+            }
+            /** Close connections idle longer than the timeout, above the minimum */
+            void reap_idle() {
+                if (co_.idle_timeout.count() == 0)
+                    return;
+                auto deadline = clock_type::now() - co_.idle_timeout;
+                while (ready_connections_.size() > co_.min_idle &&
+                       ready_connections_.front().since < deadline) {
+                    auto conn = std::move(ready_connections_.front().conn);
+                    ready_connections_.pop_front();
+                    LOG4CXX_INFO(logger_def, "Close idle " << alias() << " connection");
+                    conn->terminate();
+                }
+            }
+            void start_maintenance(const connection_pool_ptr &pool) {
+                if (co_.min_idle == 0 && co_.idle_timeout.count() == 0)
+                    return;
+                maintenance_timer_.expires_after(maintenance_interval);
+                maintenance_timer_.async_wait([pool](asio_config::error_code ec) {
+                    auto &self = *pool->pimpl_;
+                    if (ec || self.closed_)
+                        return;
+                    self.reap_idle();
+                    self.warm_up(pool);
+                    self.start_maintenance(pool);
+                });
             }
             //@}
 
             //@{
             /** @name Event queue */
+            /** The next queued request, the ones past their deadlines are dropped */
             bool next_event(events::execute &evt) {
-                lock_type lock{event_mutex_};
-                if (!queue_.empty()) {
-                    LOG4CXX_INFO(logger_def, alias()
-                                             << " queue size " << queue_.size() << " (dequeue)");
-                    evt = queue_.front();
-                    queue_.pop();
-                    return true;
+                auto now = clock_type::now();
+                while (!queue_.empty()) {
+                    evt = std::move(queue_.front());
+                    queue_.pop_front();
+                    if (!evt.expired(now))
+                        return true;
+                    fail_expired(evt);
                 }
                 return false;
             }
 
-            void enqueue_event(events::execute &&evt) {
-                lock_type lock{event_mutex_};
-                queue_.push(::std::move(evt));
-                LOG4CXX_INFO(logger_def, alias() << " queue size " << queue_.size() << " (enqueue)");
+            void enqueue_event(events::execute &&evt, const connection_pool_ptr &pool) {
+                watch_deadline(evt.deadline, pool);
+                queue_.push_back(::std::move(evt));
             }
 
             void clear_queue(error::connection_error const &ec) {
-                lock_type lock(event_mutex_);
                 while (!queue_.empty()) {
-                    auto req = queue_.front();
-                    queue_.pop();
+                    auto req = std::move(queue_.front());
+                    queue_.pop_front();
                     if (req.error)
                         req.error(ec);
                 }
             }
             //@}
 
+            //@{
+            /** @name Deadlines */
+            /** Fail a request that is past its deadline, before it is sent */
+            static void fail_expired(events::execute &evt) {
+                LOG4CXX_TRACE(logger_def, "Request timed out in the queue");
+                if (evt.error)
+                    evt.error(error::timeout_error("Request timed out in the queue"));
+            }
+            void watch_deadline(clock_type::time_point deadline, const connection_pool_ptr &pool) {
+                if (deadline == clock_type::time_point{})
+                    return;
+                if (queue_timer_armed_ && queue_timer_.expiry() <= deadline)
+                    return;
+                queue_timer_armed_ = true;
+                queue_timer_.expires_at(deadline);
+                queue_timer_.async_wait([pool](asio_config::error_code ec) {
+                    if (!ec)
+                        pool->pimpl_->shed_expired(pool);
+                });
+            }
+            /** Drop the queued requests past their deadlines, wait for the next one */
+            void shed_expired(const connection_pool_ptr &pool) {
+                queue_timer_armed_ = false;
+                auto now = clock_type::now();
+                clock_type::time_point next{};
+                for (auto *queue : {&queue_, &parked_}) {
+                    for (auto it = queue->begin(); it != queue->end();) {
+                        if (it->expired(now)) {
+                            auto evt = std::move(*it);
+                            it = queue->erase(it);
+                            fail_expired(evt);
+                            continue;
+                        }
+                        if (it->deadline != clock_type::time_point{} &&
+                            (next == clock_type::time_point{} || it->deadline < next))
+                            next = it->deadline;
+                        ++it;
+                    }
+                }
+                if (next != clock_type::time_point{})
+                    watch_deadline(next, pool);
+            }
+            //@}
+
+            //@{
+            /** @name Queue budget */
+            /** Take a place in the budget for the request, false if there is no room */
+            bool admit(events::execute &evt, bool notify = true) {
+                auto bytes = Protocol::command_size(evt.command);
+                if (!budget_->acquire(bytes, notify))
+                    return false;
+                evt.ticket = ::std::make_shared<queue_ticket>(budget_, bytes);
+                return true;
+            }
+            /** Can be called from any thread */
+            void schedule_admission(const connection_pool_ptr &pool) {
+                if (!room_scheduled_.exchange(true))
+                    service_->post([pool]() { pool->pimpl_->admit_parked(pool); });
+            }
+            /** Dispatch the waiting requests in order, while there is room for them */
+            void admit_parked(const connection_pool_ptr &pool) {
+                room_scheduled_ = false;
+                while (!parked_.empty()) {
+                    if (!admit(parked_.front(), false))
+                        return;
+                    auto evt = std::move(parked_.front());
+                    parked_.pop_front();
+                    dispatch(std::move(evt), pool);
+                }
+                budget_->waiting = false;
+            }
+            void park(events::execute &&evt, const connection_pool_ptr &pool) {
+                watch_deadline(evt.deadline, pool);
+                parked_.push_back(std::move(evt));
+                // Set before the admission, a release after it schedules another one
+                budget_->waiting = true;
+                admit_parked(pool);
+            }
+            size_t queue_depth() const {
+                return budget_->requests.load(::std::memory_order_relaxed);
+            }
+            size_t queue_bytes() const {
+                return budget_->bytes.load(::std::memory_order_relaxed);
+            }
+            //@}
+
+            //@{
+            /** @name Reconnect */
+            /** Connects failed, new connections are opened by the supervisor only */
+            bool reconnecting() const {
+                return reconnect_attempt_ > 0;
+            }
+            void schedule_reconnect(const connection_pool_ptr &pool) {
+                // Connections failing together, as on a server restart, count once
+                if (reconnect_scheduled_ || closed_)
+                    return;
+                ++reconnect_attempt_;
+                reconnect_scheduled_ = true;
+                auto delay = details::reconnect_delay(co_, reconnect_attempt_, random_());
+                LOG4CXX_INFO(logger_def, "Reconnect " << alias() << " in " << delay.count()
+                                                      << "ms, attempt " << reconnect_attempt_);
+                reconnect_timer_.expires_after(delay);
+                reconnect_timer_.async_wait([pool](asio_config::error_code ec) {
+                    auto &self = *pool->pimpl_;
+                    if (ec)
+                        return;
+                    self.reconnect_scheduled_ = false;
+                    if (!self.closed_ && self.connections_.size() < self.pool_size_)
+                        self.create_new_connection(pool);
+                });
+            }
+            /** Replay requests of a failed connection before the queued ones */
+            void requeue(::std::vector<events::execute> &&replay, const connection_pool_ptr &pool) {
+                if (replay.empty())
+                    return;
+                LOG4CXX_INFO(logger_def, "Replay " << replay.size() << " " << alias() << " requests");
+                for (auto it = replay.rbegin(); it != replay.rend(); ++it) {
+                    watch_deadline(it->deadline, pool);
+                    queue_.push_front(std::move(*it));
+                }
+                connection_ptr conn;
+                if (get_idle_connection(conn))
+                    connection_ready(conn, pool);
+            }
+            //@}
+
+            //@{
+            /** @name Submission queue */
+            /** Can be called from any thread */
+            void submit(events::execute &&evt, connection_pool_ptr &&pool) {
+                submitted_.push(std::move(evt));
+                // One drain at a time takes everything submitted before it runs
+                if (!drain_scheduled_.exchange(true))
+                    service_->post([pool = std::move(pool)]() { pool->pimpl_->drain(pool); });
+            }
+
+            void drain(const connection_pool_ptr &pool) {
+                drain_scheduled_ = false;
+                while (auto evt = submitted_.pop())
+                    dispatch(std::move(*evt), pool);
+            }
+            //@}
+
             void create_new_connection(const connection_pool_ptr &pool) {
                 if (closed_)
                     return;
@@ -123,20 +462,33 @@ namespace redis_async {
                      [pool](connection_ptr c) { pool->connection_terminated(c); },
                      [pool](connection_ptr c, error::connection_error const &ec) {
                          pool->connection_error(c, ec);
+                     },
+                     [cache = cache_](reply_view_t &&reply) {
+                         if (cache)
+                             cache->on_push(reply);
                      }});
 
-                {
-                    lock_type lock{conn_mutex_};
-                    connections_.push_back(conn);
-                    LOG4CXX_INFO(logger_def, alias() << " pool size " << connections_.size());
-                }
+                connections_.push_back(conn);
+                fresh_connections_.push_back(conn);
+                LOG4CXX_INFO(logger_def, alias() << " pool size " << connections_.size());
             }
-            void connection_ready(connection_ptr c) {
-                LOG4CXX_INFO(logger_def, "Connection " << alias() << " ready");
+            void connection_ready(connection_ptr c, const connection_pool_ptr &pool) {
+                LOG4CXX_TRACE(logger_def, "Connection " << alias() << " ready");
+                remove_busy_connection(c);
+                // Only a new connection tells the server is back, old ones may outlive it
+                if (remove_fresh_connection(c) && reconnecting()) {
+                    LOG4CXX_INFO(logger_def, "Connection " << alias() << " restored");
+                    reconnect_attempt_ = 0;
+                    warm_up(pool);
+                }
 
                 events::execute evt;
                 if (next_event(evt)) {
-                    c->execute(::std::move(evt));
+                    // Pipeline everything queued so far into the connection
+                    add_busy_connection(c);
+                    do {
+                        send(c, ::std::move(evt));
+                    } while (next_event(evt));
                 } else {
                     if (closed_) {
                         close_connections();
@@ -148,57 +500,130 @@ namespace redis_async {
             void connection_terminated(connection_ptr c) {
                 LOG4CXX_INFO(logger_def, "Connection " << alias() << " gracefully terminated");
                 erase_connection(c);
+                lose_tracking(c);
 
                 if (connections_.empty() && closed_ && closed_callback_) {
                     closed_callback_();
                 }
                 LOG4CXX_INFO(logger_def, alias() << " pool size " << connections_.size());
             }
-            void connection_error(connection_ptr c, error::connection_error const &ec) {
+            /**
+             * Queued requests wait for the reconnect, up to their deadlines.
+             * Only a closed pool fails them at once.
+             */
+            void connection_error(connection_ptr c, error::connection_error const &ec,
+                                  const connection_pool_ptr &pool) {
                 LOG4CXX_INFO(logger_def, "Connection " << alias() << " error: " << ec.what());
                 erase_connection(c);
-                clear_queue(ec);
-            }
-            void get_connection(command_wrapper_t &&cmd, query_result_callback &&conn_cb,
-                                error_callback &&err, connection_pool_ptr &&pool) {
+                lose_tracking(c);
+                requeue(c->take_replay(), pool);
                 if (closed_) {
-                    err(error::connection_error("Connection pool is closed"));
+                    clear_queue(ec);
+                    if (!terminated_ && connections_.empty())
+                        close_connections();
                     return;
                 }
+                schedule_reconnect(pool);
+            }
+            /** The server forgets the keys read by a closed connection, they are not tracked */
+            void lose_tracking(const connection_ptr &c) {
+                if (cache_)
+                    cache_->forget_reader(c.get());
+            }
+            /** Write the request to the connection, the cache learns the keys it reads */
+            void send(const connection_ptr &c, events::execute &&evt) {
+                if (cache_) {
+                    if (auto *cmd = std::get_if<single_command_t>(&evt.command))
+                        cache_->sent(*cmd, c.get());
+                }
+                c->execute(std::move(evt));
+            }
+            bool get_connection(command_wrapper_t &&cmd, events::execute &&evt,
+                                connection_pool_ptr &&pool, ::std::chrono::milliseconds timeout,
+                                admission adm) {
+                if (closed_) {
+                    if (evt.error)
+                        evt.error(error::connection_error("Connection pool is closed"));
+                    return true;
+                }
+                // Serialized by the connection, straight into its write buffer
+                if (auto *batch = std::get_if<command_container_t>(&cmd))
+                    evt.batch = batch->size();
+                evt.command = std::move(cmd);
+                // Requests to wait for room get their place in the budget from the pool
+                if (!admit(evt)) {
+                    if (adm == admission::try_once)
+                        return false;
+                    if (adm == admission::reject) {
+                        if (evt.error)
+                            evt.error(error::queue_full_error("Request queue is full"));
+                        return true;
+                    }
+                }
+                if (timeout.count() == 0)
+                    timeout = co_.socket_timeout;
+                if (timeout.count())
+                    evt.deadline = clock_type::now() + timeout;
+                submit(std::move(evt), std::move(pool));
+                return true;
+            }
+            void dispatch(events::execute &&evt, const connection_pool_ptr &pool) {
                 connection_ptr conn;
-                using serializer_t = command_serializer_visitor<events::execute::Buffer>;
-                events::execute evt{{}, conn_cb, err};
-                std::visit(serializer_t(evt.buff), cmd);
-
-                if (get_idle_connection(conn)) {
-                    LOG4CXX_INFO(logger_def, "Connection to " << alias() << " is idle");
-                    conn->execute(std::move(evt));
+                if (terminated_) {
+                    // Submitted while the pool was closing
+                    if (evt.error)
+                        evt.error(error::connection_error("Connection pool is closed"));
+                } else if (evt.expired(clock_type::now())) {
+                    // Never serialized nor sent
+                    fail_expired(evt);
+                } else if (!evt.ticket) {
+                    park(std::move(evt), pool);
+                } else if (get_idle_connection(conn)) {
+                    add_busy_connection(conn);
+                    send(conn, std::move(evt));
+                } else if (!closed_ && !reconnecting() && connections_.size() < pool_size_) {
+                    create_new_connection(pool);
+                    enqueue_event(std::move(evt), pool);
+                } else if (get_busy_connection(conn)) {
+                    send(conn, std::move(evt));
                 } else {
-                    if (!closed_ && connections_.size() < pool_size_) {
-                        create_new_connection(pool);
-                    }
-                    enqueue_event(std::move(evt));
+                    enqueue_event(std::move(evt), pool);
                 }
             }
 
-            void close(const simple_callback &close_cb) {
+            void close(const simple_callback &close_cb, const connection_pool_ptr &pool) {
                 bool expected = false;
                 if (closed_.compare_exchange_strong(expected, true)) {
-                    closed_callback_ = close_cb;
-
-                    lock_type lock{event_mutex_};
-                    if (queue_.empty()) {
-                        close_connections();
-                    } else {
-                        LOG4CXX_INFO(logger_def, "Wait for outstanding tasks to finish");
-                    }
+                    // Requests submitted before the close are still executed
+                    service_->dispatch([pool, close_cb]() {
+                        auto &self = *pool->pimpl_;
+                        self.closed_callback_ = close_cb;
+                        self.maintenance_timer_.cancel();
+                        self.reconnect_timer_.cancel();
+                        self.drain(pool);
+                        // No connection is left to run the queued requests
+                        if (self.connections_.empty() || self.reconnecting())
+                            self.clear_queue(error::connection_error("Connection pool is closed"));
+                        if (self.queue_.empty()) {
+                            self.close_connections();
+                        } else {
+                            LOG4CXX_INFO(logger_def, "Wait for outstanding tasks to finish");
+                        }
+                    });
                 }
             }
             void close_connections() {
                 LOG4CXX_INFO(logger_def, "Close connection pool " << alias() << " pool size "
                                                               << connections_.size());
+                terminated_ = true;
+                queue_timer_.cancel();
+                while (!parked_.empty()) {
+                    auto evt = std::move(parked_.front());
+                    parked_.pop_front();
+                    if (evt.error)
+                        evt.error(error::connection_error("Connection pool is closed"));
+                }
                 if (!connections_.empty()) {
-                    lock_type lock(conn_mutex_);
                     connections_container copy = connections_;
                     for (auto &c : copy) {
                         c->terminate();
@@ -211,8 +636,9 @@ namespace redis_async {
         };
 
         connection_pool::connection_pool(io_service_ptr service, size_t pool_size,
-                                         connection_options const &co)
-            : pimpl_(new impl(service, pool_size, co)) {
+                                         connection_options const &co,
+                                         client_cache_ptr cache)
+            : pimpl_(new impl(service, pool_size, co, std::move(cache))) {
         }
 
         connection_pool::~connection_pool() {
@@ -225,19 +651,22 @@ namespace redis_async {
 
         connection_pool::connection_pool_ptr connection_pool::create(io_service_ptr service,
                                                                      size_t pool_size,
-                                                                     connection_options const &co) {
-            connection_pool_ptr pool(new connection_pool(std::move(service), pool_size, co));
-            pool->create_new_connection();
+                                                                     connection_options const &co,
+                                                                     client_cache_ptr cache) {
+            connection_pool_ptr pool(
+                new connection_pool(std::move(service), pool_size, co, std::move(cache)));
+            ::std::weak_ptr<connection_pool> weak = pool;
+            pool->pimpl_->budget_->on_room = [weak]() {
+                if (auto pool = weak.lock())
+                    pool->pimpl_->schedule_admission(pool);
+            };
+            pool->pimpl_->warm_up(pool);
+            pool->pimpl_->start_maintenance(pool);
             return pool;
         }
 
-        void connection_pool::create_new_connection() {
-            auto _this = shared_from_this();
-            pimpl_->create_new_connection(_this);
-        }
-
         void connection_pool::connection_ready(connection_ptr c) {
-            pimpl_->connection_ready(std::move(c));
+            pimpl_->connection_ready(std::move(c), shared_from_this());
         }
 
         void connection_pool::connection_terminated(connection_ptr c) {
@@ -246,19 +675,75 @@ namespace redis_async {
 
         void connection_pool::connection_error(connection_ptr c,
                                                error::connection_error const &ec) {
-            pimpl_->connection_error(std::move(c), ec);
+            pimpl_->connection_error(std::move(c), ec, shared_from_this());
         }
 
-        void connection_pool::get_connection(command_wrapper_t &&cmd,
+        bool connection_pool::get_connection(command_wrapper_t &&cmd,
                                              query_result_callback &&conn_cb,
-                                             error_callback &&err) {
+                                             error_callback &&err,
+                                             std::chrono::milliseconds timeout, admission adm,
+                                             bool asking) {
+            auto _this = shared_from_this();
+            events::execute evt;
+            evt.result = std::move(conn_cb);
+            evt.error = std::move(err);
+            evt.asking = asking;
+            return pimpl_->get_connection(std::move(cmd), std::move(evt), std::move(_this), timeout,
+                                          adm);
+        }
+
+        bool connection_pool::get_connection(command_wrapper_t &&cmd,
+                                             reply_view_callback &&conn_cb,
+                                             error_callback &&err,
+                                             std::chrono::milliseconds timeout, admission adm,
+                                             bool asking) {
+            auto _this = shared_from_this();
+            events::execute evt;
+            evt.view = std::move(conn_cb);
+            evt.error = std::move(err);
+            evt.asking = asking;
+            return pimpl_->get_connection(std::move(cmd), std::move(evt), std::move(_this), timeout,
+                                          adm);
+        }
+
+        bool connection_pool::get_connection(command_wrapper_t &&cmd,
+                                             flat_reply_callback &&conn_cb,
+                                             error_callback &&err,
+                                             std::chrono::milliseconds timeout, admission adm,
+                                             bool asking) {
             auto _this = shared_from_this();
-            pimpl_->get_connection(std::move(cmd), std::move(conn_cb), std::move(err),
-                                   std::move(_this));
+            events::execute evt;
+            evt.flat = std::move(conn_cb);
+            evt.error = std::move(err);
+            evt.asking = asking;
+            return pimpl_->get_connection(std::move(cmd), std::move(evt), std::move(_this), timeout,
+                                          adm);
+        }
+
+        bool connection_pool::get_connection(command_wrapper_t &&cmd,
+                                             reply_decoder_ptr &&decoder,
+                                             error_callback &&err,
+                                             std::chrono::milliseconds timeout, admission adm,
+                                             bool asking) {
+            auto _this = shared_from_this();
+            events::execute evt;
+            evt.decoder = std::move(decoder);
+            evt.error = std::move(err);
+            evt.asking = asking;
+            return pimpl_->get_connection(std::move(cmd), std::move(evt), std::move(_this), timeout,
+                                          adm);
+        }
+
+        size_t connection_pool::queue_depth() const {
+            return pimpl_->queue_depth();
+        }
+
+        size_t connection_pool::queue_bytes() const {
+            return pimpl_->queue_bytes();
         }
 
         void connection_pool::close(simple_callback close_cb) {
-            pimpl_->close(std::move(close_cb));
+            pimpl_->close(std::move(close_cb), shared_from_this());
         }
 
         void connection_pool::close_connections() {
@@ -0,0 +1,360 @@
+//
+// Created by niko on 05.10.2021.
+//
+
+#include <redis_async/details/connection/base_connection.hpp>
+#include <redis_async/details/connection/connection_pool.hpp>
+#include <redis_async/details/connection/subscriber.hpp>
+#include <redis_async/details/protocol/command_args.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace redis_async {
+    namespace details {
+
+        namespace {
+            constexpr size_t kinds = 3;
+            constexpr std::array<const char *, kinds> subscribe_commands{"SUBSCRIBE", "PSUBSCRIBE",
+                                                                         "SSUBSCRIBE"};
+            constexpr std::array<const char *, kinds> unsubscribe_commands{
+                "UNSUBSCRIBE", "PUNSUBSCRIBE", "SUNSUBSCRIBE"};
+
+            std::string_view as_string(const view_t &value) {
+                auto *str = std::get_if<std::string_view>(&value);
+                return str ? *str : std::string_view{};
+            }
+        } // namespace
+
+        struct subscriber::impl {
+            /** A local handler of a channel */
+            struct handler_t {
+                subscription_id id;
+                message_callback message;
+                error_callback error;
+            };
+            /** Handlers of the subscribed channels, found by a view of the channel name */
+            using channel_table =
+                ::std::map<::std::string, ::std::vector<handler_t>, ::std::less<>>;
+            /** A command sent to the server, it is confirmed once per channel */
+            struct inflight_t {
+                subscription_kind kind;
+                bool subscribe;
+                ::std::vector<::std::string> channels;
+                ::std::vector<::std::string> unconfirmed; ///< Channels not confirmed yet
+            };
+
+            io_service_ptr service_;
+            connection_options co_;
+            connection_ptr conn_;
+            bool ready_; ///< The connection is set up, commands can be sent
+            bool closed_;
+            ::std::array<channel_table, kinds> tables_;
+            /** Channel of every handler, to unsubscribe it */
+            ::std::unordered_map<subscription_id, ::std::pair<subscription_kind, ::std::string>>
+                ids_;
+            ::std::deque<inflight_t> inflight_;
+            ::std::atomic<subscription_id> next_id_;
+            ::boost::asio::steady_timer reconnect_timer_;
+            size_t reconnect_attempt_;
+            bool reconnect_scheduled_;
+            ::std::minstd_rand random_;
+
+            impl(io_service_ptr service, connection_options const &co)
+                : service_(std::move(service))
+                , co_(co)
+                , ready_(false)
+                , closed_(false)
+                , next_id_(0)
+                , reconnect_timer_(*service_)
+                , reconnect_attempt_(0)
+                , reconnect_scheduled_(false)
+                , random_(::std::random_device{}()) {
+            }
+
+            rdalias const &alias() const {
+                return co_.alias;
+            }
+
+            channel_table &table(subscription_kind kind) {
+                return tables_[static_cast<size_t>(kind)];
+            }
+
+            //@{
+            /** @name Local channel table */
+            void add(handler_t &&handler, subscription_kind kind, ::std::string &&channel,
+                     const subscriber_ptr &self) {
+                if (closed_) {
+                    fail(handler, error::connection_error("Subscriber is closed"));
+                    return;
+                }
+                ids_.emplace(handler.id, ::std::make_pair(kind, channel));
+                auto &handlers = table(kind)[channel];
+                handlers.push_back(::std::move(handler));
+                // The server knows of the channel already
+                if (handlers.size() > 1)
+                    return;
+                if (conn_)
+                    send(kind, true, {::std::move(channel)});
+                else
+                    connect(self);
+            }
+            void remove(subscription_id id) {
+                auto found = ids_.find(id);
+                if (found == ids_.end())
+                    return;
+                auto kind = found->second.first;
+                auto channel = ::std::move(found->second.second);
+                ids_.erase(found);
+
+                auto &channels = table(kind);
+                auto entry = channels.find(channel);
+                if (entry == channels.end())
+                    return;
+                auto &handlers = entry->second;
+                handlers.erase(::std::remove_if(handlers.begin(), handlers.end(),
+                                                [id](const handler_t &h) { return h.id == id; }),
+                               handlers.end());
+                if (!handlers.empty())
+                    return;
+                channels.erase(entry);
+                send(kind, false, {::std::move(channel)});
+            }
+            //@}
+
+            /** Send the command, if the connection is not set up yet it subscribes all at once */
+            void send(subscription_kind kind, bool subscribe,
+                      ::std::vector<::std::string> &&channels) {
+                if (!ready_ || channels.empty())
+                    return;
+                auto index = static_cast<size_t>(kind);
+                cmd::details::CmdArgs args;
+                args << (subscribe ? subscribe_commands[index] : unsubscribe_commands[index])
+                     << ::std::make_pair(channels.begin(), channels.end());
+                auto unconfirmed = channels;
+                inflight_.push_back(
+                    {kind, subscribe, ::std::move(channels), ::std::move(unconfirmed)});
+                conn_->subscribe(::std::move(args.cmd()));
+            }
+
+            //@{
+            /** @name Messages */
+            void on_push(reply_view_t &&reply) {
+                auto *frame = ::std::get_if<view_array_t>(&reply.value);
+                if (!frame || frame->elements.empty()) {
+                    LOG4CXX_WARN(logger_def, "Unexpected reply to subscriber " << alias());
+                    return;
+                }
+                auto &e = frame->elements;
+                auto type = as_string(e[0]);
+                if (type == "message" && e.size() == 3) {
+                    deliver(subscription_kind::channel, as_string(e[1]),
+                            {{}, as_string(e[1]), as_string(e[2]), ::std::move(reply.chunk)});
+                } else if (type == "smessage" && e.size() == 3) {
+                    deliver(subscription_kind::shard_channel, as_string(e[1]),
+                            {{}, as_string(e[1]), as_string(e[2]), ::std::move(reply.chunk)});
+                } else if (type == "pmessage" && e.size() == 4) {
+                    deliver(subscription_kind::pattern, as_string(e[1]),
+                            {as_string(e[1]), as_string(e[2]), as_string(e[3]),
+                             ::std::move(reply.chunk)});
+                } else if (e.size() != 3 || !confirm(type, as_string(e[1]))) {
+                    LOG4CXX_WARN(logger_def, "Unexpected " << type << " frame to subscriber "
+                                                           << alias());
+                }
+            }
+            /** A channel of the oldest command in flight is confirmed, false for a stray frame */
+            bool confirm(::std::string_view type, ::std::string_view channel) {
+                if (inflight_.empty())
+                    return false;
+                auto &command = inflight_.front();
+                auto index = static_cast<size_t>(command.kind);
+                if (!::boost::iequals(type, command.subscribe ? subscribe_commands[index]
+                                                               : unsubscribe_commands[index]))
+                    return false;
+                auto &waiting = command.unconfirmed;
+                auto found = ::std::find(waiting.begin(), waiting.end(), channel);
+                if (found == waiting.end())
+                    return false;
+                waiting.erase(found);
+                if (waiting.empty())
+                    inflight_.pop_front();
+                return true;
+            }
+            /** Every handler of the channel gets the same message */
+            void deliver(subscription_kind kind, ::std::string_view channel,
+                         const pubsub_message_t &msg) {
+                auto &channels = table(kind);
+                auto entry = channels.find(channel);
+                if (entry == channels.end())
+                    return;
+                for (auto &handler : entry->second) {
+                    try {
+                        handler.message(msg);
+                    } catch (error::rd_error const &e) {
+                        fail(handler, e);
+                    } catch (::std::exception const &e) {
+                        fail(handler, error::client_error(e));
+                    } catch (...) {
+                        fail(handler, error::client_error("Unknown exception"));
+                    }
+                }
+            }
+            /** The server rejected a subscription, its handlers are removed */
+            void on_push_error(error::query_error const &err) {
+                if (inflight_.empty())
+                    return;
+                auto rejected = ::std::move(inflight_.front());
+                inflight_.pop_front();
+                if (!rejected.subscribe)
+                    return;
+                auto &channels = table(rejected.kind);
+                for (auto &channel : rejected.channels) {
+                    auto entry = channels.find(channel);
+                    if (entry == channels.end())
+                        continue;
+                    auto handlers = ::std::move(entry->second);
+                    channels.erase(entry);
+                    for (auto &handler : handlers) {
+                        ids_.erase(handler.id);
+                        fail(handler, err);
+                    }
+                }
+            }
+            static void fail(const handler_t &handler, error::rd_error const &err) {
+                if (!handler.error)
+                    return;
+                try {
+                    handler.error(err);
+                } catch (...) {
+                    LOG4CXX_WARN(logger_def, "Subscription error handler throwed an exception");
+                }
+            }
+            //@}
+
+            //@{
+            /** @name Connection */
+            void connect(const subscriber_ptr &self) {
+                if (conn_ || closed_ || reconnect_scheduled_)
+                    return;
+                LOG4CXX_INFO(logger_def, "Create " << alias() << " subscriber connection");
+                conn_ = basic_connection::create(
+                    service_, co_,
+                    {[self](connection_ptr c) { self->pimpl_->connection_ready(c); },
+                     [self](connection_ptr c) { self->pimpl_->connection_terminated(c); },
+                     [self](connection_ptr c, error::connection_error const &ec) {
+                         self->pimpl_->connection_error(c, ec, self);
+                     },
+                     [self](reply_view_t &&reply) { self->pimpl_->on_push(::std::move(reply)); },
+                     [self](error::query_error const &e) { self->pimpl_->on_push_error(e); }});
+            }
+            /** Subscribe to everything in the table, a new connection knows nothing */
+            void connection_ready(const connection_ptr &c) {
+                if (c != conn_)
+                    return;
+                if (reconnect_attempt_)
+                    LOG4CXX_INFO(logger_def, "Subscriber " << alias() << " restored");
+                ready_ = true;
+                reconnect_attempt_ = 0;
+                for (size_t kind = 0; kind < kinds; ++kind) {
+                    ::std::vector<::std::string> channels;
+                    for (auto &entry : tables_[kind])
+                        channels.push_back(entry.first);
+                    send(static_cast<subscription_kind>(kind), true, ::std::move(channels));
+                }
+            }
+            void connection_terminated(const connection_ptr &c) {
+                LOG4CXX_INFO(logger_def, "Subscriber " << alias() << " connection terminated");
+                if (c == conn_)
+                    conn_.reset();
+            }
+            void connection_error(const connection_ptr &c, error::connection_error const &ec,
+                                  const subscriber_ptr &self) {
+                if (c != conn_)
+                    return;
+                LOG4CXX_WARN(logger_def, "Subscriber " << alias() << " error " << ec.what());
+                conn_.reset();
+                ready_ = false;
+                inflight_.clear();
+                if (closed_ || ids_.empty())
+                    return;
+                ++reconnect_attempt_;
+                reconnect_scheduled_ = true;
+                auto delay = reconnect_delay(co_, reconnect_attempt_, random_());
+                LOG4CXX_INFO(logger_def, "Reconnect " << alias() << " subscriber in "
+                                                      << delay.count() << "ms, attempt "
+                                                      << reconnect_attempt_);
+                reconnect_timer_.expires_after(delay);
+                reconnect_timer_.async_wait([self](asio_config::error_code ec) {
+                    if (ec)
+                        return;
+                    auto &impl = *self->pimpl_;
+                    impl.reconnect_scheduled_ = false;
+                    if (!impl.ids_.empty())
+                        impl.connect(self);
+                });
+            }
+            void close() {
+                closed_ = true;
+                reconnect_timer_.cancel();
+                ready_ = false;
+                inflight_.clear();
+                ids_.clear();
+                for (auto &channels : tables_)
+                    channels.clear();
+                if (conn_)
+                    conn_->terminate();
+            }
+            //@}
+        };
+
+        subscriber::subscriber_ptr subscriber::create(io_service_ptr service,
+                                                      connection_options const &co) {
+            return subscriber_ptr(new subscriber(std::move(service), co));
+        }
+
+        subscriber::subscriber(io_service_ptr service, connection_options const &co)
+            : pimpl_(new impl(std::move(service), co)) {
+        }
+
+        subscriber::~subscriber() = default;
+
+        rdalias const &subscriber::alias() const {
+            return pimpl_->alias();
+        }
+
+        subscription_id subscriber::subscribe(subscription_kind kind, std::string channel,
+                                              message_callback &&handler, error_callback &&err) {
+            auto id = pimpl_->next_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+            auto self = shared_from_this();
+            // Posted, so that a handler can subscribe and unsubscribe while the
+            // handlers of its channel are being called
+            pimpl_->service_->post([self, id, kind, channel = std::move(channel),
+                                    handler = std::move(handler), err = std::move(err)]() mutable {
+                self->pimpl_->add({id, std::move(handler), std::move(err)}, kind,
+                                  std::move(channel), self);
+            });
+            return id;
+        }
+
+        void subscriber::unsubscribe(subscription_id id) {
+            auto self = shared_from_this();
+            pimpl_->service_->post([self, id]() { self->pimpl_->remove(id); });
+        }
+
+        void subscriber::close() {
+            auto self = shared_from_this();
+            pimpl_->service_->dispatch([self]() { self->pimpl_->close(); });
+        }
+
+    } // namespace details
+} // namespace redis_async
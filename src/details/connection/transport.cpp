@@ -2,15 +2,40 @@
 // Created by niko on 26.05.2021.
 //
 
+#include <redis_async/details/connection/base_connection.hpp>
 #include <redis_async/details/connection/transport.hpp>
 #include <redis_async/error.hpp>
 
-#include <boost/asio/connect.hpp>
+#include <boost/asio/error.hpp>
 #include <boost/bind.hpp>
 
+#include <algorithm>
+#include <netinet/tcp.h>
+
 namespace redis_async {
     namespace details {
 
+        namespace {
+            template <int Name>
+            using tcp_option = boost::asio::detail::socket_option::integer<IPPROTO_TCP, Name>;
+
+            /** A socket option that cannot be set is not worth dropping the connection */
+            template <typename Option>
+            void set_socket_option(tcp_transport::socket_type &socket, const Option &option,
+                                   const char *name) {
+                tcp_transport::error_code ec;
+                socket.set_option(option, ec);
+                if (ec)
+                    LOG4CXX_WARN(logger_def, "Cannot set " << name << ": " << ec.message());
+            }
+
+            /** Whole seconds the kernel takes, at least one */
+            int to_seconds(std::chrono::milliseconds ms) {
+                auto sec = std::chrono::duration_cast<std::chrono::seconds>(ms).count();
+                return static_cast<int>(std::max<decltype(sec)>(sec, 1));
+            }
+        } // namespace
+
         //****************************************************************************
         // tcp_layer
         tcp_transport::tcp_transport(const io_service_ptr &service)
@@ -25,6 +50,7 @@ namespace redis_async {
             if (conn.schema != "tcp") {
                 throw error::connection_error("Wrong connection schema for TCP transport");
             }
+            options_ = conn;
             std::string host = conn.uri;
             std::string svc = "6379";
             std::string::size_type pos = conn.uri.find(':');
@@ -42,16 +68,87 @@ namespace redis_async {
                                            tcp::resolver::iterator endpoint_iterator,
                                            const connect_callback &cb) {
             if (!ec) {
-                boost::asio::async_connect(
-                    socket, std::move(endpoint_iterator),
-                    boost::bind(&tcp_transport::handle_connect, this, _1, cb));
+                connect_next(std::move(endpoint_iterator), ec, cb);
+            } else {
+                cb(ec);
+            }
+        }
+
+        void tcp_transport::connect_next(tcp::resolver::iterator endpoint_iterator,
+                                         error_code ec, const connect_callback &cb) {
+            if (endpoint_iterator == tcp::resolver::iterator()) {
+                cb(ec ? ec : boost::asio::error::not_found);
+                return;
+            }
+            // The window scale is fixed by the SYN, so the buffers go before connect
+            auto endpoint = endpoint_iterator->endpoint();
+            error_code open_ec;
+            socket.close(open_ec);
+            socket.open(endpoint.protocol(), open_ec);
+            if (open_ec)
+                return connect_next(++endpoint_iterator, open_ec, cb);
+            apply_buffer_sizes();
+            socket.async_connect(endpoint, boost::bind(&tcp_transport::handle_connect, this, _1,
+                                                       endpoint_iterator, cb));
+        }
+
+        void tcp_transport::handle_connect(redis_async::details::tcp_transport::error_code ec,
+                                           tcp::resolver::iterator endpoint_iterator,
+                                           const connect_callback &cb) {
+            if (ec == boost::asio::error::operation_aborted) {
+                cb(ec);
+            } else if (ec) {
+                connect_next(++endpoint_iterator, ec, cb);
             } else {
+                apply_options();
                 cb(ec);
             }
         }
 
-        void tcp_transport::handle_connect(redis_async::details::tcp_transport::error_code ec, const connect_callback &cb) {
-            cb(ec);
+        void tcp_transport::apply_buffer_sizes() {
+            using boost::asio::socket_base;
+            if (options_.recv_buffer_size)
+                set_socket_option(
+                    socket,
+                    socket_base::receive_buffer_size(static_cast<int>(options_.recv_buffer_size)),
+                    "SO_RCVBUF");
+            if (options_.send_buffer_size)
+                set_socket_option(
+                    socket, socket_base::send_buffer_size(static_cast<int>(options_.send_buffer_size)),
+                    "SO_SNDBUF");
+        }
+
+        void tcp_transport::apply_options() {
+            using boost::asio::socket_base;
+            set_socket_option(socket, tcp::no_delay(options_.tcp_nodelay), "TCP_NODELAY");
+            if (options_.keep_alive) {
+                set_socket_option(socket, socket_base::keep_alive(true), "SO_KEEPALIVE");
+#ifdef TCP_KEEPIDLE
+                if (options_.keep_alive_idle.count())
+                    set_socket_option(socket,
+                                      tcp_option<TCP_KEEPIDLE>(to_seconds(options_.keep_alive_idle)),
+                                      "TCP_KEEPIDLE");
+#endif
+#ifdef TCP_KEEPINTVL
+                if (options_.keep_alive_interval.count())
+                    set_socket_option(
+                        socket, tcp_option<TCP_KEEPINTVL>(to_seconds(options_.keep_alive_interval)),
+                        "TCP_KEEPINTVL");
+#endif
+#ifdef TCP_KEEPCNT
+                if (options_.keep_alive_count)
+                    set_socket_option(
+                        socket, tcp_option<TCP_KEEPCNT>(static_cast<int>(options_.keep_alive_count)),
+                        "TCP_KEEPCNT");
+#endif
+            }
+        }
+
+        void tcp_transport::set_quick_ack() {
+#ifdef TCP_QUICKACK
+            if (socket.is_open())
+                set_socket_option(socket, tcp_option<TCP_QUICKACK>(1), "TCP_QUICKACK");
+#endif
         }
 
         bool tcp_transport::connected() const {
@@ -59,6 +156,7 @@ namespace redis_async {
         }
 
         void tcp_transport::close() {
+            resolver_.cancel();
             if (socket.is_open())
                 socket.close();
         }
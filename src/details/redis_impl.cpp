@@ -2,17 +2,30 @@
 // Created by niko on 10.06.2021.
 //
 
+#include <redis_async/details/client_cache.hpp>
+#include <redis_async/details/cluster.hpp>
 #include <redis_async/details/connection/base_connection.hpp>
 #include <redis_async/details/connection/connection_pool.hpp>
+#include <redis_async/details/connection/subscriber.hpp>
 #include <redis_async/details/redis_impl.hpp>
 
+#include <algorithm>
+#include <limits>
+#include <thread>
 #include <utility>
 
 namespace redis_async {
     namespace details {
 
+        namespace {
+            constexpr size_t no_shard = std::numeric_limits<size_t>::max();
+            /** Shard of the event loop running on the thread */
+            thread_local size_t local_shard = no_shard;
+        } // namespace
+
         redis_impl::redis_impl(size_t pool_size)
-            : service_(std::make_shared<asio_config::io_service>())
+            : services_{std::make_shared<asio_config::io_service>()}
+            , next_shard_(0)
             , pool_size_(pool_size)
             , state_(running) {
             LOG4CXX_TRACE(logger_def, "Initializing rd_service db service");
@@ -26,6 +39,16 @@ namespace redis_async {
             pool_size_ = pool_size;
         }
 
+        void redis_impl::set_threads(size_t threads) {
+            if (threads == 0)
+                throw error::client_error("Number of event loop threads cannot be zero");
+            if (!connections_.empty())
+                throw error::client_error("Event loop threads must be set before connections");
+            while (services_.size() < threads)
+                services_.push_back(std::make_shared<asio_config::io_service>());
+            services_.resize(threads);
+        }
+
         void redis_impl::add_connection(const std::string &connection_string,
                                         optional_size pool_size) {
             if (state_ != running)
@@ -48,58 +71,256 @@ namespace redis_async {
             add_pool(options, std::move(pool_size));
         }
 
-        void redis_impl::get_connection(rdalias &&alias, command_wrapper_t &&cmd,
-                                        query_result_callback &&conn_cb, error_callback &&err) {
+        bool redis_impl::get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                        query_result_callback &&conn_cb, error_callback &&err,
+                                        std::chrono::milliseconds timeout, admission adm) {
+            auto shard = next_shard() % services_.size();
+            auto cache = caches_.find(alias);
+            auto *single = std::get_if<single_command_t>(&cmd);
+            if (cache == caches_.end() || !single || !client_cache::cacheable(*single))
+                return submit(alias, shard, std::move(cmd), std::move(conn_cb), std::move(err),
+                              timeout, adm);
+
+            auto &cached = cache->second;
+            result_t value;
+            if (cached->lookup(*single, value)) {
+                // Answered without the server, still from an event loop as usual
+                services_[shard]->post([value = std::move(value), conn_cb = std::move(conn_cb),
+                                        err = std::move(err)]() mutable {
+                    deliver_result(0, conn_cb, err, std::move(value));
+                });
+                return true;
+            }
+            auto fill = cached->start_fill(*single);
+            auto submitted = submit(
+                alias, shard, std::move(cmd),
+                query_result_callback{[cached, fill, conn_cb = std::move(conn_cb)](result_t res) {
+                    cached->complete_fill(fill, &res);
+                    conn_cb(std::move(res));
+                }},
+                [cached, fill, err = std::move(err)](error::rd_error const &e) {
+                    cached->complete_fill(fill, nullptr);
+                    if (err)
+                        err(e);
+                },
+                timeout, adm);
+            if (!submitted)
+                cached->complete_fill(fill, nullptr);
+            return submitted;
+        }
+
+        bool redis_impl::get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                        reply_view_callback &&conn_cb, error_callback &&err,
+                                        std::chrono::milliseconds timeout, admission adm) {
+            return submit(alias, next_shard(), std::move(cmd), std::move(conn_cb), std::move(err),
+                          timeout, adm);
+        }
+
+        bool redis_impl::get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                        flat_reply_callback &&conn_cb, error_callback &&err,
+                                        std::chrono::milliseconds timeout, admission adm) {
+            return submit(alias, next_shard(), std::move(cmd), std::move(conn_cb), std::move(err),
+                          timeout, adm);
+        }
+
+        bool redis_impl::get_connection(rdalias &&alias, command_wrapper_t &&cmd,
+                                        reply_decoder_ptr &&decoder, error_callback &&err,
+                                        std::chrono::milliseconds timeout, admission adm) {
+            return submit(alias, next_shard(), std::move(cmd), std::move(decoder), std::move(err),
+                          timeout, adm);
+        }
+
+        template <typename Callback>
+        bool redis_impl::submit(rdalias const &alias, size_t shard, command_wrapper_t &&cmd,
+                                Callback &&conn_cb, error_callback &&err,
+                                std::chrono::milliseconds timeout, admission adm) {
+            if (auto c = get_cluster(alias))
+                return c->get_connection(shard, std::move(cmd), std::forward<Callback>(conn_cb),
+                                         std::move(err), timeout, adm);
+            auto &pools = get_pools(alias);
+            return pools[shard % pools.size()]->get_connection(
+                std::move(cmd), std::forward<Callback>(conn_cb), std::move(err), timeout, adm);
+        }
+
+        size_t redis_impl::queue_depth(rdalias const &alias) {
+            size_t depth = 0;
+            for (auto &pool : alias_pools(alias))
+                depth += pool->queue_depth();
+            return depth;
+        }
+
+        size_t redis_impl::queue_bytes(rdalias const &alias) {
+            size_t bytes = 0;
+            for (auto &pool : alias_pools(alias))
+                bytes += pool->queue_bytes();
+            return bytes;
+        }
+
+        cache_stats_t redis_impl::cache_stats(rdalias const &alias) {
+            auto cache = caches_.find(alias);
+            if (cache != caches_.end())
+                return cache->second->stats();
+            alias_pools(alias); // Throws if the alias is not registered
+            return {};
+        }
+
+        subscription_id redis_impl::subscribe(rdalias const &alias, subscription_kind kind,
+                                              std::string channel, message_callback &&handler,
+                                              error_callback &&err) {
+            // The subscriber is connected to the seed node, not to the node of the shard channel
+            if (kind == subscription_kind::shard_channel && clusters_.count(alias))
+                throw error::client_error("Shard channels of cluster alias '" + alias +
+                                          "' are not supported");
+            return get_subscriber(alias)->subscribe(kind, std::move(channel), std::move(handler),
+                                                    std::move(err));
+        }
+
+        void redis_impl::unsubscribe(rdalias const &alias, subscription_id id) {
+            get_subscriber(alias)->unsubscribe(id);
+        }
+
+        redis_impl::subscriber_ptr const &redis_impl::get_subscriber(rdalias const &alias) {
             if (state_ != running)
                 throw error::connection_error("Database service is not running");
 
-            if (!connections_.count(alias)) {
+            auto sub = subscribers_.find(alias);
+            if (sub == subscribers_.end()) {
                 throw error::connection_error("Database alias '" + alias + "' is not registered");
             }
-            connection_pool_ptr pool = connections_[alias];
-            pool->get_connection(std::move(cmd), std::move(conn_cb), std::move(err));
+            return sub->second;
+        }
+
+        redis_impl::shard_pools const &redis_impl::get_pools(rdalias const &alias) {
+            if (state_ != running)
+                throw error::connection_error("Database service is not running");
+
+            auto pool = connections_.find(alias);
+            if (pool == connections_.end()) {
+                throw error::connection_error("Database alias '" + alias + "' is not registered");
+            }
+            return pool->second;
+        }
+
+        redis_impl::shard_pools redis_impl::alias_pools(rdalias const &alias) {
+            if (auto c = get_cluster(alias))
+                return c->pools();
+            return get_pools(alias);
+        }
+
+        redis_impl::cluster_ptr redis_impl::get_cluster(rdalias const &alias) {
+            auto found = clusters_.find(alias);
+            return found == clusters_.end() ? cluster_ptr{} : found->second;
+        }
+
+        size_t redis_impl::next_shard() {
+            // Stay on the event loop of the caller, spread the other callers
+            auto shard = local_shard;
+            if (shard == no_shard)
+                shard = next_shard_.fetch_add(1, std::memory_order_relaxed);
+            return shard;
         }
 
         void redis_impl::run() {
-            service_->run();
+            std::vector<std::thread> threads;
+            for (size_t shard = 1; shard < services_.size(); ++shard)
+                threads.emplace_back([this, shard] { run_shard(shard); });
+            run_shard(0);
+            for (auto &t : threads)
+                t.join();
+        }
+
+        void redis_impl::run_shard(size_t shard) {
+            local_shard = shard;
+            services_[shard]->run();
+            local_shard = no_shard;
         }
 
         void redis_impl::stop() {
             if (state_ == running) {
                 state_ = closing;
-                std::shared_ptr<size_t> pool_count = std::make_shared<size_t>(connections_.size());
-                asio_config::io_service_ptr svc = service_;
+                shard_pools pools;
+                for (auto &c : connections_)
+                    pools.insert(pools.end(), c.second.begin(), c.second.end());
+                for (auto &c : clusters_) {
+                    auto nodes = c.second->close();
+                    pools.insert(pools.end(), nodes.begin(), nodes.end());
+                }
+                auto pool_count = std::make_shared<std::atomic<size_t>>(pools.size());
+                auto services = services_;
 
-                for (auto &c : connections_) {
+                for (auto &pool : pools) {
                     // Pass a close callback. Call stop
                     // only when all connections are closed, may be with some timeout
-                    c.second->close([pool_count, svc]() {
-                        --(*pool_count);
-                        if (*pool_count == 0) {
-                            svc->stop();
+                    pool->close([pool_count, services]() {
+                        if (--(*pool_count) == 0) {
+                            for (auto &svc : services)
+                                svc->stop();
                         }
                     });
                 }
                 connections_.clear();
+                clusters_.clear();
+                caches_.clear();
+                for (auto &sub : subscribers_)
+                    sub.second->close();
+                subscribers_.clear();
             }
         }
 
-        redis_impl::connection_pool_ptr redis_impl::add_pool(const connection_options &co,
-                                                             optional_size pool_size) {
-            if (!connections_.count(co.alias)) {
-                if (!pool_size.is_initialized()) {
-                    pool_size = pool_size_;
-                }
-                LOG4CXX_INFO(logger_def,
-                             "Create a new connection pool " << co.alias << " size " << *pool_size);
-                LOG4CXX_INFO(logger_def, "Register new connection " << co.uri << "[" << co.database
-                                                                << "]"
-                                                                << " with alias " << co.alias);
-                connections_.insert(std::make_pair(
-                    co.alias,
-                    connection_pool_ptr(connection_pool::create(service_, *pool_size, co))));
+        void redis_impl::add_pool(connection_options co, optional_size pool_size) {
+            if (connections_.count(co.alias) || clusters_.count(co.alias))
+                return;
+            // Invalidation messages come as push frames of RESP3, whatever made the options
+            if (co.client_cache_size) {
+                if (co.protocol == 2)
+                    throw error::connection_error("client cache requires protocol 3");
+                co.protocol = 3;
+            }
+            if (!pool_size.is_initialized()) {
+                pool_size = co.max_connections ? co.max_connections : pool_size_;
             }
-            return connections_[co.alias];
+            LOG4CXX_INFO(logger_def,
+                         "Create a new connection pool " << co.alias << " size " << *pool_size);
+            LOG4CXX_INFO(logger_def, "Register new connection " << co.uri << "[" << co.database
+                                                            << "]"
+                                                            << " with alias " << co.alias);
+            client_cache_ptr cache;
+            if (co.client_cache_size) {
+                cache = std::make_shared<client_cache>(co.client_cache_size);
+                caches_.emplace(co.alias, cache);
+            }
+            // Connections are split between the shards, each has one at least
+            auto make_pools = [services = services_, size = *pool_size,
+                               cache](const connection_options &node_co) {
+                auto shards = services.size();
+                auto split = [shards](size_t count, size_t shard) {
+                    return count / shards + (shard < count % shards ? 1 : 0);
+                };
+                shard_pools pools;
+                for (size_t shard = 0; shard < shards; ++shard) {
+                    auto shard_co = node_co;
+                    shard_co.min_idle = split(node_co.min_idle, shard);
+                    if (node_co.max_queue_size)
+                        shard_co.max_queue_size =
+                            std::max<size_t>(split(node_co.max_queue_size, shard), 1);
+                    if (node_co.max_queue_bytes)
+                        shard_co.max_queue_bytes =
+                            std::max<size_t>(split(node_co.max_queue_bytes, shard), 1);
+                    auto shard_size = std::max<size_t>(split(size, shard), 1);
+                    pools.push_back(
+                        connection_pool::create(services[shard], shard_size, shard_co, cache));
+                }
+                return pools;
+            };
+            // Every node of a cluster gets pools of the same size
+            if (co.cluster)
+                clusters_.emplace(co.alias, cluster::create(co, std::move(make_pools)));
+            else
+                connections_.emplace(co.alias, make_pools(co));
+            // A subscribed connection cannot run CLIENT TRACKING, it keeps no cache
+            auto subscriber_co = co;
+            subscriber_co.client_cache_size = 0;
+            subscribers_.emplace(co.alias, subscriber::create(services_.front(), subscriber_co));
         }
 
     } // namespace details
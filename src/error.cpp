@@ -58,6 +58,38 @@ namespace redis_async {
             : rd_error(msg) {
         }
 
+        namespace {
+            std::string first_error(const std::vector<std::optional<query_error>> &errors) {
+                for (auto &e : errors)
+                    if (e)
+                        return e->what();
+                return "Batch failed";
+            }
+        } // namespace
+
+        batch_error::batch_error(std::vector<result_t> &&replies,
+                                 std::vector<std::optional<query_error>> &&errors)
+            : query_error(first_error(errors))
+            , replies(std::move(replies))
+            , errors(std::move(errors)) {
+        }
+
+        timeout_error::timeout_error(const std::string &msg)
+            : rd_error(msg) {
+        }
+
+        timeout_error::timeout_error(const char *msg)
+            : rd_error(msg) {
+        }
+
+        queue_full_error::queue_full_error(const std::string &msg)
+            : rd_error(msg) {
+        }
+
+        queue_full_error::queue_full_error(const char *msg)
+            : rd_error(msg) {
+        }
+
         client_error::client_error(const std::string &msg)
             : rd_error(msg) {
         }
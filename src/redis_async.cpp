@@ -30,6 +30,10 @@ namespace redis_async {
         impl()->add_connection(co, std::move(pool_size));
     }
 
+    void rd_service::set_threads(size_t threads) {
+        impl()->set_threads(threads);
+    }
+
     void rd_service::run() {
         impl()->run();
     }
@@ -50,9 +54,108 @@ namespace redis_async {
     }
 
     void rd_service::execute(rdalias &&alias, single_command_t &&cmd,
-                             query_result_callback &&result, error_callback &&error) {
+                             query_result_callback &&result, error_callback &&error,
+                             std::chrono::milliseconds timeout) {
+        impl()->get_connection(std::move(alias), std::move(cmd), std::move(result),
+                               std::move(error), timeout);
+    }
+
+    bool rd_service::try_execute(rdalias &&alias, single_command_t &&cmd,
+                                 query_result_callback &&result, error_callback &&error,
+                                 std::chrono::milliseconds timeout) {
+        return impl()->get_connection(std::move(alias), std::move(cmd), std::move(result),
+                                      std::move(error), timeout, details::admission::try_once);
+    }
+
+    size_t rd_service::queue_depth(rdalias const &alias) {
+        return impl()->queue_depth(alias);
+    }
+
+    size_t rd_service::queue_bytes(rdalias const &alias) {
+        return impl()->queue_bytes(alias);
+    }
+
+    cache_stats_t rd_service::cache_stats(rdalias const &alias) {
+        return impl()->cache_stats(alias);
+    }
+
+    void rd_service::execute_view(rdalias &&alias, single_command_t &&cmd,
+                                  reply_view_callback &&result, error_callback &&error,
+                                  std::chrono::milliseconds timeout) {
+        impl()->get_connection(std::move(alias), std::move(cmd), std::move(result),
+                               std::move(error), timeout);
+    }
+
+    void rd_service::execute_flat(rdalias &&alias, single_command_t &&cmd,
+                                  flat_reply_callback &&result, error_callback &&error,
+                                  std::chrono::milliseconds timeout) {
         impl()->get_connection(std::move(alias), std::move(cmd), std::move(result),
-                               std::move(error));
+                               std::move(error), timeout);
+    }
+
+    bool rd_service::execute_decoded(rdalias &&alias, single_command_t &&cmd,
+                                     reply_decoder_ptr &&decoder, error_callback &&error,
+                                     std::chrono::milliseconds timeout, details::admission adm) {
+        return impl()->get_connection(std::move(alias), std::move(cmd), std::move(decoder),
+                                      std::move(error), timeout, adm);
+    }
+
+    void rd_service::execute(rdalias &&alias, command_container_t &&cmds,
+                             batch_result_callback &&result, error_callback &&error,
+                             std::chrono::milliseconds timeout) {
+        if (cmds.empty())
+            throw error::client_error("Empty batch not allowed");
+        // Failed commands come with the replies to the others in a batch_error
+        auto deliver = [result = std::make_shared<batch_result_callback>(std::move(result))](
+                           std::vector<result_t> &&values,
+                           std::vector<std::optional<error::query_error>> &&errors) {
+            std::vector<batch_reply_t> replies(values.size());
+            for (size_t i = 0; i < values.size(); ++i) {
+                replies[i].value = std::move(values[i]);
+                if (i < errors.size())
+                    replies[i].error = std::move(errors[i]);
+            }
+            (*result)(std::move(replies));
+        };
+        impl()->get_connection(
+            std::move(alias), std::move(cmds),
+            [deliver](result_t res) {
+                deliver(std::move(std::get<array_holder_t>(res).elements), {});
+            },
+            [deliver, error = std::move(error)](error::rd_error const &e) {
+                auto *failed = dynamic_cast<error::batch_error const *>(&e);
+                if (!failed) {
+                    if (error)
+                        error(e);
+                    return;
+                }
+                auto values = failed->replies;
+                auto errors = failed->errors;
+                deliver(std::move(values), std::move(errors));
+            },
+            timeout);
+    }
+
+    subscription_id rd_service::subscribe(rdalias &&alias, std::string channel,
+                                          message_callback &&handler, error_callback &&error) {
+        return impl()->subscribe(alias, details::subscription_kind::channel, std::move(channel),
+                                 std::move(handler), std::move(error));
+    }
+
+    subscription_id rd_service::psubscribe(rdalias &&alias, std::string pattern,
+                                           message_callback &&handler, error_callback &&error) {
+        return impl()->subscribe(alias, details::subscription_kind::pattern, std::move(pattern),
+                                 std::move(handler), std::move(error));
+    }
+
+    subscription_id rd_service::ssubscribe(rdalias &&alias, std::string channel,
+                                           message_callback &&handler, error_callback &&error) {
+        return impl()->subscribe(alias, details::subscription_kind::shard_channel,
+                                 std::move(channel), std::move(handler), std::move(error));
+    }
+
+    void rd_service::unsubscribe(rdalias &&alias, subscription_id id) {
+        impl()->unsubscribe(alias, id);
     }
 
     rd_service::pimpl &rd_service::impl_ptr() {
@@ -0,0 +1,159 @@
+//
+// Created by niko on 14.10.2021.
+//
+
+#ifndef REDIS_ASYNC_FAKE_NODE_HPP
+#define REDIS_ASYNC_FAKE_NODE_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fake_node {
+
+    using command_t = std::vector<std::string>;
+    /** RESP reply to the command, nothing is sent for an empty one */
+    using handler_t = std::function<std::string(const command_t &)>;
+
+    inline std::string bulk(const std::string &str) {
+        return "$" + std::to_string(str.size()) + "\r\n" + str + "\r\n";
+    }
+    inline std::string integer(long long value) {
+        return ":" + std::to_string(value) + "\r\n";
+    }
+    inline std::string array(std::initializer_list<std::string> elements) {
+        std::string out = "*" + std::to_string(elements.size()) + "\r\n";
+        for (auto &e : elements)
+            out += e;
+        return out;
+    }
+
+    /**
+     * Redis node on the loopback, answering with the handler of the test. It
+     * runs on the io_service of the client, the commands are kept in the
+     * order they came with the arguments joined by spaces.
+     */
+    class FakeNode {
+        using tcp = boost::asio::ip::tcp;
+
+    public:
+        FakeNode(boost::asio::io_service &svc, handler_t handler)
+            : service_(svc)
+            , acceptor_(svc, tcp::endpoint{boost::asio::ip::address_v4::loopback(), 0})
+            , handler_(std::move(handler)) {
+            accept();
+        }
+
+        std::string address() const {
+            return "127.0.0.1:" + std::to_string(acceptor_.local_endpoint().port());
+        }
+        /** The commands received since the last call */
+        std::vector<std::string> take_received() {
+            return std::move(received_);
+        }
+
+        /** Replies are sent this long after the commands come */
+        std::chrono::milliseconds delay{0};
+
+    private:
+        struct session {
+            explicit session(boost::asio::io_service &svc)
+                : socket(svc)
+                , timer(svc) {
+            }
+            tcp::socket socket;
+            boost::asio::steady_timer timer;
+            std::array<char, 4096> buffer;
+            std::string incoming;
+            std::string outgoing;
+        };
+        using session_ptr = std::shared_ptr<session>;
+
+        void accept() {
+            auto s = std::make_shared<session>(service_);
+            acceptor_.async_accept(s->socket, [this, s](boost::system::error_code ec) {
+                if (ec)
+                    return;
+                read(s);
+                accept();
+            });
+        }
+
+        void read(const session_ptr &s) {
+            s->socket.async_read_some(boost::asio::buffer(s->buffer),
+                                      [this, s](boost::system::error_code ec, size_t size) {
+                                          if (ec)
+                                              return;
+                                          s->incoming.append(s->buffer.data(), size);
+                                          answer(s);
+                                      });
+        }
+
+        void answer(const session_ptr &s) {
+            command_t cmd;
+            while (parse(s->incoming, cmd)) {
+                std::string line;
+                for (auto &arg : cmd)
+                    line += (line.empty() ? "" : " ") + arg;
+                received_.push_back(line);
+                s->outgoing += handler_(cmd);
+            }
+            s->timer.expires_after(delay);
+            s->timer.async_wait([this, s](boost::system::error_code) { write(s); });
+        }
+
+        void write(const session_ptr &s) {
+            if (s->outgoing.empty())
+                return read(s);
+            auto out = std::make_shared<std::string>(std::move(s->outgoing));
+            s->outgoing.clear();
+            boost::asio::async_write(s->socket, boost::asio::buffer(*out),
+                                     [this, s, out](boost::system::error_code ec, size_t) {
+                                         if (!ec)
+                                             read(s);
+                                     });
+        }
+
+        /** Take a command, an array of bulk strings, off the front of the buffer */
+        static bool parse(std::string &in, command_t &cmd) {
+            size_t pos = 0;
+            auto number = [&in, &pos](long &value) {
+                auto end = in.find("\r\n", pos);
+                if (end == std::string::npos)
+                    return false;
+                value = std::stol(in.substr(pos + 1, end - pos - 1));
+                pos = end + 2;
+                return true;
+            };
+            long count = 0;
+            if (!number(count))
+                return false;
+            cmd.clear();
+            for (long i = 0; i < count; ++i) {
+                long size = 0;
+                if (!number(size) || in.size() < pos + size + 2)
+                    return false;
+                cmd.push_back(in.substr(pos, size));
+                pos += size + 2;
+            }
+            in.erase(0, pos);
+            return true;
+        }
+
+        boost::asio::io_service &service_;
+        tcp::acceptor acceptor_;
+        handler_t handler_;
+        std::vector<std::string> received_;
+    };
+
+} // namespace fake_node
+
+#endif // REDIS_ASYNC_FAKE_NODE_HPP
@@ -0,0 +1,155 @@
+//
+// Created by niko on 08.10.2021.
+//
+
+#include <gtest/gtest.h>
+
+#include <redis_async/details/client_cache.hpp>
+
+using redis_async::array_holder_t;
+using redis_async::nil_t;
+using redis_async::reply_view_t;
+using redis_async::result_t;
+using redis_async::single_command_t;
+using redis_async::string_t;
+using redis_async::view_array_t;
+using redis_async::details::client_cache;
+
+namespace {
+    /** Fill the cache with the reply to the command, read through the connection */
+    void fill(client_cache &cache, const single_command_t &cmd, const result_t &value,
+              const void *reader = nullptr) {
+        auto started = cache.start_fill(cmd);
+        cache.sent(cmd, reader);
+        cache.complete_fill(started, &value);
+    }
+
+    reply_view_t invalidate(std::initializer_list<std::string_view> keys) {
+        view_array_t frame;
+        frame.elements.emplace_back(std::string_view{"invalidate"});
+        view_array_t names;
+        for (auto key : keys)
+            names.elements.emplace_back(key);
+        frame.elements.emplace_back(std::move(names));
+        return {std::move(frame), {}};
+    }
+} // namespace
+
+TEST(ClientCacheTest, lookup) {
+    client_cache cache(1024 * 1024);
+    single_command_t get{"GET", "a"};
+    ASSERT_TRUE(client_cache::cacheable(get));
+    ASSERT_FALSE(client_cache::cacheable(single_command_t{"SET", "a", "1"}));
+
+    result_t value;
+    ASSERT_FALSE(cache.lookup(get, value));
+    fill(cache, get, string_t{"1"});
+    ASSERT_TRUE(cache.lookup(get, value));
+    ASSERT_EQ(std::get<string_t>(value), "1");
+
+    // Missing keys are cached too
+    single_command_t hget{"HGET", "h", "f"};
+    fill(cache, hget, nil_t{});
+    ASSERT_TRUE(cache.lookup(hget, value));
+    ASSERT_TRUE(std::holds_alternative<nil_t>(value));
+    ASSERT_FALSE(cache.lookup(single_command_t{"HGET", "h", "g"}, value));
+
+    // MGET is answered if all of its keys are cached, and fills them all
+    ASSERT_FALSE(cache.lookup(single_command_t{"MGET", "a", "b"}, value));
+    fill(cache, single_command_t{"MGET", "b", "c"},
+         array_holder_t{{string_t{"2"}, string_t{"3"}}});
+    ASSERT_TRUE(cache.lookup(single_command_t{"MGET", "a", "b", "c"}, value));
+    ASSERT_EQ(std::get<array_holder_t>(value).elements.size(), 3);
+    ASSERT_TRUE(cache.lookup(single_command_t{"GET", "c"}, value));
+    ASSERT_EQ(std::get<string_t>(value), "3");
+
+    // Errors are not cached
+    fill(cache, single_command_t{"GET", "d"}, result_t{});
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits, 4);
+    ASSERT_EQ(stats.misses, 3);
+    ASSERT_EQ(stats.entries, 4);
+}
+
+TEST(ClientCacheTest, invalidate) {
+    client_cache cache(1024 * 1024);
+    single_command_t get{"GET", "a"};
+    fill(cache, get, string_t{"1"});
+    fill(cache, single_command_t{"HGET", "h", "f"}, string_t{"v"});
+    cache.on_push(invalidate({"a", "h"}));
+    result_t value;
+    ASSERT_FALSE(cache.lookup(get, value));
+    ASSERT_FALSE(cache.lookup(single_command_t{"HGET", "h", "f"}, value));
+
+    // The key changed while the request was on its way, the reply is stale
+    auto stale = cache.start_fill(get);
+    cache.on_push(invalidate({"a"}));
+    result_t reply = string_t{"1"};
+    cache.complete_fill(stale, &reply);
+    ASSERT_FALSE(cache.lookup(get, value));
+
+    // A callback failing after the reply completes the fill again, it is ignored
+    auto first = cache.start_fill(get);
+    auto second = cache.start_fill(get);
+    cache.complete_fill(first, &reply);
+    cache.complete_fill(first, nullptr);
+    cache.on_push(invalidate({"a"}));
+    cache.complete_fill(second, &reply);
+    ASSERT_FALSE(cache.lookup(get, value));
+
+    // Flushed database
+    fill(cache, get, string_t{"2"});
+    view_array_t flushed;
+    flushed.elements.emplace_back(std::string_view{"invalidate"});
+    flushed.elements.emplace_back(nil_t{});
+    cache.on_push({std::move(flushed), {}});
+    ASSERT_FALSE(cache.lookup(get, value));
+    ASSERT_EQ(cache.stats().invalidations, 4);
+    ASSERT_EQ(cache.stats().bytes, 0);
+}
+
+TEST(ClientCacheTest, forget_reader) {
+    client_cache cache(1024 * 1024);
+    int first = 0, second = 0;
+    fill(cache, single_command_t{"GET", "a"}, string_t{"1"}, &first);
+    fill(cache, single_command_t{"MGET", "b", "c"},
+         array_holder_t{{string_t{"2"}, string_t{"3"}}}, &second);
+    // Read through both, the first one closing is enough to lose the tracking
+    fill(cache, single_command_t{"HGET", "h", "f"}, string_t{"v"}, &second);
+    fill(cache, single_command_t{"HGET", "h", "g"}, string_t{"w"}, &first);
+
+    // The closed connection had a request on its way, the reply is not tracked
+    single_command_t get_d{"GET", "d"};
+    auto pending = cache.start_fill(get_d);
+    cache.sent(get_d, &first);
+
+    cache.forget_reader(&first);
+    result_t value;
+    ASSERT_FALSE(cache.lookup(single_command_t{"GET", "a"}, value));
+    ASSERT_FALSE(cache.lookup(single_command_t{"HGET", "h", "f"}, value));
+    ASSERT_TRUE(cache.lookup(single_command_t{"MGET", "b", "c"}, value));
+    result_t reply = string_t{"4"};
+    cache.complete_fill(pending, &reply);
+    ASSERT_FALSE(cache.lookup(get_d, value));
+    ASSERT_EQ(cache.stats().invalidations, 2);
+}
+
+TEST(ClientCacheTest, evict) {
+    // Room for two keys with their values
+    client_cache cache(2 * (96 + 1 + 100));
+    std::string value(100, 'x');
+    fill(cache, single_command_t{"GET", "a"}, value);
+    fill(cache, single_command_t{"GET", "b"}, value);
+    result_t cached;
+    // The least recently used one goes first
+    ASSERT_TRUE(cache.lookup(single_command_t{"GET", "a"}, cached));
+    fill(cache, single_command_t{"GET", "c"}, value);
+    ASSERT_TRUE(cache.lookup(single_command_t{"GET", "a"}, cached));
+    ASSERT_FALSE(cache.lookup(single_command_t{"GET", "b"}, cached));
+    ASSERT_TRUE(cache.lookup(single_command_t{"GET", "c"}, cached));
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.evictions, 1);
+    ASSERT_EQ(stats.entries, 2);
+    ASSERT_LE(stats.bytes, 2 * (96 + 1 + 100));
+}
@@ -0,0 +1,341 @@
+//
+// Created by niko on 11.10.2021.
+//
+
+#include <gtest/gtest.h>
+
+#include <optional>
+
+#include <redis_async/details/cluster.hpp>
+#include <redis_async/details/connection/connection_pool.hpp>
+
+#include "fake_node.hpp"
+
+namespace asio_config = redis_async::asio_config;
+namespace error = redis_async::error;
+namespace fn = fake_node;
+
+using redis_async::result_t;
+using redis_async::single_command_t;
+using redis_async::string_t;
+using redis_async::details::cluster;
+using redis_async::details::command_key;
+using redis_async::details::key_slot;
+using redis_async::details::split_by_slot;
+
+TEST(ClusterTest, key_slot) {
+    // CRC16 check value of the XMODEM variant
+    ASSERT_EQ(key_slot("123456789"), 0x31c3);
+    ASSERT_EQ(key_slot("foo"), 12182);
+    ASSERT_EQ(key_slot("bar"), 5061);
+
+    // Only the hash tag counts
+    ASSERT_EQ(key_slot("{user1000}.following"), key_slot("{user1000}.followers"));
+    ASSERT_EQ(key_slot("{user1000}.following"), key_slot("user1000"));
+    ASSERT_EQ(key_slot("foo{{bar}}zap"), key_slot("{bar"));
+    // An empty tag is not a tag
+    ASSERT_EQ(key_slot("foo{}{bar}"), 8363);
+}
+
+TEST(ClusterTest, command_key) {
+    ASSERT_EQ(command_key(single_command_t{"GET", "foo"}), "foo");
+    ASSERT_EQ(command_key(single_command_t{"hset", "h", "f", "v"}), "h");
+    ASSERT_FALSE(command_key(single_command_t{"PING"}));
+    ASSERT_FALSE(command_key(single_command_t{"ping", "hello"}));
+    ASSERT_EQ(command_key(single_command_t{"BITOP", "AND", "dest", "a", "b"}), "dest");
+    ASSERT_EQ(command_key(single_command_t{"EVAL", "return 1", "1", "k"}), "k");
+    ASSERT_FALSE(command_key(single_command_t{"EVALSHA", "abc", "0"}));
+    ASSERT_EQ(command_key(single_command_t{"XREAD", "COUNT", "2", "STREAMS", "s", "0"}), "s");
+}
+
+TEST(ClusterTest, split_by_slot) {
+    auto groups = split_by_slot(single_command_t{"MGET", "foo", "bar", "{foo}x"});
+    ASSERT_EQ(groups.size(), 2);
+    ASSERT_EQ(groups[0].command.arguments.size(), 3);
+    ASSERT_EQ(groups[0].command.arguments[0], "MGET");
+    ASSERT_EQ(groups[0].command.arguments[2], "{foo}x");
+    ASSERT_EQ(groups[0].positions, (std::vector<std::size_t>{0, 2}));
+    ASSERT_EQ(groups[1].command.arguments[1], "bar");
+    ASSERT_EQ(groups[1].positions, std::vector<std::size_t>{1});
+
+    // Keys of one slot are not split
+    ASSERT_EQ(split_by_slot(single_command_t{"del", "{a}1", "{a}2"}).size(), 1);
+    ASSERT_TRUE(split_by_slot(single_command_t{"GET", "foo"}).empty());
+    ASSERT_TRUE(split_by_slot(single_command_t{"MSET", "foo", "1", "bar", "2"}).empty());
+}
+
+namespace {
+    /** A cluster of fake nodes, on one io_service with the pools of its alias */
+    struct ClusterFixture {
+        asio_config::io_service_ptr service{new asio_config::io_service};
+
+        cluster::cluster_ptr connect(const fn::FakeNode &seed) {
+            auto co = redis_async::connection_options::parse("main=tcp://" + seed.address() +
+                                                             "?cluster=true");
+            auto svc = service;
+            return cluster::create(co, [svc](redis_async::connection_options const &node_co) {
+                return cluster::shard_pools{
+                    redis_async::details::connection_pool::create(svc, 1, node_co)};
+            });
+        }
+
+        /** Run the io_service until the condition holds, for the limit at most */
+        bool run_until(const std::function<bool()> &done,
+                       std::chrono::milliseconds limit = std::chrono::seconds{5}) {
+            auto until = std::chrono::steady_clock::now() + limit;
+            while (!done() && std::chrono::steady_clock::now() < until) {
+                service->restart();
+                service->run_for(std::chrono::milliseconds{10});
+            }
+            return done();
+        }
+
+        /** Send GET, the value or the error of the reply */
+        std::string get(const cluster::cluster_ptr &c, const std::string &key,
+                        std::chrono::milliseconds timeout = std::chrono::milliseconds{0}) {
+            std::string reply;
+            c->get_connection(
+                0, single_command_t{"GET", key},
+                [&reply](result_t res) { reply = std::get<string_t>(res); },
+                [&reply](error::rd_error const &e) { reply = std::string{"error "} + e.what(); },
+                timeout, redis_async::details::admission::reject);
+            run_until([&reply] { return !reply.empty(); });
+            return reply;
+        }
+    };
+
+    /** CLUSTER SLOTS reply of one range served by the node */
+    std::string slot_range(int start, int end, const std::string &host, const fn::FakeNode &node) {
+        auto address = node.address();
+        auto port = std::stoi(address.substr(address.find(':') + 1));
+        return fn::array({fn::integer(start), fn::integer(end),
+                          fn::array({fn::bulk(host), fn::integer(port), fn::bulk("id")})});
+    }
+
+    std::string moved(int slot, const fn::FakeNode &node) {
+        return "-MOVED " + std::to_string(slot) + " " + node.address() + "\r\n";
+    }
+} // namespace
+
+TEST(ClusterTest, slot_table) {
+    ClusterFixture f;
+    fn::FakeNode *b_ptr = nullptr;
+    fn::FakeNode a(*f.service, [&](const fn::command_t &cmd) {
+        if (cmd[0] == "CLUSTER")
+            // The empty host is the host of the node answering
+            return fn::array({slot_range(0, 8191, "", a),
+                              slot_range(8192, 16383, "127.0.0.1", *b_ptr)});
+        return cmd[0] == "GET" ? fn::bulk("a") : std::string{"+OK\r\n"};
+    });
+    fn::FakeNode b(*f.service, [](const fn::command_t &cmd) {
+        return cmd[0] == "GET" ? fn::bulk("b") : std::string{"+OK\r\n"};
+    });
+    b_ptr = &b;
+
+    auto c = f.connect(a);
+    ASSERT_TRUE(f.run_until([&c] { return !c->node_address(16383).empty(); }));
+    ASSERT_EQ(c->node_address(0), a.address());
+    ASSERT_EQ(c->node_address(8191), a.address());
+    ASSERT_EQ(c->node_address(8192), b.address());
+    ASSERT_EQ(c->node_address(16383), b.address());
+
+    // Commands go straight to the node of their slot
+    a.take_received();
+    ASSERT_EQ(f.get(c, "foo"), "b");
+    ASSERT_EQ(f.get(c, "bar"), "a");
+    ASSERT_EQ(a.take_received(), std::vector<std::string>{"GET bar"});
+    ASSERT_EQ(b.take_received(), std::vector<std::string>{"GET foo"});
+}
+
+TEST(ClusterTest, moved) {
+    ClusterFixture f;
+    fn::FakeNode *a_ptr = nullptr;
+    fn::FakeNode *b_ptr = nullptr;
+    bool resharded = false;
+    auto slots = [&]() {
+        if (!resharded)
+            return fn::array({slot_range(0, 16383, "127.0.0.1", *a_ptr)});
+        return fn::array({slot_range(0, 8191, "127.0.0.1", *a_ptr),
+                          slot_range(8192, 16383, "127.0.0.1", *b_ptr)});
+    };
+    fn::FakeNode a(*f.service, [&](const fn::command_t &cmd) {
+        if (cmd[0] == "CLUSTER")
+            return slots();
+        // foo has moved to the other node
+        resharded = true;
+        return moved(key_slot(cmd[1]), *b_ptr);
+    });
+    fn::FakeNode b(*f.service, [&](const fn::command_t &cmd) {
+        return cmd[0] == "CLUSTER" ? slots() : fn::bulk("b");
+    });
+    a_ptr = &a;
+    b_ptr = &b;
+
+    auto c = f.connect(a);
+    ASSERT_TRUE(f.run_until([&c] { return !c->node_address(0).empty(); }));
+    ASSERT_EQ(c->node_address(key_slot("foo")), a.address());
+    a.take_received();
+
+    ASSERT_EQ(f.get(c, "foo"), "b");
+    // The slot is moved at once, the table is read again from the node redirected to
+    ASSERT_EQ(c->node_address(key_slot("foo")), b.address());
+    ASSERT_TRUE(f.run_until([&] { return c->node_address(8192) == b.address(); }));
+    ASSERT_EQ(c->node_address(8191), a.address());
+    ASSERT_EQ(c->node_address(16383), b.address());
+    ASSERT_EQ(a.take_received(), std::vector<std::string>{"GET foo"});
+    ASSERT_EQ(b.take_received(), (std::vector<std::string>{"CLUSTER SLOTS", "GET foo"}));
+
+    ASSERT_EQ(f.get(c, "foo"), "b");
+    ASSERT_TRUE(a.take_received().empty());
+    ASSERT_EQ(b.take_received(), std::vector<std::string>{"GET foo"});
+}
+
+TEST(ClusterTest, ask) {
+    ClusterFixture f;
+    fn::FakeNode *b_ptr = nullptr;
+    fn::FakeNode a(*f.service, [&](const fn::command_t &cmd) {
+        if (cmd[0] == "CLUSTER")
+            return fn::array({slot_range(0, 16383, "127.0.0.1", a)});
+        if (cmd[1] == "migrating")
+            return "-ASK " + std::to_string(key_slot(cmd[1])) + " " + b_ptr->address() + "\r\n";
+        return fn::bulk("a");
+    });
+    bool asking = false;
+    fn::FakeNode b(*f.service, [&](const fn::command_t &cmd) {
+        if (cmd[0] == "ASKING") {
+            asking = true;
+            return std::string{"+OK\r\n"};
+        }
+        // Served only right after ASKING
+        auto reply = asking ? fn::bulk("b") : moved(key_slot(cmd[1]), a);
+        asking = false;
+        return reply;
+    });
+    b_ptr = &b;
+
+    auto c = f.connect(a);
+    ASSERT_TRUE(f.run_until([&c] { return !c->node_address(0).empty(); }));
+    a.take_received();
+
+    ASSERT_EQ(f.get(c, "migrating"), "b");
+    ASSERT_EQ(b.take_received(), (std::vector<std::string>{"ASKING", "GET migrating"}));
+    // ASK leaves the table as it is, the next request goes to the first node again
+    ASSERT_EQ(c->node_address(key_slot("migrating")), a.address());
+    ASSERT_EQ(f.get(c, "migrating"), "b");
+    ASSERT_EQ(a.take_received(), (std::vector<std::string>{"GET migrating", "GET migrating"}));
+}
+
+TEST(ClusterTest, redirect_deadline) {
+    ClusterFixture f;
+    fn::FakeNode *b_ptr = nullptr;
+    fn::FakeNode a(*f.service, [&](const fn::command_t &cmd) {
+        if (cmd[0] == "CLUSTER")
+            return fn::array({slot_range(0, 16383, "127.0.0.1", a)});
+        return moved(key_slot(cmd[1]), *b_ptr);
+    });
+    fn::FakeNode b(*f.service, [](const fn::command_t &) { return fn::bulk("b"); });
+    b_ptr = &b;
+
+    auto c = f.connect(a);
+    ASSERT_TRUE(f.run_until([&c] { return !c->node_address(0).empty(); }));
+    a.delay = std::chrono::milliseconds{150};
+    b.delay = std::chrono::milliseconds{150};
+
+    // The redirected request has the time left of its timeout, not all of it again
+    ASSERT_EQ(f.get(c, "foo", std::chrono::milliseconds{250}), "error Request timed out");
+    ASSERT_EQ(f.get(c, "bar", std::chrono::milliseconds{1000}), "b");
+}
+
+namespace {
+    /** Two nodes splitting the slots in halves, answering MGET and DEL for their keys */
+    struct SplitCluster : ClusterFixture {
+        static std::string values(const fn::command_t &cmd, const std::string &node) {
+            std::string out = "*" + std::to_string(cmd.size() - 1) + "\r\n";
+            for (size_t i = 1; i < cmd.size(); ++i)
+                out += fn::bulk(cmd[i] + "@" + node);
+            return out;
+        }
+
+        fn::handler_t handler(const std::string &name) {
+            return [this, name](const fn::command_t &cmd) {
+                if (cmd[0] == "CLUSTER")
+                    return fn::array({slot_range(0, 8191, "127.0.0.1", a),
+                                      slot_range(8192, 16383, "127.0.0.1", b)});
+                if (cmd[0] == "MGET")
+                    return values(cmd, name);
+                if (cmd[0] == "DEL" || (cmd[0] == "EXISTS" && name == "a"))
+                    return fn::integer(cmd.size() - 1);
+                return std::string{"-ERR failed\r\n"};
+            };
+        }
+
+        fn::FakeNode a{*service, handler("a")};
+        fn::FakeNode b{*service, handler("b")};
+        cluster::cluster_ptr c = connect(a);
+
+        SplitCluster() {
+            run_until([this] { return !c->node_address(0).empty(); });
+        }
+
+        /** Send the command, the reply or the error */
+        std::optional<result_t> execute(single_command_t &&cmd, std::string &error) {
+            std::optional<result_t> reply;
+            c->get_connection(
+                0, std::move(cmd), [&reply](result_t res) { reply = std::move(res); },
+                [&reply, &error](error::rd_error const &e) {
+                    // Called once whatever number of parts fails
+                    ASSERT_TRUE(error.empty());
+                    error = e.what();
+                },
+                std::chrono::milliseconds{0}, redis_async::details::admission::reject);
+            run_until([&] { return reply || !error.empty(); });
+            // Let the other parts come
+            run_until([] { return false; }, std::chrono::milliseconds{100});
+            return reply;
+        }
+    };
+} // namespace
+
+TEST(ClusterTest, merge_values) {
+    SplitCluster f;
+    std::string error;
+    // foo and {foo}x are served by b, bar by a
+    auto res = f.execute(single_command_t{"MGET", "foo", "bar", "{foo}x", "{bar}y"}, error);
+    ASSERT_TRUE(res) << error;
+    auto &values = std::get<redis_async::array_holder_t>(*res).elements;
+    ASSERT_EQ(values.size(), 4);
+    ASSERT_EQ(std::get<string_t>(values[0]), "foo@b");
+    ASSERT_EQ(std::get<string_t>(values[1]), "bar@a");
+    ASSERT_EQ(std::get<string_t>(values[2]), "{foo}x@b");
+    ASSERT_EQ(std::get<string_t>(values[3]), "{bar}y@a");
+    ASSERT_EQ(f.a.take_received().back(), "MGET bar {bar}y");
+    ASSERT_EQ(f.b.take_received().back(), "MGET foo {foo}x");
+}
+
+TEST(ClusterTest, merge_sum) {
+    SplitCluster f;
+    std::string error;
+    auto res = f.execute(single_command_t{"DEL", "foo", "bar", "{bar}z"}, error);
+    ASSERT_TRUE(res) << error;
+    ASSERT_EQ(std::get<redis_async::int_t>(*res), 3);
+}
+
+TEST(ClusterTest, merge_failed_part) {
+    SplitCluster f;
+    // The part on a is answered first, then the one on b fails
+    f.b.delay = std::chrono::milliseconds{50};
+    std::string error;
+    auto res = f.execute(single_command_t{"EXISTS", "bar", "foo"}, error);
+    ASSERT_FALSE(res);
+    ASSERT_EQ(error, "ERR failed");
+    ASSERT_EQ(f.a.take_received().back(), "EXISTS bar");
+    ASSERT_EQ(f.b.take_received().back(), "EXISTS foo");
+
+    // The part on b fails first, the reply of a comes to nothing
+    f.b.delay = std::chrono::milliseconds{0};
+    f.a.delay = std::chrono::milliseconds{50};
+    error.clear();
+    res = f.execute(single_command_t{"EXISTS", "bar", "foo"}, error);
+    ASSERT_FALSE(res);
+    ASSERT_EQ(error, "ERR failed");
+}
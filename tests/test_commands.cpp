@@ -5,8 +5,10 @@
 #include "redis_instance.hpp"
 
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <thread>
 
 namespace rt = redis_async::test::instance;
 
@@ -83,6 +85,246 @@ TEST(CommandsTest, echo) {
     rd_service::run();
 }
 
+TEST(CommandsTest, pipeline) {
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    const int count = 1000;
+    int received = 0;
+    for (int n = 0; n < count; ++n) {
+        rd_service::execute(
+            "tcp"_rd, cmd::echo(std::to_string(n)),
+            [&, n](const result_t &res) {
+                EXPECT_EQ(received, n);
+                EXPECT_EQ(std::to_string(n), std::get<redis_async::string_t>(res));
+                if (++received == count)
+                    inst.reset();
+            },
+            error_handler);
+    }
+
+    inst->run();
+    ASSERT_EQ(received, count);
+}
+
+TEST(CommandsTest, batch) {
+    using redis_async::batch_reply_t;
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace error = redis_async::error;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    const std::string key = "batch_key";
+    const std::string value = "batch_value";
+
+    rd_service::execute(
+        "tcp"_rd, {cmd::set(key, value), cmd::get(key), cmd::echo(value), cmd::del({key})},
+        [&](std::vector<batch_reply_t> res) {
+            ASSERT_EQ(4, res.size());
+            EXPECT_EQ("OK", std::get<redis_async::string_t>(res[0].value));
+            EXPECT_EQ(value, std::get<redis_async::string_t>(res[1].value));
+            EXPECT_EQ(value, std::get<redis_async::string_t>(res[2].value));
+            EXPECT_EQ(1, std::get<redis_async::int_t>(res[3].value));
+            for (auto &r : res)
+                EXPECT_FALSE(r.error);
+        },
+        error_handler);
+
+    rd_service::execute(
+        "tcp"_rd, {cmd::ping()},
+        [&](std::vector<batch_reply_t> res) {
+            ASSERT_EQ(1, res.size());
+            EXPECT_EQ("PONG", std::get<redis_async::string_t>(res[0].value));
+        },
+        error_handler);
+
+    // a failed command has its error, the others have their replies
+    rd_service::execute(
+        "tcp"_rd, {cmd::ping(), cmd::lset(key, 10, value), cmd::ping()},
+        [&](std::vector<batch_reply_t> res) {
+            ASSERT_EQ(3, res.size());
+            EXPECT_EQ("PONG", std::get<redis_async::string_t>(res[0].value));
+            ASSERT_TRUE(res[1].error);
+            EXPECT_TRUE(std::holds_alternative<redis_async::nil_t>(res[1].value));
+            EXPECT_FALSE(res[2].error);
+            EXPECT_EQ("PONG", std::get<redis_async::string_t>(res[2].value));
+        },
+        error_handler);
+
+    rd_service::execute(
+        "tcp"_rd, cmd::echo(value),
+        [&](const result_t &res) {
+            EXPECT_EQ(value, std::get<redis_async::string_t>(res));
+            inst.reset();
+        },
+        error_handler);
+
+    ASSERT_THROW(rd_service::execute(
+                     "tcp"_rd, redis_async::command_container_t{},
+                     [](std::vector<batch_reply_t>) {}, error_handler),
+                 error::client_error);
+
+    inst->run();
+}
+
+TEST(CommandsTest, view) {
+    using redis_async::rd_service;
+    using redis_async::reply_view_t;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    const std::string value(10000, 'v');
+    rd_service::execute(
+        "tcp"_rd, cmd::mset({{"view1", value}, {"view2", "value2"}}),
+        [&](const result_t &res) { EXPECT_EQ("OK", std::get<redis_async::string_t>(res)); },
+        error_handler);
+
+    // Views must stay valid after the buffer is reused by the next replies
+    auto kept = std::make_shared<std::vector<reply_view_t>>();
+    rd_service::execute_view(
+        "tcp"_rd, cmd::get("view1"), [kept](reply_view_t res) { kept->push_back(std::move(res)); },
+        error_handler);
+    rd_service::execute_view(
+        "tcp"_rd, cmd::mget({"view1", "view2", "view3"}),
+        [kept](reply_view_t res) { kept->push_back(std::move(res)); }, error_handler);
+    rd_service::execute(
+        "tcp"_rd, cmd::mget({"view1", "view2"}),
+        [&](const result_t &res) {
+            EXPECT_EQ(2, std::get<redis_async::array_holder_t>(res).elements.size());
+        },
+        error_handler);
+    rd_service::execute_view(
+        "tcp"_rd, cmd::echo("last"),
+        [&, kept](reply_view_t res) {
+            EXPECT_EQ("last", std::get<std::string_view>(res.value));
+            ASSERT_EQ(2, kept->size());
+            EXPECT_EQ(value, std::get<std::string_view>((*kept)[0].value));
+            auto &values = std::get<redis_async::view_array_t>((*kept)[1].value).elements;
+            ASSERT_EQ(3, values.size());
+            EXPECT_EQ(value, std::get<std::string_view>(values[0]));
+            EXPECT_EQ("value2", std::get<std::string_view>(values[1]));
+            EXPECT_TRUE(std::holds_alternative<redis_async::nil_t>(values[2]));
+            inst.reset();
+        },
+        error_handler);
+
+    rd_service::run();
+}
+
+TEST(CommandsTest, flat) {
+    using redis_async::flat_reply_t;
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    rd_service::execute(
+        "tcp"_rd, cmd::rpush("flat_list", {"a", "b", "c"}),
+        [&](const result_t &res) { EXPECT_EQ(3, std::get<redis_async::int_t>(res)); },
+        error_handler);
+
+    rd_service::execute_flat(
+        "tcp"_rd, cmd::lrange("flat_list", 0, -1),
+        [&](flat_reply_t res) {
+            ASSERT_EQ(4, res.size());
+            std::string joined;
+            for (auto item : res.root())
+                joined += item.string();
+            EXPECT_EQ("abc", joined);
+        },
+        error_handler);
+
+    rd_service::execute_flat(
+        "tcp"_rd, cmd::get("flat_list"),
+        [&](flat_reply_t) { ADD_FAILURE() << "GET of a list succeeded"; },
+        [](const redis_async::error::rd_error &err) {
+            EXPECT_NE(nullptr, dynamic_cast<const redis_async::error::query_error *>(&err));
+        });
+
+    rd_service::execute_flat(
+        "tcp"_rd, cmd::llen("flat_list"),
+        [&](flat_reply_t res) {
+            EXPECT_EQ(3, res.root().integer());
+            inst.reset();
+        },
+        error_handler);
+
+    rd_service::run();
+}
+
+TEST(CommandsTest, typed) {
+    using redis_async::int_t;
+    using redis_async::rd_service;
+    namespace cmd = redis_async::cmd;
+    namespace error = redis_async::error;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    rd_service::execute<int_t>(
+        "tcp"_rd, cmd::hset("typed_hash", {{"f1", "v1"}, {"f2", "v2"}}),
+        [](int_t added) { EXPECT_EQ(2, added); }, error_handler);
+
+    using fields_t = std::unordered_map<std::string, std::string>;
+    rd_service::execute<fields_t>(
+        "tcp"_rd, cmd::hgetall("typed_hash"),
+        [](fields_t fields) {
+            EXPECT_EQ(2, fields.size());
+            EXPECT_EQ("v1", fields["f1"]);
+            EXPECT_EQ("v2", fields["f2"]);
+        },
+        error_handler);
+
+    using values_t = std::vector<std::optional<std::string>>;
+    rd_service::execute<values_t>(
+        "tcp"_rd, cmd::hmget("typed_hash", {"f2", "f3"}),
+        [](values_t values) {
+            ASSERT_EQ(2, values.size());
+            EXPECT_EQ("v2", values[0]);
+            EXPECT_EQ(std::nullopt, values[1]);
+        },
+        error_handler);
+
+    // a reply which does not fit the type is reported, the next requests are not affected
+    rd_service::execute<int_t>(
+        "tcp"_rd, cmd::hkeys("typed_hash"), [](int_t) { ADD_FAILURE() << "Decoded an array"; },
+        [](const error::rd_error &err) {
+            EXPECT_NE(nullptr, dynamic_cast<const error::client_error *>(&err));
+        });
+
+    rd_service::execute<std::string>(
+        "tcp"_rd, cmd::echo("last"),
+        [&](std::string res) {
+            EXPECT_EQ("last", res);
+            inst.reset();
+        },
+        error_handler);
+
+    rd_service::run();
+}
+
 TEST(CommandsTest, set_get) {
     using redis_async::rd_service;
     using redis_async::result_t;
@@ -657,3 +899,188 @@ TEST(CommandsTest, hadnle_exceptions) {
 
     rd_service::run();
 }
+
+TEST(CommandsTest, threads) {
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+    constexpr int producers = 4;
+    constexpr int per_producer = 100;
+
+    rd_service::set_threads(4);
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 4);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    std::atomic<int> replies{0};
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < per_producer; ++i) {
+                rd_service::execute(
+                    "tcp"_rd, cmd::ping(),
+                    [&](const result_t &res) {
+                        EXPECT_EQ("PONG", std::get<redis_async::string_t>(res));
+                        if (++replies == producers * per_producer) {
+                            // the timers of the test live in the first event loop
+                            rd_service::io_service()->post([&] { inst.reset(); });
+                        }
+                    },
+                    error_handler);
+            }
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    inst->run();
+    EXPECT_EQ(replies, producers * per_producer);
+}
+
+TEST(CommandsTest, async_execute) {
+    using redis_async::rd_service;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+
+    rd_service::async_execute<std::string>(
+        "tcp"_rd, cmd::set("key", "value"), [](std::exception_ptr err, std::string res) {
+            EXPECT_FALSE(err);
+            EXPECT_EQ(res, "OK");
+        });
+    rd_service::async_execute<std::optional<std::string>>(
+        "tcp"_rd, cmd::get("no_key"),
+        [](std::exception_ptr err, std::optional<std::string> res) {
+            EXPECT_FALSE(err);
+            EXPECT_EQ(res, std::nullopt);
+        });
+    rd_service::async_execute<int>(
+        "tcp"_rd, cmd::get("key"), [&](std::exception_ptr err, int) {
+            EXPECT_THROW(std::rethrow_exception(err), redis_async::error::client_error);
+            inst.reset();
+        });
+
+    rd_service::run();
+}
+
+TEST(CommandsTest, pool_warm_up) {
+    using redis_async::rd_service;
+    using redis_async::result_t;
+
+    auto inst = std::make_unique<rt::Client>();
+    rd_service::add_connection("tcp=" + inst->getUri() + "?min_idle=3", 4);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    // the minimum of connections is opened before any request
+    inst->add_deadline_timer(boost::posix_time::milliseconds(300), [&](auto ec) {
+        if (ec)
+            return;
+        rd_service::execute(
+            "tcp"_rd, redis_async::single_command_t{"CLIENT", "LIST"},
+            [&](const result_t &res) {
+                auto list = std::get<redis_async::string_t>(res);
+                EXPECT_EQ(std::count(list.begin(), list.end(), '\n'), 3);
+                inst.reset();
+            },
+            error_handler);
+    });
+
+    rd_service::run();
+}
+
+TEST(CommandsTest, queue_limit) {
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    rd_service::add_connection("tcp=" + inst->getUri() + "?max_queue_size=2", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    // nothing is answered before run(), two requests fill the queue
+    std::vector<int> order;
+    for (int n = 0; n < 2; ++n)
+        rd_service::execute(
+            "tcp"_rd, cmd::ping(), [&order, n](const result_t &) { order.push_back(n); },
+            error_handler);
+    EXPECT_EQ(rd_service::queue_depth("tcp"_rd), 2);
+    EXPECT_EQ(rd_service::queue_bytes("tcp"_rd), 2 * std::string{"*1\r\n$4\r\nPING\r\n"}.size());
+
+    std::string rejected;
+    rd_service::execute(
+        "tcp"_rd, cmd::ping(), [](const result_t &) { FAIL() << "Request over the limit"; },
+        [&rejected](const redis_async::error::rd_error &e) { rejected = e.what(); });
+    EXPECT_EQ(rejected, "Request queue is full");
+    EXPECT_FALSE(rd_service::try_execute(
+        "tcp"_rd, cmd::ping(), [](const result_t &) { FAIL() << "Request over the limit"; },
+        error_handler));
+
+    // the asynchronous operation waits for room
+    rd_service::async_execute<std::string>(
+        "tcp"_rd, cmd::ping(), [&](std::exception_ptr err, std::string res) {
+            EXPECT_FALSE(err);
+            EXPECT_EQ(res, "PONG");
+            EXPECT_EQ(order, (std::vector<int>{0, 1}));
+            inst.reset();
+        });
+
+    rd_service::run();
+}
+
+TEST(CommandsTest, pubsub) {
+    using redis_async::pubsub_message_t;
+    using redis_async::rd_service;
+    using redis_async::result_t;
+    namespace cmd = redis_async::cmd;
+
+    auto inst = std::make_unique<rt::Client>();
+    inst->add_connection("tcp", 1);
+    inst->add_deadline_timer(boost::posix_time::seconds(5), on_time_expiry);
+    auto error_handler = std::bind(on_rd_error, boost::ref(inst), std::placeholders::_1);
+
+    // two handlers of a channel share one subscription on the server
+    std::vector<std::string> messages;
+    auto done = [&] {
+        if (messages.size() == 3)
+            inst.reset();
+    };
+    auto on_message = [&](const pubsub_message_t &msg) {
+        EXPECT_EQ(msg.channel, "news");
+        EXPECT_TRUE(msg.pattern.empty());
+        messages.emplace_back(msg.payload);
+        done();
+    };
+    rd_service::subscribe("tcp"_rd, "news", on_message, error_handler);
+    rd_service::subscribe("tcp"_rd, "news", on_message, error_handler);
+    rd_service::psubscribe(
+        "tcp"_rd, "ne*",
+        [&](const pubsub_message_t &msg) {
+            EXPECT_EQ(msg.pattern, "ne*");
+            EXPECT_EQ(msg.channel, "news");
+            messages.emplace_back(msg.payload);
+            done();
+        },
+        error_handler);
+    auto removed = rd_service::subscribe(
+        "tcp"_rd, "news", [](const pubsub_message_t &) { FAIL() << "Unsubscribed handler"; },
+        error_handler);
+    rd_service::unsubscribe("tcp"_rd, removed);
+
+    inst->add_deadline_timer(boost::posix_time::milliseconds(300), [&](auto ec) {
+        if (ec)
+            return;
+        // the channel and the pattern, the local handlers are not counted
+        rd_service::execute(
+            "tcp"_rd, cmd::publish("news", "hello"),
+            [](const result_t &res) { EXPECT_EQ(std::get<redis_async::int_t>(res), 2); },
+            error_handler);
+    });
+
+    rd_service::run();
+    EXPECT_EQ(messages, (std::vector<std::string>{"hello", "hello", "hello"}));
+}
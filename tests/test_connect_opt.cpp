@@ -219,3 +219,129 @@ TEST(ConnectOptTest, wrong_alias) {
     ASSERT_THROW(auto conn = "main=tcp://localhost:7432?socket_timeout=a10s"_redis, connection_error);
     ASSERT_THROW(auto conn = "main=tcp://localhost:7432?socket_timeout=10hour"_redis, connection_error);
 }
+
+TEST(ConnectOptTest, max_flush_size) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.max_flush_size, 256 * 1024);
+
+    conn = "main=tcp://192.168.0.10:6379?max_flush_size=1000"_redis;
+    ASSERT_EQ(conn.max_flush_size, 1000);
+    conn = "main=tcp://192.168.0.10:6379?max_flush_size=64k"_redis;
+    ASSERT_EQ(conn.max_flush_size, 64 * 1024);
+    conn = "main=tcp://192.168.0.10:6379?max_flush_size=1m"_redis;
+    ASSERT_EQ(conn.max_flush_size, 1024 * 1024);
+
+    ASSERT_THROW("main=tcp://192.168.0.10:6379?max_flush_size=1g"_redis,
+                 redis_async::error::connection_error);
+}
+
+TEST(ConnectOptTest, inline_completion) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.inline_completion, false);
+    conn = "main=tcp://192.168.0.10:6379?inline_completion=true"_redis;
+    ASSERT_EQ(conn.inline_completion, true);
+}
+
+TEST(ConnectOptTest, pool_sizing) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.max_connections, 0);
+    ASSERT_EQ(conn.min_idle, 0);
+    ASSERT_EQ(conn.idle_timeout, std::chrono::milliseconds(0));
+
+    conn = "main=tcp://192.168.0.10:6379?max_connections=16&min_idle=4&idle_timeout=30s"_redis;
+    ASSERT_EQ(conn.max_connections, 16);
+    ASSERT_EQ(conn.min_idle, 4);
+    ASSERT_EQ(conn.idle_timeout, std::chrono::seconds(30));
+
+    ASSERT_THROW("main=tcp://192.168.0.10:6379?min_idle=few"_redis,
+                 redis_async::error::connection_error);
+}
+
+TEST(ConnectOptTest, queue_limits) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.max_queue_size, 0);
+    ASSERT_EQ(conn.max_queue_bytes, 0);
+
+    conn = "main=tcp://192.168.0.10:6379?max_queue_size=1000&max_queue_bytes=16m"_redis;
+    ASSERT_EQ(conn.max_queue_size, 1000);
+    ASSERT_EQ(conn.max_queue_bytes, 16 * 1024 * 1024);
+}
+
+TEST(ConnectOptTest, tcp_tuning) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.tcp_nodelay, true);
+    ASSERT_EQ(conn.quick_ack, false);
+    ASSERT_EQ(conn.recv_buffer_size, 0);
+    ASSERT_EQ(conn.send_buffer_size, 0);
+
+    conn = "main=tcp://192.168.0.10:6379?tcp_nodelay=false&quick_ack=true"
+           "&recv_buffer_size=256k&send_buffer_size=1m"_redis;
+    ASSERT_EQ(conn.tcp_nodelay, false);
+    ASSERT_EQ(conn.quick_ack, true);
+    ASSERT_EQ(conn.recv_buffer_size, 256 * 1024);
+    ASSERT_EQ(conn.send_buffer_size, 1024 * 1024);
+
+    conn = "main=tcp://192.168.0.10:6379?keep_alive=true&keep_alive_idle=60s"
+           "&keep_alive_interval=10s&keep_alive_count=5"_redis;
+    ASSERT_EQ(conn.keep_alive, true);
+    ASSERT_EQ(conn.keep_alive_idle, std::chrono::seconds(60));
+    ASSERT_EQ(conn.keep_alive_interval, std::chrono::seconds(10));
+    ASSERT_EQ(conn.keep_alive_count, 5);
+}
+
+TEST(ConnectOptTest, reconnect) {
+    auto conn = "main=tcp://192.168.0.10:6379"_redis;
+    ASSERT_EQ(conn.reconnect_delay, std::chrono::milliseconds(100));
+    ASSERT_EQ(conn.max_reconnect_delay, std::chrono::seconds(10));
+    ASSERT_EQ(conn.replay_requests, false);
+
+    conn = "main=tcp://192.168.0.10:6379?reconnect_delay=50ms&max_reconnect_delay=2s"
+           "&replay_requests=true"_redis;
+    ASSERT_EQ(conn.reconnect_delay, std::chrono::milliseconds(50));
+    ASSERT_EQ(conn.max_reconnect_delay, std::chrono::seconds(2));
+    ASSERT_EQ(conn.replay_requests, true);
+}
+
+TEST(ConnectOptTest, setup) {
+    auto conn = "main=tcp://user:pass:word@localhost:6379/2?client_name=worker&protocol=2"_redis;
+    ASSERT_EQ(conn.user, "user");
+    ASSERT_EQ(conn.password, "pass:word");
+    ASSERT_EQ(conn.database, "2");
+    ASSERT_EQ(conn.client_name, "worker");
+    ASSERT_EQ(conn.protocol, 2);
+
+    conn = "main=tcp://localhost:6379"_redis;
+    ASSERT_EQ(conn.user, "");
+    ASSERT_EQ(conn.client_name, "");
+    ASSERT_EQ(conn.protocol, 0);
+
+    conn = "main=tcp://localhost:6379?protocol=3"_redis;
+    ASSERT_EQ(conn.protocol, 3);
+
+    using redis_async::error::connection_error;
+    ASSERT_THROW(auto conn = "main=tcp://localhost:6379?protocol=4"_redis, connection_error);
+}
+
+TEST(ConnectOptTest, client_cache) {
+    auto conn = "main=tcp://localhost:6379?client_cache_size=16m"_redis;
+    ASSERT_EQ(conn.client_cache_size, 16 * 1024 * 1024);
+    // Invalidation messages need RESP3
+    ASSERT_EQ(conn.protocol, 3);
+
+    conn = "main=tcp://localhost:6379"_redis;
+    ASSERT_EQ(conn.client_cache_size, 0);
+
+    using redis_async::error::connection_error;
+    ASSERT_THROW(auto conn = "main=tcp://localhost:6379?client_cache_size=1m&protocol=2"_redis,
+                 connection_error);
+}
+
+TEST(ConnectOptTest, cluster) {
+    auto conn = "main=tcp://localhost:7000?cluster=true"_redis;
+    ASSERT_TRUE(conn.cluster);
+    ASSERT_EQ(conn.uri, "localhost:7000");
+
+    using redis_async::error::connection_error;
+    ASSERT_THROW(auto conn = "main=tcp://localhost:7000/2?cluster=true"_redis, connection_error);
+    ASSERT_THROW(auto conn = "main=unix:///tmp/redis.sock?cluster=true"_redis, connection_error);
+}
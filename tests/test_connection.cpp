@@ -2,13 +2,17 @@
 // Created by niko on 10.06.2021.
 //
 
+#include <atomic>
 #include <boost/lexical_cast.hpp>
 #include <cstdlib>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <thread>
+#include <redis_async/details/connection/connection_pool.hpp>
 #include <redis_async/redis_async.hpp>
 
 #include "empty_port.hpp"
+#include "fake_node.hpp"
 #include "test_server.hpp"
 
 namespace ts = test_server;
@@ -89,3 +93,161 @@ TEST(ConnectionTest, conn_err) {
                  error::connection_error);
     rd_service::stop();
 }
+
+TEST(ConnectionTest, close_while_reconnecting) {
+    using redis_async::result_t;
+    namespace error = redis_async::error;
+    namespace cmd = redis_async::cmd;
+
+    // Nothing listens on the port, the pool waits to reconnect
+    auto port_str = boost::lexical_cast<std::string>(ep::get_random());
+    auto co = redis_async::connection_options::parse("main=tcp://localhost:" + port_str +
+                                                     "?reconnect_delay=10s");
+    auto service = std::make_shared<redis_async::asio_config::io_service>();
+    auto pool = redis_async::details::connection_pool::create(service, 1, co);
+
+    bool failed = false;
+    bool closed = false;
+    pool->get_connection(
+        cmd::ping(), [](const result_t &) { FAIL() << "No server to answer"; },
+        [&](const error::rd_error &err) {
+            ASSERT_NE(dynamic_cast<const error::connection_error *>(&err), nullptr);
+            failed = true;
+        });
+    boost::asio::steady_timer backoff(*service, std::chrono::milliseconds{200});
+    backoff.async_wait([&](const boost::system::error_code &) {
+        ASSERT_FALSE(failed);
+        pool->close([&]() { closed = true; });
+    });
+    service->run();
+    ASSERT_TRUE(failed);
+    ASSERT_TRUE(closed);
+}
+
+TEST(ConnectionTest, closed_pool_without_error_callback) {
+    auto port_str = boost::lexical_cast<std::string>(ep::get_random());
+    auto co = redis_async::connection_options::parse("main=tcp://localhost:" + port_str);
+    auto service = std::make_shared<redis_async::asio_config::io_service>();
+    auto pool = redis_async::details::connection_pool::create(service, 1, co);
+    pool->close([]() {});
+    service->run();
+
+    bool called = false;
+    ASSERT_NO_THROW(pool->get_connection(
+        redis_async::cmd::ping(), [&called](const redis_async::result_t &) { called = true; },
+        {}));
+    ASSERT_FALSE(called);
+}
+
+TEST(ConnectionTest, cluster_shard_channel) {
+    using redis_async::rd_service;
+    namespace error = redis_async::error;
+
+    // Nothing listens on the port, the subscription is refused before any connect
+    auto port_str = boost::lexical_cast<std::string>(ep::get_random());
+    rd_service::add_connection("cluster=tcp://localhost:" + port_str + "?cluster=true");
+    ASSERT_THROW(rd_service::ssubscribe(
+                     "cluster"_rd, "news", [](const redis_async::pubsub_message_t &) {},
+                     [](const error::rd_error &) {}),
+                 error::client_error);
+    rd_service::stop();
+}
+
+TEST(ConnectionTest, client_cache_options) {
+    using redis_async::rd_service;
+    namespace error = redis_async::error;
+
+    auto service = rd_service::io_service();
+    fake_node::FakeNode node(*service, [](const fake_node::command_t &) { return "+OK\r\n"; });
+    // The options are made without the connection string, the cache still gets RESP3
+    redis_async::connection_options co;
+    co.alias = "cached";
+    co.schema = "tcp";
+    co.uri = node.address();
+    co.client_cache_size = 1024 * 1024;
+    rd_service::add_connection(co, 1);
+    std::vector<std::string> received;
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (received.size() < 2 && std::chrono::steady_clock::now() < until) {
+        service->restart();
+        service->run_for(std::chrono::milliseconds{10});
+        for (auto &cmd : node.take_received())
+            received.push_back(cmd);
+    }
+    ASSERT_EQ(received, (std::vector<std::string>{"HELLO 3", "CLIENT TRACKING ON"}));
+
+    co.alias = "resp2";
+    co.protocol = 2;
+    ASSERT_THROW(rd_service::add_connection(co, 1), error::connection_error);
+    rd_service::stop();
+}
+
+TEST(ConnectionTest, queue_limit_contention) {
+    using redis_async::rd_service;
+    namespace cmd = redis_async::cmd;
+
+    auto service = rd_service::io_service();
+    fake_node::FakeNode node(*service, [](const fake_node::command_t &) { return "+OK\r\n"; });
+    // The loop is not run, the requests taken keep their places in the queue
+    constexpr size_t limit = 64;
+    auto submit = [](std::string alias) {
+        return rd_service::try_execute(redis_async::rdalias{alias}, cmd::get("key"),
+                                       [](const redis_async::result_t &) {}, {});
+    };
+    rd_service::add_connection("sizer=tcp://" + node.address(), 1);
+    ASSERT_TRUE(submit("sizer"));
+    auto size = rd_service::queue_bytes(redis_async::rdalias{"sizer"});
+    rd_service::add_connection("by_count=tcp://" + node.address() +
+                                   "?max_queue_size=" + std::to_string(limit),
+                               1);
+    rd_service::add_connection("by_bytes=tcp://" + node.address() +
+                                   "?max_queue_bytes=" + std::to_string(limit * size),
+                               1);
+
+    // Producers racing for the last places never turn away one that fits
+    for (std::string alias : {"by_count", "by_bytes"}) {
+        std::atomic<size_t> taken{0};
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 8; ++p) {
+            producers.emplace_back([&] {
+                for (size_t i = 0; i < limit; ++i) {
+                    if (submit(alias))
+                        ++taken;
+                }
+            });
+        }
+        for (auto &t : producers)
+            t.join();
+        ASSERT_EQ(taken, limit) << alias;
+        ASSERT_EQ(rd_service::queue_depth(redis_async::rdalias{alias}), limit) << alias;
+    }
+    rd_service::stop();
+}
+
+TEST(ConnectionTest, subscriber_stray_push) {
+    using redis_async::rd_service;
+    namespace error = redis_async::error;
+    using fake_node::array;
+    using fake_node::bulk;
+
+    auto service = rd_service::io_service();
+    // A frame that confirms nothing comes before the server rejects the subscription
+    fake_node::FakeNode node(*service, [](const fake_node::command_t &cmd) -> std::string {
+        if (cmd[0] == "SUBSCRIBE")
+            return array({bulk("pong"), bulk("")}) + "-ERR no subscriptions\r\n";
+        return "+OK\r\n";
+    });
+    rd_service::add_connection("stray=tcp://" + node.address(), 1);
+    bool rejected = false;
+    rd_service::subscribe(
+        redis_async::rdalias{"stray"}, "news",
+        [](const redis_async::pubsub_message_t &) { FAIL() << "No message was published"; },
+        [&rejected](const error::rd_error &) { rejected = true; });
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (!rejected && std::chrono::steady_clock::now() < until) {
+        service->restart();
+        service->run_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_TRUE(rejected);
+    rd_service::stop();
+}
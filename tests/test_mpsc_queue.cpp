@@ -0,0 +1,36 @@
+//
+// Created by niko on 20.09.2021.
+//
+
+#include <gtest/gtest.h>
+
+#include <redis_async/details/mpsc_queue.hpp>
+
+#include <thread>
+#include <vector>
+
+TEST(MpscQueueTest, producers) {
+    constexpr int producers = 4;
+    constexpr int per_producer = 10000;
+    redis_async::details::mpsc_queue<std::pair<int, int>> queue;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, p] {
+            for (int i = 0; i < per_producer; ++i)
+                queue.push({p, i});
+        });
+    }
+
+    // values of every producer are popped in the order they were pushed
+    std::vector<int> next(producers, 0);
+    for (int popped = 0; popped < producers * per_producer;) {
+        if (auto value = queue.pop()) {
+            ASSERT_EQ(value->second, next[value->first]++);
+            ++popped;
+        }
+    }
+    for (auto &t : threads)
+        t.join();
+    ASSERT_FALSE(queue.pop());
+}
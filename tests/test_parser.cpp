@@ -5,6 +5,8 @@
 #include <redis_async/details/protocol/serializer.hpp>
 
 #include <redis_async/details/protocol/parser.hpp>
+#include <redis_async/details/connection/recv_buffer.hpp>
+#include <redis_async/details/protocol/stream_parser.hpp>
 
 #include <boost/asio/buffers_iterator.hpp>
 #include <boost/asio/streambuf.hpp>
@@ -45,6 +47,39 @@ TEST(ParserTests, raw_cmd) {
     }
 }
 
+TEST(ParserTests, cmd_arguments) {
+    using redis_async::single_command_t;
+    using Buffer = std::vector<char>;
+    using Protocol = redis_async::details::Protocol;
+    namespace cmd = redis_async::cmd;
+
+    {
+        auto set = cmd::set("key", "value", std::chrono::milliseconds(1500));
+        std::vector<std::string_view> args{set.arguments.begin(), set.arguments.end()};
+        ASSERT_EQ(args, (std::vector<std::string_view>{"SET", "key", "value", "PX", "1500"}));
+        auto lrange = cmd::lrange("list", -100, 0);
+        ASSERT_EQ(lrange.arguments[2], "-100");
+        ASSERT_EQ(lrange.arguments[3], "0");
+    }
+    {
+        // arguments beyond the inline storage, copies own their bytes
+        const std::string big(1000, 'x');
+        single_command_t copy;
+        {
+            auto mset = cmd::mset({{"k1", big}, {"k2", big}, {"k3", ""}, {"k4", "v4"}, {"k5", big}});
+            copy = mset;
+        }
+        ASSERT_EQ(copy.arguments.size(), 11);
+        ASSERT_EQ(copy.arguments[2], big);
+        ASSERT_EQ(copy.arguments[6], "");
+        ASSERT_EQ(copy.arguments[10], big);
+        auto moved = std::move(copy);
+        Buffer result;
+        Protocol::serialize(result, moved);
+        ASSERT_EQ(result.size(), Protocol::command_size(moved));
+    }
+}
+
 TEST(ParserTests, simple_str) {
     using Buffer = boost::asio::streambuf;
     using Iterator = boost::asio::buffers_iterator<Buffer::const_buffers_type, char>;
@@ -258,7 +293,7 @@ TEST(ParserTests, wrong_introduction) {
     using Iterator = boost::asio::buffers_iterator<Buffer::const_buffers_type, char>;
     Buffer buff;
 
-    std::string answer = ",whats up\r\n";
+    std::string answer = "&whats up\r\n";
     std::ostream(&buff) << answer;
 
     auto data = buff.data();
@@ -637,3 +672,505 @@ TEST(ParserTests, array_wrong_data) {
     ASSERT_EQ(result.code, intr_error);
     buff.consume(buff.size());
 }
+
+namespace {
+    std::string dump_reply(const redis_async::details::parse_result_t &res) {
+        using redis_async::details::error_t;
+        using redis_async::details::positive_parse_result_t;
+        using redis_async::details::protocol_error_t;
+        std::ostringstream out;
+        if (auto *positive = std::get_if<positive_parse_result_t>(&res)) {
+            std::visit([&out](const auto &v) { out << v; }, positive->result);
+            out << '#' << positive->consumed;
+        } else if (auto *err = std::get_if<error_t>(&res)) {
+            out << "{ERROR_t}" << err->str << '#' << err->consumed;
+        } else {
+            out << "{PROTOCOL_t}" << std::get<protocol_error_t>(res).code.message();
+        }
+        return out.str();
+    }
+
+    template <typename Buffer>
+    void parse_available(redis_async::details::stream_parser_t &parser, Buffer &buff,
+                         std::vector<std::string> &replies) {
+        using Iterator = boost::asio::buffers_iterator<typename Buffer::const_buffers_type, char>;
+        using redis_async::details::stream_parser_t;
+        while (buff.size()) {
+            auto data = buff.data();
+            auto res = parser.parse(Iterator::begin(data), Iterator::end(data));
+            if (stream_parser_t::need_more(res))
+                return;
+            replies.push_back(dump_reply(res));
+            if (auto *positive = std::get_if<redis_async::details::positive_parse_result_t>(&res))
+                buff.consume(positive->consumed);
+            else
+                buff.consume(std::get<redis_async::details::error_t>(res).consumed);
+        }
+    }
+
+    const std::string pipelined_replies = "+OK\r\n"
+                                          "-ERR some error\r\n"
+                                          ":-555423\r\n"
+                                          "$5\r\nhello\r\n"
+                                          "$0\r\n\r\n"
+                                          "$-1\r\n"
+                                          "*-1\r\n"
+                                          "*0\r\n"
+                                          "*3\r\n$3\r\nfoo\r\n*2\r\n:1\r\n$-1\r\n+bar\r\n"
+                                          "*2\r\n-ERR in array\r\n:1\r\n";
+} // namespace
+
+TEST(StreamParserTests, whole_buffer) {
+    boost::asio::streambuf buff;
+    redis_async::details::stream_parser_t parser;
+    std::vector<std::string> replies;
+
+    std::ostream(&buff) << pipelined_replies;
+    parse_available(parser, buff, replies);
+
+    ASSERT_EQ(buff.size(), 0);
+    ASSERT_EQ(replies.size(), 10);
+    ASSERT_EQ(replies[0], "OK#5");
+    ASSERT_EQ(replies[1], "{ERROR_t}ERR some error#17");
+    ASSERT_EQ(replies[2], "-555423#10");
+    ASSERT_EQ(replies[3], "hello#11");
+    ASSERT_EQ(replies[4], "#6");
+    ASSERT_EQ(replies[5], "{NIL_t}#5");
+    ASSERT_EQ(replies[6], "{NIL_t}#5");
+    ASSERT_EQ(replies[7], "{ARRAY_t}\n#4");
+    ASSERT_EQ(replies[8], "{ARRAY_t}\n\tfoo\n\t{ARRAY_t}\n\t1\n\t{NIL_t}\n\n\tbar\n#32");
+    // an error inside of an array fails the whole reply
+    ASSERT_EQ(replies[9], "{ERROR_t}ERR in array#23");
+}
+
+TEST(StreamParserTests, split_at_every_byte) {
+    std::vector<std::string> expected;
+    {
+        boost::asio::streambuf buff;
+        redis_async::details::stream_parser_t parser;
+        std::ostream(&buff) << pipelined_replies;
+        parse_available(parser, buff, expected);
+    }
+
+    for (std::size_t split = 0; split <= pipelined_replies.size(); ++split) {
+        boost::asio::streambuf buff;
+        redis_async::details::stream_parser_t parser;
+        std::vector<std::string> replies;
+
+        std::ostream(&buff) << pipelined_replies.substr(0, split);
+        parse_available(parser, buff, replies);
+        std::ostream(&buff) << pipelined_replies.substr(split);
+        parse_available(parser, buff, replies);
+
+        ASSERT_EQ(buff.size(), 0) << "split at " << split;
+        ASSERT_EQ(replies, expected) << "split at " << split;
+    }
+}
+
+TEST(StreamParserTests, byte_by_byte) {
+    std::vector<std::string> expected;
+    {
+        boost::asio::streambuf buff;
+        redis_async::details::stream_parser_t parser;
+        std::ostream(&buff) << pipelined_replies;
+        parse_available(parser, buff, expected);
+    }
+
+    boost::asio::streambuf buff;
+    redis_async::details::stream_parser_t parser;
+    std::vector<std::string> replies;
+    for (auto c : pipelined_replies) {
+        std::ostream(&buff) << c;
+        parse_available(parser, buff, replies);
+    }
+    ASSERT_EQ(buff.size(), 0);
+    ASSERT_EQ(replies, expected);
+}
+
+TEST(StreamParserTests, protocol_errors) {
+    using Buffer = boost::asio::streambuf;
+    using Iterator = boost::asio::buffers_iterator<Buffer::const_buffers_type, char>;
+    namespace error = redis_async::error;
+    using redis_async::details::protocol_error_t;
+
+    const std::vector<std::pair<std::string, error::errc>> cases = {
+        {"&4\r\n", error::errc::wrong_introduction},
+        {"*2\r\n$4\r\nSome\r\n&4\r\n", error::errc::wrong_introduction},
+        {":beef\r\n", error::errc::count_conversion},
+        {"*2\r\n$beef\r\n", error::errc::count_conversion},
+        {"$-4\r\n", error::errc::count_range},
+        {"*2\r\n*-4\r\n", error::errc::count_range},
+        {"$4\r\nSome!!\r\n", error::errc::bulk_terminator},
+    };
+
+    redis_async::details::stream_parser_t parser;
+    for (const auto &c : cases) {
+        Buffer buff;
+        std::ostream(&buff) << c.first;
+        auto data = buff.data();
+        auto res = parser.parse(Iterator::begin(data), Iterator::end(data));
+        ASSERT_EQ(std::get<protocol_error_t>(res).code, error::make_error_code(c.second))
+            << c.first;
+    }
+
+    // the parser is ready for a new reply after an error
+    Buffer buff;
+    std::ostream(&buff) << "+OK\r\n";
+    auto data = buff.data();
+    auto res = parser.parse(Iterator::begin(data), Iterator::end(data));
+    ASSERT_EQ(dump_reply(res), "OK#5");
+}
+
+TEST(StreamParserTests, views_of_recv_buffer) {
+    using redis_async::details::error_t;
+    using redis_async::details::reply_scanner_t;
+    using redis_async::details::view_parser_t;
+    std::vector<std::string> expected;
+    {
+        boost::asio::streambuf buff;
+        redis_async::details::stream_parser_t parser;
+        std::ostream(&buff) << pipelined_replies;
+        parse_available(parser, buff, expected);
+    }
+
+    // small chunks, so the buffer is reallocated while the views refer to it
+    redis_async::details::recv_buffer_t buff{8};
+    reply_scanner_t scanner;
+    view_parser_t view_parser;
+    std::vector<redis_async::reply_view_t> views;
+    std::vector<std::string> replies;
+    for (std::size_t pos = 0; pos < pipelined_replies.size(); pos += 7) {
+        auto chunk = pipelined_replies.substr(pos, 7);
+        auto space = buff.prepare(chunk.size());
+        std::memcpy(space.data(), chunk.data(), chunk.size());
+        buff.commit(chunk.size());
+        while (buff.size()) {
+            auto from = buff.data(), to = from + buff.size();
+            auto scanned = scanner.parse(from, to);
+            if (reply_scanner_t::need_more(scanned))
+                break;
+            if (auto *err = std::get_if<error_t>(&scanned)) {
+                replies.push_back("{ERROR_t}" + err->str + '#' + std::to_string(err->consumed));
+                buff.consume(err->consumed);
+                continue;
+            }
+            auto consumed = std::get<reply_scanner_t::positive_result_type>(scanned).consumed;
+            auto res = view_parser.parse(from, from + consumed);
+            auto &positive = std::get<view_parser_t::positive_result_type>(res);
+            ASSERT_EQ(positive.consumed, consumed);
+            views.push_back({std::move(positive.result), buff.chunk()});
+            replies.push_back("#" + std::to_string(consumed));
+            buff.consume(consumed);
+        }
+    }
+    ASSERT_EQ(buff.size(), 0);
+    ASSERT_EQ(replies.size(), expected.size());
+
+    // dump the views after all the reads, when their chunks are not used anymore
+    auto view = views.begin();
+    for (auto &reply : replies) {
+        if (reply[0] != '#')
+            continue;
+        std::ostringstream out;
+        std::visit([&out](const auto &v) { out << v; }, (view++)->value);
+        reply = out.str() + reply;
+    }
+    ASSERT_EQ(replies, expected);
+}
+
+TEST(StreamParserTests, flat_reply) {
+    using Buffer = boost::asio::streambuf;
+    using Iterator = boost::asio::buffers_iterator<Buffer::const_buffers_type, char>;
+    using redis_async::details::error_t;
+    using redis_async::details::flat_parser_t;
+    std::vector<std::string> expected;
+    {
+        Buffer buff;
+        redis_async::details::stream_parser_t parser;
+        std::ostream(&buff) << pipelined_replies;
+        parse_available(parser, buff, expected);
+    }
+
+    for (std::size_t split = 0; split <= pipelined_replies.size(); ++split) {
+        Buffer buff;
+        flat_parser_t parser;
+        std::vector<std::string> replies;
+        for (const auto &part : {pipelined_replies.substr(0, split), pipelined_replies.substr(split)}) {
+            std::ostream(&buff) << part;
+            while (buff.size()) {
+                auto data = buff.data();
+                auto res = parser.parse(Iterator::begin(data), Iterator::end(data));
+                if (flat_parser_t::need_more(res))
+                    break;
+                if (auto *err = std::get_if<error_t>(&res)) {
+                    replies.push_back("{ERROR_t}" + err->str + '#' +
+                                      std::to_string(err->consumed));
+                    buff.consume(err->consumed);
+                    continue;
+                }
+                auto &positive = std::get<flat_parser_t::positive_result_type>(res);
+                std::ostringstream out;
+                out << positive.result << '#' << positive.consumed;
+                replies.push_back(out.str());
+                buff.consume(positive.consumed);
+            }
+        }
+        ASSERT_EQ(replies, expected) << "split at " << split;
+    }
+}
+
+TEST(StreamParserTests, flat_reply_cursor) {
+    using redis_async::node_type;
+    using redis_async::details::flat_parser_t;
+    const std::string reply = "*4\r\n$3\r\nfoo\r\n*2\r\n:1\r\n$-1\r\n*0\r\n+bar\r\n";
+
+    flat_parser_t parser;
+    auto res = parser.parse(reply.data(), reply.data() + reply.size());
+    auto flat = std::get<flat_parser_t::positive_result_type>(res).result;
+    ASSERT_EQ(flat.size(), 7);
+
+    // copies own their nodes
+    auto copy = flat;
+    flat = {};
+    auto root = copy.root();
+    ASSERT_EQ(root.size(), 4);
+    ASSERT_EQ(root[0].string(), "foo");
+    ASSERT_EQ(root[1].size(), 2);
+    ASSERT_EQ(root[1][0].integer(), 1);
+    ASSERT_TRUE(root[1][1].is_nil());
+    ASSERT_EQ(root[2].size(), 0);
+    ASSERT_TRUE(root[2].begin() == root[2].end());
+    ASSERT_EQ(root[3].string(), "bar");
+    ASSERT_EQ(root[3].type(), node_type::string);
+    ASSERT_THROW(root[3].integer(), redis_async::error::client_error);
+    ASSERT_THROW(root.string(), redis_async::error::client_error);
+
+    std::size_t count = 0;
+    for (auto item : root)
+        count += item.visit([](const auto &) { return 1; });
+    ASSERT_EQ(count, 4);
+}
+
+TEST(StreamParserTests, resp3) {
+    const std::string replies = "_\r\n"
+                                ",1.5\r\n"
+                                ",-inf\r\n"
+                                "#t\r\n"
+                                "(3492890328409238509324850943850943825024385\r\n"
+                                "!9\r\nERR oops!\r\n"
+                                "=8\r\ntxt:Some\r\n"
+                                "%2\r\n+a\r\n:1\r\n+b\r\n#f\r\n"
+                                "~2\r\n:1\r\n:2\r\n"
+                                "|1\r\n+ttl\r\n:3600\r\n+OK\r\n"
+                                "*2\r\n|1\r\n+ttl\r\n*1\r\n:1\r\n:2\r\n:3\r\n"
+                                ">2\r\n+invalidate\r\n*1\r\n+key\r\n"
+                                "%0\r\n";
+    const std::vector<std::string> expected = {
+        "{NIL_t}#3",
+        "1.5#6",
+        "-inf#7",
+        "1#4",
+        "3492890328409238509324850943850943825024385#46",
+        "{ERROR_t}ERR oops!#15",
+        "Some#14",
+        "{MAP_t}\n\ta => 1\n\tb => 0\n#20",
+        "{ARRAY_t}\n\t1\n\t2\n#12",
+        // attributes are skipped
+        "OK#22",
+        "{ARRAY_t}\n\t2\n\t3\n#30",
+        "{ARRAY_t}\n\tinvalidate\n\t{ARRAY_t}\n\tkey\n\n#27",
+        "{MAP_t}\n#4",
+    };
+
+    for (std::size_t split = 0; split <= replies.size(); ++split) {
+        boost::asio::streambuf buff;
+        redis_async::details::stream_parser_t parser;
+        std::vector<std::string> parsed;
+        std::ostream(&buff) << replies.substr(0, split);
+        parse_available(parser, buff, parsed);
+        std::ostream(&buff) << replies.substr(split);
+        parse_available(parser, buff, parsed);
+        ASSERT_EQ(parsed, expected) << "split at " << split;
+    }
+
+    // raw_parse gives the same replies
+    auto from = replies.begin();
+    for (const auto &reply : expected) {
+        auto res = redis_async::details::raw_parse(from, replies.end());
+        ASSERT_EQ(dump_reply(res), reply);
+        from += std::stoul(reply.substr(reply.rfind('#') + 1));
+    }
+
+    // maps, doubles and booleans are nodes of a flat reply
+    using redis_async::node_type;
+    using redis_async::details::flat_parser_t;
+    const std::string map = "%2\r\n+a\r\n,0.25\r\n+b\r\n#t\r\n";
+    flat_parser_t flat_parser;
+    auto res = flat_parser.parse(map.data(), map.data() + map.size());
+    auto root = std::get<flat_parser_t::positive_result_type>(res).result.root();
+    ASSERT_EQ(root.type(), node_type::map);
+    ASSERT_EQ(root.size(), 4);
+    ASSERT_EQ(root[0].string(), "a");
+    ASSERT_EQ(root[1].floating(), 0.25);
+    ASSERT_EQ(root[3].boolean(), true);
+    ASSERT_THROW(root[3].integer(), redis_async::error::client_error);
+}
+
+namespace {
+    struct point_t {
+        double x;
+        double y;
+    };
+
+    /** Decode the reply split at every byte, check every split gives the same value */
+    template <typename T>
+    T decode_split(const std::string &reply) {
+        using redis_async::details::decoding_parser_t;
+        using redis_async::details::reply_decoder_t;
+        std::optional<T> first;
+        for (std::size_t split = 0; split <= reply.size(); ++split) {
+            decoding_parser_t parser;
+            std::optional<T> value;
+            auto decoder = std::make_shared<reply_decoder_t<T>>([&](T v) { value = std::move(v); });
+            parser.builder().target(decoder.get());
+
+            std::string buff = reply.substr(0, split);
+            auto res = parser.parse(buff.data(), buff.data() + buff.size());
+            if (decoding_parser_t::need_more(res)) {
+                buff += reply.substr(split);
+                res = parser.parse(buff.data(), buff.data() + buff.size());
+            }
+            EXPECT_EQ(std::get<decoding_parser_t::positive_result_type>(res).consumed, reply.size());
+            decoder->deliver();
+            if (!first)
+                first = std::move(value);
+        }
+        return std::move(*first);
+    }
+} // namespace
+
+template <>
+struct redis_async::reply_traits<point_t> {
+    using wire_type = std::tuple<double, double>;
+    static point_t convert(wire_type &&v) {
+        return {std::get<0>(v), std::get<1>(v)};
+    }
+};
+
+TEST(ReplyDecoderTests, scalars) {
+    using redis_async::int_t;
+    ASSERT_EQ(decode_split<int_t>(":-555423\r\n"), -555423);
+    ASSERT_EQ(decode_split<int>("$3\r\n423\r\n"), 423);
+    ASSERT_EQ(decode_split<double>("$4\r\n1.25\r\n"), 1.25);
+    ASSERT_EQ(decode_split<std::string>("+OK\r\n"), "OK");
+    ASSERT_EQ(decode_split<std::string>("$5\r\nhello\r\n"), "hello");
+    ASSERT_EQ(decode_split<std::optional<std::string>>("$-1\r\n"), std::nullopt);
+    ASSERT_EQ(decode_split<std::optional<std::string>>("$2\r\nhi\r\n"), "hi");
+}
+
+TEST(ReplyDecoderTests, containers) {
+    using redis_async::int_t;
+    const std::string mget = "*3\r\n$3\r\nfoo\r\n$-1\r\n$3\r\nbar\r\n";
+    std::vector<std::optional<std::string>> values{"foo", std::nullopt, "bar"};
+    ASSERT_EQ(decode_split<std::vector<std::optional<std::string>>>(mget), values);
+    ASSERT_TRUE(decode_split<std::vector<std::string>>("*0\r\n").empty());
+
+    const std::string hgetall = "*4\r\n$2\r\nf1\r\n$2\r\nv1\r\n$2\r\nf2\r\n$2\r\nv2\r\n";
+    std::unordered_map<std::string, std::string> fields{{"f1", "v1"}, {"f2", "v2"}};
+    ASSERT_EQ((decode_split<std::unordered_map<std::string, std::string>>(hgetall)), fields);
+    ASSERT_EQ((decode_split<std::map<std::string, std::string>>(hgetall).size()), 2);
+
+    const std::string scan = "*2\r\n$2\r\n17\r\n*2\r\n$1\r\na\r\n$1\r\nb\r\n";
+    auto [cursor, keys] = decode_split<std::tuple<int_t, std::vector<std::string>>>(scan);
+    ASSERT_EQ(cursor, 17);
+    ASSERT_EQ(keys, (std::vector<std::string>{"a", "b"}));
+
+    const std::string nested = "*2\r\n*2\r\n:1\r\n:2\r\n*-1\r\n";
+    auto lists = decode_split<std::vector<std::optional<std::vector<int_t>>>>(nested);
+    ASSERT_EQ(lists.size(), 2);
+    ASSERT_EQ(*lists[0], (std::vector<int_t>{1, 2}));
+    ASSERT_EQ(lists[1], std::nullopt);
+
+    auto pair = decode_split<std::pair<std::string, int_t>>("*2\r\n$3\r\nkey\r\n:5\r\n");
+    ASSERT_EQ(pair, (std::pair<std::string, int_t>{"key", 5}));
+
+    auto points = decode_split<std::vector<point_t>>("*1\r\n*2\r\n$3\r\n1.5\r\n$2\r\n-2\r\n");
+    ASSERT_EQ(points.size(), 1);
+    ASSERT_EQ(points[0].x, 1.5);
+    ASSERT_EQ(points[0].y, -2);
+}
+
+TEST(ReplyDecoderTests, resp3) {
+    using redis_async::int_t;
+    ASSERT_EQ(decode_split<double>(",1.5\r\n"), 1.5);
+    ASSERT_EQ(decode_split<bool>("#t\r\n"), true);
+    ASSERT_EQ(decode_split<std::optional<int_t>>("_\r\n"), std::nullopt);
+    ASSERT_EQ(decode_split<std::string>("=8\r\ntxt:Some\r\n"), "Some");
+
+    const std::string hgetall = "%2\r\n$2\r\nf1\r\n:1\r\n$2\r\nf2\r\n:2\r\n";
+    std::map<std::string, int_t> fields{{"f1", 1}, {"f2", 2}};
+    ASSERT_EQ((decode_split<std::map<std::string, int_t>>(hgetall)), fields);
+    auto pairs = decode_split<std::vector<std::pair<std::string, double>>>(
+        "*1\r\n*2\r\n$1\r\na\r\n,0.5\r\n");
+    ASSERT_EQ(pairs[0].second, 0.5);
+    auto members = decode_split<std::vector<std::string>>("|1\r\n+ttl\r\n:1\r\n~1\r\n+m\r\n");
+    ASSERT_EQ(members, std::vector<std::string>{"m"});
+}
+
+TEST(ReplyDecoderTests, mismatch) {
+    using redis_async::int_t;
+    namespace error = redis_async::error;
+    ASSERT_THROW(decode_split<int_t>("$3\r\nabc\r\n"), error::client_error);
+    ASSERT_THROW(decode_split<std::string>("$-1\r\n"), error::client_error);
+    ASSERT_THROW(decode_split<std::string>("*1\r\n:1\r\n"), error::client_error);
+    ASSERT_THROW((decode_split<std::tuple<int_t, int_t>>("*1\r\n:1\r\n")), error::client_error);
+    ASSERT_THROW((decode_split<std::map<std::string, std::string>>("*1\r\n+a\r\n")),
+                 error::client_error);
+    // the rest of the reply is consumed after a mismatch
+    ASSERT_THROW(decode_split<std::vector<int_t>>("*3\r\n:1\r\n*1\r\n+x\r\n:3\r\n"),
+                 error::client_error);
+}
+
+TEST(ReplyDecoderTests, async_completion) {
+    using redis_async::details::async_reply_decoder_t;
+    using redis_async::details::decoding_parser_t;
+    namespace error = redis_async::error;
+    using completion_t = std::function<void(std::exception_ptr, std::string)>;
+
+    std::exception_ptr err;
+    std::string value;
+    int calls = 0;
+    completion_t handler = [&](std::exception_ptr e, std::string v) {
+        err = e;
+        value = std::move(v);
+        ++calls;
+    };
+
+    decoding_parser_t parser;
+    const std::string reply = "$5\r\nhello\r\n";
+    async_reply_decoder_t<std::string, completion_t> decoder{completion_t{handler}};
+    ASSERT_TRUE(decoder.completes_request());
+    parser.builder().target(&decoder);
+    parser.parse(reply.data(), reply.data() + reply.size());
+    decoder.complete();
+    // the handler is called once, inline for the default executor
+    decoder.fail(error::connection_error("closed"));
+    ASSERT_EQ(calls, 1);
+    ASSERT_FALSE(err);
+    ASSERT_EQ(value, "hello");
+
+    // errors keep their type
+    async_reply_decoder_t<std::string, completion_t> failed{completion_t{handler}};
+    failed.fail(error::query_error("ERR wrong"));
+    ASSERT_EQ(calls, 2);
+    ASSERT_THROW(std::rethrow_exception(err), error::query_error);
+
+    // the decoding error completes the request
+    async_reply_decoder_t<std::string, completion_t> mismatch{completion_t{handler}};
+    const std::string integer = ":1\r\n";
+    parser.builder().target(&mismatch);
+    parser.parse(integer.data(), integer.data() + integer.size());
+    mismatch.complete();
+    ASSERT_EQ(calls, 3);
+    ASSERT_THROW(std::rethrow_exception(err), error::client_error);
+}